@@ -0,0 +1,84 @@
+#pragma once
+
+#include <limits>
+
+#include "Ray.h"
+
+// An axis aligned bounding box. A default constructed box is empty, and growing it
+// with Extend() makes it enclose the given points and boxes.
+class AABB {
+  public:
+    AABB():
+      min(std::numeric_limits<float>::infinity()),
+      max(-std::numeric_limits<float>::infinity())
+    {}
+
+    AABB(const glm::vec3 &min, const glm::vec3 &max):
+      min(min),
+      max(max)
+    {}
+
+    /* A box covering all of space, for objects like planes that have no finite bounds */
+    static AABB Infinite() {
+      return AABB(glm::vec3(-std::numeric_limits<float>::infinity()), glm::vec3(std::numeric_limits<float>::infinity()));
+    }
+
+    glm::vec3 min;
+    glm::vec3 max;
+
+    bool IsEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+    bool IsFinite() const {
+      return glm::all(glm::lessThan(glm::abs(min), glm::vec3(std::numeric_limits<float>::max()))) &&
+             glm::all(glm::lessThan(glm::abs(max), glm::vec3(std::numeric_limits<float>::max())));
+    }
+
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    glm::vec3 Extent() const { return max - min; }
+
+    /* Half the surface area, which is all the surface area heuristic needs */
+    float HalfArea() const {
+      if (IsEmpty()) {
+        return 0.0f;
+      }
+      glm::vec3 e = Extent();
+      return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    void Extend(const glm::vec3 &point) {
+      min = glm::min(min, point);
+      max = glm::max(max, point);
+    }
+
+    void Extend(const AABB &box) {
+      min = glm::min(min, box.min);
+      max = glm::max(max, box.max);
+    }
+
+    /* The part of this box that is also in box, empty if they don't overlap */
+    AABB Intersection(const AABB &box) const {
+      return AABB(glm::max(min, box.min), glm::min(max, box.max));
+    }
+
+    bool Overlaps(const AABB &box) const {
+      return min.x <= box.max.x && max.x >= box.min.x &&
+             min.y <= box.max.y && max.y >= box.min.y &&
+             min.z <= box.max.z && max.z >= box.min.z;
+    }
+
+    /*
+    ** Slab test of a ray against the box. On a hit, tNear and tFar are the parameters at which
+    ** the ray enters and leaves the box (tNear is clamped to 0 when the origin is inside).
+    */
+    bool Intersect(const Ray &ray, float &tNear, float &tFar) const {
+      glm::vec3 inverseDirection = 1.0f / ray.direction;
+      glm::vec3 t0 = (min - ray.origin) * inverseDirection;
+      glm::vec3 t1 = (max - ray.origin) * inverseDirection;
+      glm::vec3 tSmall = glm::min(t0, t1);
+      glm::vec3 tBig = glm::max(t0, t1);
+
+      tNear = glm::max(0.0f, glm::max(tSmall.x, glm::max(tSmall.y, tSmall.z)));
+      tFar = glm::min(tBig.x, glm::min(tBig.y, tBig.z));
+
+      return tNear <= tFar;
+    }
+};
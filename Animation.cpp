@@ -0,0 +1,229 @@
+#include "Animation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtx/quaternion.hpp"
+#include "glm/gtx/spline.hpp"
+
+#include "Instance.h"
+
+glm::mat4 TransformKey::Transform() const {
+    return glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+}
+
+/*
+** Finds where time falls between the keys: after key i, u of the way to key i + 1. The spline
+** through key i and i + 1 also uses the keys either side of them, repeating the ends.
+*/
+template<class Key>
+static void FindSegment(const std::vector<Key> &keys, float time, int &i0, int &i1, int &i2, int &i3, float &u) {
+
+    int last = keys.size() - 1;
+    int i = 0;
+    u = 0.0f;
+
+    if (time >= keys[last].time) {
+        i = last;
+    } else if (time > keys[0].time) {
+        while (keys[i + 1].time <= time) {
+            i++;
+        }
+        u = (time - keys[i].time) / (keys[i + 1].time - keys[i].time);
+    }
+
+    i0 = std::max(i - 1, 0);
+    i1 = i;
+    i2 = std::min(i + 1, last);
+    i3 = std::min(i + 2, last);
+}
+
+// The log and exp of unit quaternions, as the rotation vector (axis times half angle) and back
+static glm::vec3 Log(const glm::quat &q) {
+    glm::vec3 axis(q.x, q.y, q.z);
+    float sine = glm::length(axis);
+    return sine < 1e-6f ? axis : axis * (atan2f(sine, q.w) / sine);
+}
+
+static glm::quat Exp(const glm::vec3 &v) {
+    float angle = glm::length(v);
+    glm::vec3 axis = angle < 1e-6f ? v : v * (sinf(angle) / angle);
+    return glm::quat(cosf(angle), axis.x, axis.y, axis.z);
+}
+
+// The squad control point at curr. glm's intermediate() adds where it should multiply and
+// divides by zero when neighbouring keys are equal, so this is the textbook version.
+static glm::quat Intermediate(const glm::quat &prev, const glm::quat &curr, const glm::quat &next) {
+    glm::quat inverse = glm::conjugate(curr);
+    return curr * Exp((Log(inverse * next) + Log(inverse * prev)) * -0.25f);
+}
+
+template<class Key>
+static bool Earlier(const Key &a, const Key &b) {
+    return a.time < b.time;
+}
+
+bool Animation::Load(const std::string &path, const std::vector<Object *> &objects) {
+
+    std::ifstream file(path.c_str());
+    if (!file) {
+        std::cerr << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        std::istringstream words(line);
+        std::string kind;
+        if (!(words >> kind) || kind[0] == '#') {
+            continue;
+        }
+
+        if (kind == "camera") {
+            CameraKey key;
+            Camera &camera = key.camera;
+            if (!(words >> key.time >> camera.eye.x >> camera.eye.y >> camera.eye.z >> camera.center.x >> camera.center.y >> camera.center.z)) {
+                std::cerr << path << ":" << lineNumber << ": expected camera <frame> <eye> <center> [<field of view>]" << std::endl;
+                return false;
+            }
+            // a failed read would zero what it reads into, so the optional parts go through temporaries
+            float fieldOfView;
+            if (words >> fieldOfView) {
+                camera.fieldOfView = fieldOfView;
+            }
+            cameraKeys.push_back(key);
+
+        } else if (kind == "object") {
+            std::string target;
+            TransformKey key;
+            if (!(words >> target >> key.time >> key.position.x >> key.position.y >> key.position.z)) {
+                std::cerr << path << ":" << lineNumber << ": expected object <id>[/<instance>] <frame> <position> [<axis> <angle> [<scale>]]" << std::endl;
+                return false;
+            }
+
+            glm::vec3 axis;
+            float angle;
+            if (words >> axis.x >> axis.y >> axis.z >> angle) {
+                key.rotation = glm::angleAxis(angle, glm::normalize(axis));
+                float scale;
+                if (words >> scale) {
+                    key.scale = scale;
+                }
+            }
+
+            // an object of the scene, or an instance inside an InstanceGroup of it
+            int id = -1, instance = -1;
+            char slash = 0;
+            std::istringstream targetWords(target);
+            targetWords >> id >> slash >> instance;
+
+            Object *object = id >= 0 && id < (int)objects.size() ? objects[id] : NULL;
+            if (object && slash == '/') {
+                InstanceGroup *group = dynamic_cast<InstanceGroup *>(object);
+                object = group && instance >= 0 && instance < (int)group->Instances().size() ? group->Instances()[instance] : NULL;
+            }
+            if (!object) {
+                std::cerr << path << ":" << lineNumber << ": no object " << target << " in the scene" << std::endl;
+                return false;
+            }
+
+            ObjectTrack *track = NULL;
+            for (size_t i = 0; i < tracks.size(); i++) {
+                if (tracks[i].object == object) {
+                    track = &tracks[i];
+                }
+            }
+            if (!track) {
+                tracks.push_back(ObjectTrack());
+                track = &tracks.back();
+                track->object = object;
+            }
+            track->keys.push_back(key);
+
+        } else {
+            std::cerr << path << ":" << lineNumber << ": unknown keyframe " << kind << std::endl;
+            return false;
+        }
+    }
+
+    std::stable_sort(cameraKeys.begin(), cameraKeys.end(), Earlier<CameraKey>);
+    for (size_t i = 0; i < tracks.size(); i++) {
+        std::vector<TransformKey> &keys = tracks[i].keys;
+        std::stable_sort(keys.begin(), keys.end(), Earlier<TransformKey>);
+
+        // q and -q are the same rotation, squad has to be given the one on the short way round
+        for (size_t k = 1; k < keys.size(); k++) {
+            if (glm::dot(keys[k - 1].rotation, keys[k].rotation) < 0.0f) {
+                keys[k].rotation = -keys[k].rotation;
+            }
+        }
+    }
+
+    return true;
+}
+
+void Animation::Turntable(const Camera &camera, int frames) {
+
+    // the spline through this many keys stays within a fraction of a percent of the circle
+    const int keys = 16;
+
+    cameraKeys.clear();
+    for (int i = 0; i <= keys; i++) {
+        CameraKey key;
+        key.time = (float)frames * i / keys;
+        key.camera = camera;
+        key.camera.eye = camera.center + glm::vec3(glm::rotate(glm::mat4(1.0f), 360.0f * i / keys, camera.up) * glm::vec4(camera.eye - camera.center, 0.0f));
+        cameraKeys.push_back(key);
+    }
+}
+
+int Animation::FrameCount() const {
+
+    float last = 0.0f;
+    if (!cameraKeys.empty()) {
+        last = cameraKeys.back().time;
+    }
+    for (size_t i = 0; i < tracks.size(); i++) {
+        last = std::max(last, tracks[i].keys.back().time);
+    }
+
+    return (int)floorf(last) + 1;
+}
+
+void Animation::Apply(float time, Camera &camera, const std::vector<Object *> &objects) const {
+
+    int i0, i1, i2, i3;
+    float u;
+
+    if (!cameraKeys.empty()) {
+        FindSegment(cameraKeys, time, i0, i1, i2, i3, u);
+        const Camera &c0 = cameraKeys[i0].camera, &c1 = cameraKeys[i1].camera, &c2 = cameraKeys[i2].camera, &c3 = cameraKeys[i3].camera;
+
+        camera.eye = glm::catmullRom(c0.eye, c1.eye, c2.eye, c3.eye, u);
+        camera.center = glm::catmullRom(c0.center, c1.center, c2.center, c3.center, u);
+        camera.up = glm::normalize(glm::mix(c1.up, c2.up, u));
+        camera.fieldOfView = glm::mix(c1.fieldOfView, c2.fieldOfView, u);
+    }
+
+    for (size_t t = 0; t < tracks.size(); t++) {
+        const std::vector<TransformKey> &keys = tracks[t].keys;
+        FindSegment(keys, time, i0, i1, i2, i3, u);
+
+        TransformKey key;
+        key.position = glm::catmullRom(keys[i0].position, keys[i1].position, keys[i2].position, keys[i3].position, u);
+        key.rotation = glm::squad(keys[i1].rotation, keys[i2].rotation,
+                                  Intermediate(keys[i0].rotation, keys[i1].rotation, keys[i2].rotation),
+                                  Intermediate(keys[i1].rotation, keys[i2].rotation, keys[i3].rotation), u);
+        key.scale = glm::mix(keys[i1].scale, keys[i2].scale, u);
+
+        tracks[t].object->SetTransform(key.Transform());
+    }
+
+    for (size_t i = 0; i < objects.size(); i++) {
+        objects[i]->Update();
+    }
+}
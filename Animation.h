@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include "Camera.h"
+#include "Object.h"
+
+// A camera pose at a point in time, which is counted in frames.
+class CameraKey {
+  public:
+    CameraKey():
+      time(0.0f)
+    {}
+
+    float time;
+    Camera camera;
+};
+
+// An object transform at a point in time, split up so that it can be interpolated.
+class TransformKey {
+  public:
+    TransformKey():
+      time(0.0f),
+      position(0.0f),
+      scale(1.0f)
+    {}
+
+    float time;
+    glm::vec3 position;
+    glm::quat rotation;
+    float scale;
+
+    glm::mat4 Transform() const;
+};
+
+class ObjectTrack {
+  public:
+    ObjectTrack():
+      object(NULL)
+    {}
+
+    Object *object;
+    std::vector<TransformKey> keys;  // sorted by time
+};
+
+/*
+** Keyframed camera and object motion. Between the keys, positions follow Catmull-Rom splines
+** and rotations are interpolated with squad, so the motion is smooth through every key.
+** Before the first key and after the last one, the first and last keys hold.
+*/
+class Animation {
+  public:
+    Animation() {}
+
+    std::vector<CameraKey> cameraKeys;  // sorted by time
+    std::vector<ObjectTrack> tracks;
+
+    /* Reads the keys from a file (see readme.txt), with object ids referring to objects. Prints what is wrong if it can't */
+    bool Load(const std::string &path, const std::vector<Object *> &objects);
+
+    /* Makes the camera circle around what it looks at once every frames frames */
+    void Turntable(const Camera &camera, int frames);
+
+    /* The frame after the last key */
+    int FrameCount() const;
+
+    /*
+    ** Poses the camera and the animated objects for the frame at time, then lets the objects
+    ** update what depends on the moved parts (InstanceGroups refit their BVH)
+    */
+    void Apply(float time, Camera &camera, const std::vector<Object *> &objects) const;
+};
@@ -0,0 +1,56 @@
+#include "Arena.h"
+
+#include <cstdlib>
+#include <stdint.h>
+
+Arena::Arena(size_t blockSize):
+    blockSize(blockSize),
+    current(NULL),
+    end(NULL),
+    bytesUsed(0)
+  {}
+
+Arena::~Arena() {
+    Release();
+}
+
+void *Arena::Allocate(size_t size, size_t alignment) {
+
+    uintptr_t aligned = ((uintptr_t)current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+    if (current == NULL || aligned + size > (uintptr_t)end) {
+        // start a new block, big enough for allocations larger than the usual block size too
+        size_t newBlockSize = size + alignment > blockSize ? size + alignment : blockSize;
+        char *block = (char *)malloc(newBlockSize);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+
+        blocks.push_back(block);
+        current = block;
+        end = block + newBlockSize;
+        aligned = ((uintptr_t)current + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+
+    current = (char *)(aligned + size);
+    bytesUsed += size;
+
+    return (void *)aligned;
+}
+
+void Arena::Release() {
+
+    for (size_t i = destructors.size(); i > 0; i--) {
+        destructors[i - 1].destroy(destructors[i - 1].object);
+    }
+    destructors.clear();
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        free(blocks[i]);
+    }
+    blocks.clear();
+
+    current = NULL;
+    end = NULL;
+    bytesUsed = 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A monotonic ("bump") allocator. Memory is handed out from large blocks in the order it is
+// requested and is only ever given back all at once by Release(), so allocating is a pointer
+// increment and there are no per-object heap headers between consecutive objects.
+// Everything is 64 byte (cache line) aligned by default.
+class Arena {
+  public:
+    Arena(size_t blockSize = 1 << 20);
+    ~Arena();
+
+    /* Returns size bytes aligned to alignment, which must be a power of two */
+    void *Allocate(size_t size, size_t alignment = 64);
+
+    /* Constructs a T inside the arena. Its destructor is run by Release() if it has one that matters */
+    template<class T, class... Args>
+    T *New(Args&&... args) {
+        T *object = new (Allocate(sizeof(T), alignof(T) > 64 ? alignof(T) : 64)) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            destructors.push_back(Destructor(&Destroy<T>, object));
+        }
+        return object;
+    }
+
+    /* Runs the pending destructors (newest first) and frees every block in one go */
+    void Release();
+
+    /* The number of bytes handed out since the last Release() */
+    size_t BytesUsed() const { return bytesUsed; }
+
+  private:
+    Arena(const Arena &);
+    Arena &operator =(const Arena &);
+
+    template<class T>
+    static void Destroy(void *object) { static_cast<T *>(object)->~T(); }
+
+    class Destructor {
+      public:
+        Destructor(void (*destroy)(void *), void *object):
+          destroy(destroy),
+          object(object)
+        {}
+
+        void (*destroy)(void *);
+        void *object;
+    };
+
+    size_t blockSize;
+    std::vector<char *> blocks;
+    char *current;  // the next free byte of the newest block
+    char *end;      // one past the newest block
+    size_t bytesUsed;
+    std::vector<Destructor> destructors;
+};
+
+// An allocator for std::vector that starts the array on a 64 byte boundary, like everything in an Arena.
+// The nodes of the acceleration structures use it rather than an Arena: they are built again whenever the
+// objects change, and an arena only gives memory back when everything in it goes.
+template<class T>
+class CacheAlignedAllocator {
+  public:
+    typedef T value_type;
+
+    CacheAlignedAllocator() {}
+    template<class U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U> &) {}
+
+    T *allocate(size_t count) {
+        void *memory = NULL;
+        if (posix_memalign(&memory, 64, count * sizeof(T) > 0 ? count * sizeof(T) : 64) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(memory);
+    }
+
+    void deallocate(T *memory, size_t) { free(memory); }
+
+    template<class U>
+    bool operator ==(const CacheAlignedAllocator<U> &) const { return true; }
+    template<class U>
+    bool operator !=(const CacheAlignedAllocator<U> &) const { return false; }
+};
+
+template<class T>
+using CacheAlignedVector = std::vector<T, CacheAlignedAllocator<T> >;
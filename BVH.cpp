@@ -0,0 +1,299 @@
+#include "BVH.h"
+
+#include <algorithm>
+
+#include "Parallel.h"
+
+// the number of buckets the centroids are sorted into when looking for the best split
+static const int binCount = 16;
+// subtrees of fewer nodes than this are refitted by one thread, the refit isn't split up further
+static const int refitGrain = 2048;
+
+void BVH::Build(const std::vector<const Object *> &objects) {
+
+    nodes.clear();
+    primitives = objects;
+
+    if (objects.empty()) {
+        return;
+    }
+
+    std::vector<AABB> bounds(objects.size());
+    std::vector<glm::vec3> centroids(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        bounds[i] = objects[i]->Bounds();
+        centroids[i] = bounds[i].Center();
+    }
+
+    nodes.reserve(2 * objects.size());
+    BuildRecursive(bounds, centroids, 0, objects.size(), 1);
+}
+
+int BVH::BuildRecursive(std::vector<AABB> &bounds, std::vector<glm::vec3> &centroids, int begin, int end, int depth) {
+
+    int index = nodes.size();
+    nodes.push_back(BVHNode());
+
+    AABB nodeBounds, centroidBounds;
+    for (int i = begin; i < end; i++) {
+        nodeBounds.Extend(bounds[i]);
+        centroidBounds.Extend(centroids[i]);
+    }
+    nodes[index].bounds = nodeBounds;
+
+    int count = end - begin;
+    if (count <= bvhMaxLeafSize) {
+        nodes[index].offset = begin;
+        nodes[index].count = count;
+        return index;
+    }
+
+    // split along the axis the centroids are most spread out on
+    glm::vec3 extent = centroidBounds.Extent();
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+    int mid = begin + count / 2;
+
+    if (extent[axis] > 0.0f && depth < bvhMaxDepth) {
+        // bin the centroids and sweep the bins for the split with the lowest surface area heuristic cost
+        AABB binBounds[binCount];
+        int binCounts[binCount] = {0};
+        float scale = binCount / extent[axis];
+
+        for (int i = begin; i < end; i++) {
+            int bin = std::min(binCount - 1, (int)((centroids[i][axis] - centroidBounds.min[axis]) * scale));
+            binBounds[bin].Extend(bounds[i]);
+            binCounts[bin]++;
+        }
+
+        float rightCost[binCount];
+        AABB right;
+        int rightCount = 0;
+        for (int bin = binCount - 1; bin > 0; bin--) {
+            right.Extend(binBounds[bin]);
+            rightCount += binCounts[bin];
+            rightCost[bin] = right.HalfArea() * rightCount;
+        }
+
+        float bestCost = std::numeric_limits<float>::infinity();
+        int bestBin = -1;
+        AABB left;
+        int leftCount = 0;
+        for (int bin = 1; bin < binCount; bin++) {
+            left.Extend(binBounds[bin - 1]);
+            leftCount += binCounts[bin - 1];
+            float cost = left.HalfArea() * leftCount + rightCost[bin];
+            if (leftCount > 0 && leftCount < count && cost < bestCost) {
+                bestCost = cost;
+                bestBin = bin;
+            }
+        }
+
+        if (bestBin > 0) {
+            // move everything left of the chosen bin to the front of the range
+            mid = begin;
+            for (int i = begin; i < end; i++) {
+                int bin = std::min(binCount - 1, (int)((centroids[i][axis] - centroidBounds.min[axis]) * scale));
+                if (bin < bestBin) {
+                    std::swap(bounds[i], bounds[mid]);
+                    std::swap(centroids[i], centroids[mid]);
+                    std::swap(primitives[i], primitives[mid]);
+                    mid++;
+                }
+            }
+        }
+    }
+
+    BuildRecursive(bounds, centroids, begin, mid, depth + 1);
+    int second = BuildRecursive(bounds, centroids, mid, end, depth + 1);
+
+    nodes[index].offset = second;
+    nodes[index].count = 0;
+
+    return index;
+}
+
+int BVH::Depth() const {
+
+    // the nodes are depth first, so every node comes after its parent
+    std::vector<int> depths(nodes.size(), 1);
+    int deepest = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        deepest = std::max(deepest, depths[i]);
+        if (!nodes[i].IsLeaf()) {
+            depths[i + 1] = depths[nodes[i].offset] = depths[i] + 1;
+        }
+    }
+    return deepest;
+}
+
+int BVH::SubtreeEnd(int index) const {
+    // the last node of a subtree is the last leaf of the second child's subtree
+    while (!nodes[index].IsLeaf()) {
+        index = nodes[index].offset;
+    }
+    return index + 1;
+}
+
+void BVH::RefitNode(int index) {
+    BVHNode &node = nodes[index];
+
+    if (node.IsLeaf()) {
+        node.bounds = AABB();
+        for (int j = node.offset; j < node.offset + node.count; j++) {
+            node.bounds.Extend(primitives[j]->Bounds());
+        }
+    } else {
+        node.bounds = nodes[index + 1].bounds;
+        node.bounds.Extend(nodes[node.offset].bounds);
+    }
+}
+
+void BVH::Refit() {
+
+    if (nodes.empty()) {
+        return;
+    }
+
+    // split the tree from the root down into subtrees of about a few per thread, each no bigger than
+    // grain nodes unless it is a leaf; the nodes above them are what is left to do afterwards
+    int grain = std::max(refitGrain, (int)nodes.size() / (4 * WorkerCount()));
+    std::vector<int> subtrees, above;
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        if (nodes[index].IsLeaf() || SubtreeEnd(index) - index <= grain) {
+            subtrees.push_back(index);
+        } else {
+            above.push_back(index);
+            stack.push_back(index + 1);
+            stack.push_back(nodes[index].offset);
+        }
+    }
+
+    // children are always stored after their parent, so going backwards visits them first
+    ParallelFor(subtrees.size(), [&](int i) {
+        for (int index = SubtreeEnd(subtrees[i]) - 1; index >= subtrees[i]; index--) {
+            RefitNode(index);
+        }
+    });
+
+    std::sort(above.begin(), above.end());
+    for (int i = (int)above.size() - 1; i >= 0; i--) {
+        RefitNode(above[i]);
+    }
+}
+
+float BVH::SAHCost() const {
+
+    if (nodes.empty() || nodes[0].bounds.HalfArea() <= 0.0f) {
+        return 0.0f;
+    }
+
+    float cost = 0.0f;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        cost += nodes[i].bounds.HalfArea() * (nodes[i].IsLeaf() ? nodes[i].count : bvhBoxTestCost);
+    }
+    return cost / nodes[0].bounds.HalfArea();
+}
+
+bool BVH::Intersect(const Ray &ray, IntersectInfo &info) const {
+
+    if (nodes.empty()) {
+        return false;
+    }
+
+    // the boxes give ray parameters, the hits give distances
+    float length = glm::length(ray.direction);
+
+    IntersectInfo closest;
+    bool hit = false;
+
+    int stack[bvhStackSize];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const BVHNode &node = nodes[stack[--top]];
+
+        float tNear, tFar;
+        if (!node.bounds.Intersect(ray, tNear, tFar) || tNear * length > closest.time) {
+            continue;
+        }
+
+        if (node.IsLeaf()) {
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                IntersectInfo candidate;
+                if (primitives[i]->Intersect(ray, candidate) && candidate.time < closest.time) {
+                    closest = candidate;
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        // visit the nearer child first, so the farther one is more likely to be culled
+        int first = &node - &nodes[0] + 1;
+        int second = node.offset;
+        float firstNear, secondNear;
+        bool firstHit = nodes[first].bounds.Intersect(ray, firstNear, tFar);
+        bool secondHit = nodes[second].bounds.Intersect(ray, secondNear, tFar);
+
+        if (firstHit && secondHit) {
+            if (firstNear > secondNear) {
+                std::swap(first, second);
+            }
+            stack[top++] = second;
+            stack[top++] = first;
+        } else if (firstHit) {
+            stack[top++] = first;
+        } else if (secondHit) {
+            stack[top++] = second;
+        }
+    }
+
+    if (hit) {
+        info = closest;
+    }
+
+    return hit;
+}
+
+const Object *BVH::Occluder(const Ray &ray, float distance) const {
+
+    if (nodes.empty()) {
+        return NULL;
+    }
+
+    float length = glm::length(ray.direction);
+
+    int stack[bvhStackSize];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const BVHNode &node = nodes[stack[--top]];
+
+        float tNear, tFar;
+        if (!node.bounds.Intersect(ray, tNear, tFar) || tNear * length > distance) {
+            continue;
+        }
+
+        if (node.IsLeaf()) {
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                IntersectInfo candidate;
+                if (primitives[i]->Intersect(ray, candidate) && candidate.time < distance) {
+                    return primitives[i];
+                }
+            }
+            continue;
+        }
+
+        // any hit will do, so the order of the children doesn't matter
+        stack[top++] = node.offset;
+        stack[top++] = &node - &nodes[0] + 1;
+    }
+
+    return NULL;
+}
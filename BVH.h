@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+
+#include "Arena.h"
+#include "Object.h"
+
+// Leaves hold at most this many primitives
+const int bvhMaxLeafSize = 4;
+// How many nodes deep the builds choose their splits for cost; below, they split the primitives in half
+// by count, so no tree is deeper than this plus the log2 of its primitives, which the traversal stacks
+// of bvhStackSize entries (one per level, and one more) always hold
+const int bvhMaxDepth = 64;
+const int bvhStackSize = 128;
+// What testing a ray against a node's box costs, counted in primitive tests, for the surface area heuristic
+const float bvhBoxTestCost = 1.0f;
+
+// One node of a bounding volume hierarchy. The nodes are stored depth first, so the first
+// child of an interior node is always the node right after it.
+class BVHNode {
+  public:
+    BVHNode():
+      offset(0),
+      count(0)
+    {}
+
+    AABB bounds;
+    int offset;  // leaves: the index of the first primitive, interior nodes: the index of the second child
+    int count;   // the number of primitives in a leaf, 0 for interior nodes
+
+    bool IsLeaf() const { return count > 0; }
+};
+
+/*
+** A binary bounding volume hierarchy over objects with finite bounds, built with the surface
+** area heuristic over binned centroids (or see BuildLinear and BuildSpatial). It doesn't own
+** the objects. Used for the objects of the scene (see SceneBVH), for the primitives of a shared
+** shape and, through InstanceGroup, over the instances of shapes.
+*/
+class BVH {
+  public:
+    BVH() {}
+
+    /* Builds the hierarchy over the objects, which must all have finite bounds */
+    void Build(const std::vector<const Object *> &objects);
+
+    /*
+    ** Builds the hierarchy as a linear BVH (Karras, "Maximizing parallelism in the construction of
+    ** BVHs"): the primitives' centroids get 63 bit Morton codes and are radix sorted along the Morton
+    ** curve, and every interior node of the tree is found from the sorted codes on its own, so the
+    ** whole build runs in parallel and in time linear in the number of primitives. Its trees cost
+    ** more to trace than Build's; optimizing treelets (Karras and Aila, "Fast parallel construction
+    ** of high-quality BVHs") rebuilds every subtree of up to 7 leaves with the topology of lowest
+    ** SAH cost and recovers most of the difference, for a few times the build time.
+    */
+    void BuildLinear(const std::vector<const Object *> &objects, bool optimizeTreelets = true);
+
+    /*
+    ** Builds the hierarchy with spatial splits as well (Stich, Friedrich and Dietrich, "Spatial splits
+    ** in bounding volume hierarchies"). Where the children of the best split of the primitives would
+    ** overlap, splitting space by a plane is tried too, which cuts the primitives crossing it in two
+    ** and puts the parts, with boxes clipped to them, on both sides. Long thin triangles, whose boxes
+    ** overlap a lot, end up in far fewer nodes' way that way. Primitives may then be in several leaves;
+    ** duplicateBudget caps the added references at that fraction of the primitives. The build is
+    ** a lot slower than Build's, and a refit of the tree gives up the tighter boxes of the parts.
+    */
+    void BuildSpatial(const std::vector<const Object *> &objects, float duplicateBudget = 1.0f);
+
+    /* Recomputes the bounds of every node after the primitives have moved, keeping the tree as it is.
+       Large trees are refitted as independent subtrees in parallel, and then the few nodes above them */
+    void Refit();
+
+    /* Finds the closest hit along the ray, like Object::Intersect */
+    bool Intersect(const Ray &ray, IntersectInfo &info) const;
+
+    /* Any primitive the ray hits less than distance away, NULL if there is none. Shadow rays only need
+       to know whether something is in the way, so this stops at the first such hit */
+    const Object *Occluder(const Ray &ray, float distance) const;
+
+    AABB Bounds() const { return nodes.empty() ? AABB() : nodes[0].bounds; }
+
+    /* The surface area heuristic cost of the tree: the expected number of box and primitive tests
+       (weighted by bvhBoxTestCost) of a ray that hits the root box */
+    float SAHCost() const;
+
+    /* The most nodes on the way from the root down to a leaf, 0 for an empty tree */
+    int Depth() const;
+
+    const CacheAlignedVector<BVHNode> &Nodes() const { return nodes; }
+    const std::vector<const Object *> &Primitives() const { return primitives; }
+
+  private:
+    int BuildRecursive(std::vector<AABB> &bounds, std::vector<glm::vec3> &centroids, int begin, int end, int depth);
+    /* One past the last node of the subtree at index, whose nodes all follow it in one piece */
+    int SubtreeEnd(int index) const;
+    void RefitNode(int index);
+
+    CacheAlignedVector<BVHNode> nodes;
+    std::vector<const Object *> primitives;  // in leaf order
+};
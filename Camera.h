@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Ray.h"
+
+// Where the scene is looked at from. The defaults are the view the renders in /renders were made with.
+class Camera {
+  public:
+    Camera():
+      eye(-10.0f, 10.0f, 10.0f),
+      center(0.0f, 0.0f, 0.0f),
+      up(0.0f, 1.0f, 0.0f),
+      fieldOfView(45.0f)
+    {}
+
+    glm::vec3 eye;
+    glm::vec3 center;
+    glm::vec3 up;
+    float fieldOfView;  // vertical, in degrees
+
+    //	Three parameters of lookat(vec3 eye, vec3 center, vec3 up).
+    glm::mat4 ViewMatrix() const { return glm::lookAt(eye, center, up); }
+    glm::mat4 ProjectionMatrix(float aspect) const { return glm::perspective(fieldOfView, aspect, 1.0f, 10000.0f); }
+    glm::mat4 ViewProjection(float aspect) const { return ProjectionMatrix(aspect) * ViewMatrix(); }
+};
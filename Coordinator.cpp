@@ -0,0 +1,250 @@
+#include "Coordinator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <deque>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+
+static double Now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Coordinator::Coordinator(const std::vector<std::string> &addresses):
+    tileSize(64),
+    tilesPerServer(2),
+    speculationFactor(2.0f),
+    nextId(1)
+  {
+    for (size_t i = 0; i < addresses.size(); i++) {
+        Server server = { addresses[i], -1, 0 };
+        servers.push_back(server);
+    }
+}
+
+Coordinator::~Coordinator() {
+    for (size_t i = 0; i < servers.size(); i++) {
+        if (servers[i].fd >= 0) {
+            close(servers[i].fd);
+        }
+    }
+}
+
+int Coordinator::Connect() {
+
+    // a server that went away must not take the coordinator with it
+    signal(SIGPIPE, SIG_IGN);
+
+    int connected = 0;
+    for (size_t i = 0; i < servers.size(); i++) {
+        if (servers[i].fd < 0) {
+            servers[i].fd = ConnectTo(servers[i].address);
+            servers[i].queued = 0;
+            if (servers[i].fd < 0) {
+                std::cerr << "Could not connect to " << servers[i].address << std::endl;
+            }
+        }
+        connected += servers[i].fd >= 0;
+    }
+
+    return connected;
+}
+
+void Coordinator::Drop(int server) {
+
+    std::cerr << "Lost render server " << servers[server].address << std::endl;
+    close(servers[server].fd);
+    servers[server].fd = -1;
+    servers[server].queued = 0;
+
+    for (std::map<int, Dispatch>::iterator i = dispatches.begin(); i != dispatches.end();) {
+        if (i->second.server == server) {
+            dispatches.erase(i++);
+        } else {
+            ++i;
+        }
+    }
+}
+
+bool Coordinator::Render(const RenderJob &job, Image &image) {
+
+    if (Connect() == 0) {
+        return false;
+    }
+
+    image = Image(job.width, job.height);
+
+    int tilesX = (job.width + tileSize - 1) / tileSize;
+    int tileCount = tilesX * ((job.height + tileSize - 1) / tileSize);
+
+    std::deque<int> pending;
+    for (int i = 0; i < tileCount; i++) {
+        pending.push_back(i);
+    }
+    std::vector<bool> done(tileCount, false);
+    std::vector<int> copies(tileCount, 0);  // dispatches of each tile that are still wanted
+    int doneCount = 0;
+
+    double tileTime = 0.0;  // total over the finished tiles, for the average
+    int timedTiles = 0;
+
+    std::vector<pollfd> polled;
+    std::vector<int> polledServers;
+
+    bool failed = false;
+    while (doneCount < tileCount && !failed) {
+
+        // keep every server busy, with fresh tiles while there are any and then with copies of the stragglers
+        double now = Now();
+        for (size_t s = 0; s < servers.size(); s++) {
+            Server &server = servers[s];
+
+            while (server.fd >= 0 && server.queued < tilesPerServer) {
+                int tile = -1;
+                if (!pending.empty()) {
+                    tile = pending.front();
+                    pending.pop_front();
+                } else if (server.queued == 0 && timedTiles > 0) {
+                    double oldest = now - speculationFactor * tileTime / timedTiles;
+                    for (std::map<int, Dispatch>::iterator i = dispatches.begin(); i != dispatches.end(); ++i) {
+                        const Dispatch &dispatch = i->second;
+                        if (!dispatch.cancelled && copies[dispatch.tile] == 1 && dispatch.start < oldest) {
+                            oldest = dispatch.start;
+                            tile = dispatch.tile;
+                        }
+                    }
+                }
+                if (tile < 0) {
+                    break;
+                }
+
+                RenderJob region = job;
+                region.id = nextId++;
+                region.x0 = (tile % tilesX) * tileSize;
+                region.y0 = (tile / tilesX) * tileSize;
+                region.x1 = std::min(region.x0 + tileSize, job.width);
+                region.y1 = std::min(region.y0 + tileSize, job.height);
+
+                MessageWriter writer;
+                region.Write(writer);
+                if (!SendMessage(server.fd, MessageRenderJob, writer.data)) {
+                    pending.push_front(tile);
+                    break;  // noticed and dropped when its socket is polled
+                }
+
+                Dispatch dispatch = { tile, (int)s, now, false };
+                dispatches[region.id] = dispatch;
+                copies[tile]++;
+                server.queued++;
+            }
+        }
+
+        polled.clear();
+        polledServers.clear();
+        for (size_t s = 0; s < servers.size(); s++) {
+            if (servers[s].fd >= 0) {
+                pollfd entry = { servers[s].fd, POLLIN, 0 };
+                polled.push_back(entry);
+                polledServers.push_back(s);
+            }
+        }
+        if (polled.empty()) {
+            std::cerr << "No render servers left" << std::endl;
+            failed = true;
+            break;
+        }
+
+        // wake up now and then to look for stragglers even if nothing arrives
+        if (poll(&polled[0], polled.size(), 20) < 0) {
+            continue;
+        }
+
+        for (size_t p = 0; p < polled.size(); p++) {
+            if (!polled[p].revents) {
+                continue;
+            }
+            int s = polledServers[p];
+
+            int type;
+            std::vector<char> payload;
+            if (!ReceiveMessage(servers[s].fd, type, payload)) {
+                // the tiles it had go to the other servers
+                for (std::map<int, Dispatch>::iterator i = dispatches.begin(); i != dispatches.end(); ++i) {
+                    const Dispatch &dispatch = i->second;
+                    if (dispatch.server == s && !dispatch.cancelled && --copies[dispatch.tile] == 0 && !done[dispatch.tile]) {
+                        pending.push_front(dispatch.tile);
+                    }
+                }
+                Drop(s);
+                continue;
+            }
+
+            MessageReader reader(payload);
+            std::map<int, Dispatch>::iterator found = dispatches.find(reader.GetInt());
+            if (found == dispatches.end()) {
+                continue;
+            }
+            Dispatch &dispatch = found->second;
+
+            if (type == MessageTile) {
+                int x0 = reader.GetInt(), y0 = reader.GetInt(), x1 = reader.GetInt(), y1 = reader.GetInt();
+                if (dispatch.cancelled || done[dispatch.tile] || x0 < 0 || y0 < 0 || x1 > image.width || y1 > image.height) {
+                    continue;
+                }
+                for (int y = y0; y < y1; y++) {
+                    for (int x = x0; x < x1; x++) {
+                        image(x, y) = reader.GetVec3();
+                    }
+                }
+            } else if (type == MessageJobDone) {
+                bool finished = reader.GetInt() == 1;
+                servers[s].queued--;
+
+                if (!dispatch.cancelled) {
+                    int tile = dispatch.tile;
+                    copies[tile]--;
+
+                    if (finished && !done[tile]) {
+                        done[tile] = true;
+                        doneCount++;
+                        tileTime += Now() - dispatch.start;
+                        timedTiles++;
+
+                        // the other copy of the tile is not needed any more
+                        for (std::map<int, Dispatch>::iterator i = dispatches.begin(); i != dispatches.end(); ++i) {
+                            if (i->second.tile == tile && !i->second.cancelled && i != found) {
+                                MessageWriter writer;
+                                writer.PutInt(i->first);
+                                SendMessage(servers[i->second.server].fd, MessageCancel, writer.data);
+                                i->second.cancelled = true;
+                                copies[tile]--;
+                            }
+                        }
+                    } else if (!done[tile] && copies[tile] == 0) {
+                        pending.push_front(tile);
+                    }
+                }
+                dispatches.erase(found);
+            } else if (type == MessageError) {
+                std::cerr << "Render server " << servers[s].address << ": " << reader.GetString() << std::endl;
+                failed = true;
+                servers[s].queued--;
+                dispatches.erase(found);
+            }
+        }
+    }
+
+    // whatever is still running belongs to this frame and is not wanted any more
+    for (std::map<int, Dispatch>::iterator i = dispatches.begin(); i != dispatches.end(); ++i) {
+        if (!i->second.cancelled) {
+            MessageWriter writer;
+            writer.PutInt(i->first);
+            SendMessage(servers[i->second.server].fd, MessageCancel, writer.data);
+            i->second.cancelled = true;
+        }
+    }
+
+    return !failed;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+#include "Protocol.h"
+
+/*
+** Renders frames across several render servers (see RenderServer.h), usually one per machine
+** listening on TCP. The frame is cut into tiles and every tile is sent to a server as a job
+** for that region, a few at a time per server so none of them waits for the next one. The
+** servers keep their scenes built between jobs, so only the first frame of a scene pays for it.
+**
+** Once every tile has been handed out, a server that runs out of work takes over a copy of the
+** tile that has been running longest, if it has taken more than speculationFactor times as long
+** as an average tile. Whichever copy finishes first is used and the other one is cancelled, so a
+** slow or stuck node doesn't hold up the frame. A server that disconnects has its tiles sent to
+** the others.
+*/
+class Coordinator {
+  public:
+    Coordinator(const std::vector<std::string> &addresses);
+    ~Coordinator();
+
+    /* Connects to the servers that aren't connected yet, returns how many are */
+    int Connect();
+
+    /* Renders job (its region is ignored, the whole frame is rendered) into image. False if it failed */
+    bool Render(const RenderJob &job, Image &image);
+
+    int tileSize;
+    int tilesPerServer;        // jobs each server has queued at once
+    float speculationFactor;   // how much longer than average a tile has to run before it is duplicated
+
+  private:
+    struct Server {
+        std::string address;
+        int fd;
+        int queued;
+    };
+
+    struct Dispatch {
+        int tile;
+        int server;
+        double start;
+        bool cancelled;  // its results are no longer wanted, but the server still owes the JobDone
+    };
+
+    void Drop(int server);
+
+    std::vector<Server> servers;
+    std::map<int, Dispatch> dispatches;  // by job id, kept across frames until the servers are done with them
+    int nextId;
+};
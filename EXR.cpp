@@ -0,0 +1,254 @@
+#include "EXR.h"
+
+#include <cstring>
+
+#include "glm/gtc/half_float.hpp"
+
+// The parts of the OpenEXR file layout that are used here, all little endian.
+static const int exrMagic = 20000630;
+static const int exrVersion = 2;
+static const int exrTiledFlag = 0x200;
+static const int exrHalf = 1;
+static const int exrRandomY = 2;
+
+static void PutInt(std::vector<char> &data, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        data.push_back((char)((value >> (8 * i)) & 0xff));
+    }
+}
+
+static void PutFloat(std::vector<char> &data, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    PutInt(data, bits);
+}
+
+static void PutString(std::vector<char> &data, const char *value) {
+    data.insert(data.end(), value, value + strlen(value) + 1);
+}
+
+// A header attribute: name, type name, size of the value, then the value
+static void PutAttribute(std::vector<char> &data, const char *name, const char *type, const std::vector<char> &value) {
+    PutString(data, name);
+    PutString(data, type);
+    PutInt(data, value.size());
+    data.insert(data.end(), value.begin(), value.end());
+}
+
+static std::vector<char> Box(int xMin, int yMin, int xMax, int yMax) {
+    std::vector<char> box;
+    PutInt(box, xMin);
+    PutInt(box, yMin);
+    PutInt(box, xMax);
+    PutInt(box, yMax);
+    return box;
+}
+
+/*
+** OpenEXR's RLE compression of a block. The bytes are first split into the even and the odd
+** ones (for half floats, the low and the high bytes), then every byte is replaced by its
+** difference to the previous one, and finally runs of 3 or more equal bytes are stored as a
+** count and the byte while everything else is stored as a negative count and the literal bytes.
+*/
+static std::vector<char> CompressRLE(const std::vector<char> &raw) {
+
+    size_t size = raw.size();
+    std::vector<unsigned char> split(size);
+    for (size_t i = 0; i < size; i++) {
+        split[(i & 1) ? (size + 1) / 2 + i / 2 : i / 2] = raw[i];
+    }
+
+    for (size_t i = size - 1; i > 0; i--) {
+        split[i] = (unsigned char)(split[i] - split[i - 1] + 128);
+    }
+
+    const int minRun = 3, maxRun = 127;
+    std::vector<char> out;
+    out.reserve(size + size / 128 + 1);
+
+    size_t runStart = 0, runEnd = 1;
+    while (runStart < size) {
+        while (runEnd < size && split[runStart] == split[runEnd] && (int)(runEnd - runStart) - 1 < maxRun) {
+            runEnd++;
+        }
+
+        if ((int)(runEnd - runStart) >= minRun) {
+            out.push_back((char)(runEnd - runStart - 1));
+            out.push_back((char)split[runStart]);
+            runStart = runEnd;
+        } else {
+            // literals until the next run of three starts
+            while (runEnd < size &&
+                   (runEnd + 1 >= size || split[runEnd] != split[runEnd + 1] ||
+                    runEnd + 2 >= size || split[runEnd + 1] != split[runEnd + 2]) &&
+                   (int)(runEnd - runStart) < maxRun) {
+                runEnd++;
+            }
+            out.push_back((char)-(int)(runEnd - runStart));
+            out.insert(out.end(), split.begin() + runStart, split.begin() + runEnd);
+            runStart = runEnd;
+        }
+        runEnd++;
+    }
+
+    return out;
+}
+
+EXRWriter::EXRWriter():
+    file(NULL),
+    width(0),
+    height(0),
+    tileSize(0),
+    tilesX(0),
+    tilesY(0),
+    compression(EXRNoCompression),
+    tableStart(0),
+    failed(false)
+  {}
+
+EXRWriter::~EXRWriter() {
+    if (file) {
+        Close();
+    }
+}
+
+bool EXRWriter::Open(const std::string &path, int width, int height, int tileSize, EXRCompression compression) {
+
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    this->width = width;
+    this->height = height;
+    this->tileSize = tileSize;
+    this->compression = compression;
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+    failed = false;
+
+    std::vector<char> header;
+    PutInt(header, exrMagic);
+    PutInt(header, exrVersion | exrTiledFlag);
+
+    // the channels have to be listed in alphabetical order, which is also their order in the tiles
+    std::vector<char> channels;
+    const char *names[4] = { "A", "B", "G", "R" };
+    for (int i = 0; i < 4; i++) {
+        PutString(channels, names[i]);
+        PutInt(channels, exrHalf);
+        PutInt(channels, 0);  // pLinear and reserved
+        PutInt(channels, 1);  // x and y sampling
+        PutInt(channels, 1);
+    }
+    channels.push_back(0);
+    PutAttribute(header, "channels", "chlist", channels);
+
+    PutAttribute(header, "compression", "compression", std::vector<char>(1, (char)compression));
+    PutAttribute(header, "dataWindow", "box2i", Box(0, 0, width - 1, height - 1));
+    PutAttribute(header, "displayWindow", "box2i", Box(0, 0, width - 1, height - 1));
+    PutAttribute(header, "lineOrder", "lineOrder", std::vector<char>(1, (char)exrRandomY));
+
+    std::vector<char> value;
+    PutFloat(value, 1.0f);
+    PutAttribute(header, "pixelAspectRatio", "float", value);
+
+    value.clear();
+    PutFloat(value, 0.0f);
+    PutFloat(value, 0.0f);
+    PutAttribute(header, "screenWindowCenter", "v2f", value);
+
+    value.clear();
+    PutFloat(value, 1.0f);
+    PutAttribute(header, "screenWindowWidth", "float", value);
+
+    // one level, no mipmaps
+    value.clear();
+    PutInt(value, tileSize);
+    PutInt(value, tileSize);
+    value.push_back(0);
+    PutAttribute(header, "tiles", "tiledesc", value);
+
+    header.push_back(0);
+
+    // the offset table is written as zeroes for now, Close fills it in
+    tableStart = header.size();
+    offsets.assign(tilesX * tilesY, 0);
+    header.resize(header.size() + offsets.size() * 8, 0);
+
+    if (fwrite(&header[0], 1, header.size(), file) != header.size()) {
+        failed = true;
+    }
+
+    return !failed;
+}
+
+bool EXRWriter::WriteTile(int tileX, int tileY, const Image &pixels) {
+
+    // the block is every row of the tile, and in each row every channel's values one after the other
+    std::vector<char> raw(pixels.width * pixels.height * 4 * 2);
+    uint16_t one = glm::detail::toFloat16(1.0f);
+    for (int y = 0; y < pixels.height; y++) {
+        char *row = &raw[y * pixels.width * 4 * 2];
+        for (int x = 0; x < pixels.width; x++) {
+            const glm::vec3 &color = pixels(x, y);
+            uint16_t values[4] = { one, (uint16_t)glm::detail::toFloat16(color.z), (uint16_t)glm::detail::toFloat16(color.y), (uint16_t)glm::detail::toFloat16(color.x) };
+            for (int c = 0; c < 4; c++) {
+                char *out = row + (c * pixels.width + x) * 2;
+                out[0] = (char)(values[c] & 0xff);
+                out[1] = (char)(values[c] >> 8);
+            }
+        }
+    }
+
+    // a block that doesn't get smaller is stored as it is, which readers recognise by its size
+    std::vector<char> packed;
+    if (compression == EXRRLECompression) {
+        packed = CompressRLE(raw);
+    }
+    const std::vector<char> &data = !packed.empty() && packed.size() < raw.size() ? packed : raw;
+
+    std::vector<char> chunk;
+    PutInt(chunk, tileX);
+    PutInt(chunk, tileY);
+    PutInt(chunk, 0);  // level
+    PutInt(chunk, 0);
+    PutInt(chunk, data.size());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file || failed) {
+        return false;
+    }
+
+    offsets[tileY * tilesX + tileX] = ftell(file);
+    if (fwrite(&chunk[0], 1, chunk.size(), file) != chunk.size() ||
+        fwrite(&data[0], 1, data.size(), file) != data.size()) {
+        failed = true;
+    }
+
+    return !failed;
+}
+
+bool EXRWriter::Close() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file) {
+        return false;
+    }
+
+    std::vector<char> table;
+    for (size_t i = 0; i < offsets.size(); i++) {
+        PutInt(table, (uint32_t)offsets[i]);
+        PutInt(table, (uint32_t)(offsets[i] >> 32));
+    }
+
+    if (fseek(file, tableStart, SEEK_SET) != 0 || fwrite(&table[0], 1, table.size(), file) != table.size()) {
+        failed = true;
+    }
+    if (fclose(file) != 0) {
+        failed = true;
+    }
+    file = NULL;
+
+    return !failed;
+}
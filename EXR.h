@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "Image.h"
+
+enum EXRCompression {
+    EXRNoCompression = 0,
+    EXRRLECompression = 1   // OpenEXR's RLE: bytes split by significance, delta coded, then run length encoded
+};
+
+/*
+** Writes a tiled OpenEXR file with half float R, G, B and A channels (A is always 1). The tiles
+** can be written in any order and from any thread as soon as each one is rendered, so the
+** frame never has to be held in memory. The file is in random tile order, and the table of
+** tile offsets at the front is filled in by Close.
+*/
+class EXRWriter {
+  public:
+    EXRWriter();
+    /* Closes the file if that hasn't been done */
+    ~EXRWriter();
+
+    /* Creates the file and writes the header for an image of width x height in tiles of tileSize */
+    bool Open(const std::string &path, int width, int height, int tileSize, EXRCompression compression);
+
+    /*
+    ** Writes the tile at (tileX, tileY), counted in tiles. pixels holds its pixels; tiles on the
+    ** right and bottom edge are smaller than tileSize when the image size isn't a multiple of it
+    */
+    bool WriteTile(int tileX, int tileY, const Image &pixels);
+
+    /* Writes the offset table and closes the file. False if anything went wrong along the way */
+    bool Close();
+
+    int TilesX() const { return tilesX; }
+    int TilesY() const { return tilesY; }
+
+  private:
+    FILE *file;
+    int width;
+    int height;
+    int tileSize;
+    int tilesX;
+    int tilesY;
+    EXRCompression compression;
+
+    std::mutex mutex;           // guards the file and everything below
+    long tableStart;            // where the offset table is in the file
+    std::vector<uint64_t> offsets;
+    bool failed;
+};
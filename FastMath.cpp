@@ -0,0 +1,15 @@
+#include "FastMath.h"
+
+// Turned on by --shading fast
+bool fastMath = false;
+
+bool ParseShadingMode(const std::string &name, bool &fast) {
+    if (name == "exact") {
+        fast = false;
+    } else if (name == "fast") {
+        fast = true;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "glm/glm.hpp"
+#include "glm/gtx/fast_square_root.hpp"
+
+/*
+** Approximations of the functions shading spends its time in, for preview renders. Against the
+** standard library, over the ranges shading uses them for (measured over every float of [1e-6, 1e6]
+** for the square roots and over [1e-4, 1] x [1, 128] for pow):
+**   FastInverseSqrt, FastSqrt, FastNormalize   relative error under 3.1e-7
+**   FastPow with a whole exponent               relative error under 6e-6
+**   FastPow with any other exponent             relative error under 1.1e-5
+** Shaded colors stay within an 8 bit step of the exact ones. What can change more is the odd
+** pixel where a grazing ray just hits or just misses a sphere or its shadow, 0.02% of the
+** pixels of the instances scene.
+*/
+
+/* Set by --shading fast: shading and the sphere intersections use the approximations below */
+extern bool fastMath;
+
+/* Parses exact or fast into whether fastMath is set, false if it isn't one of them */
+bool ParseShadingMode(const std::string &name, bool &fast);
+
+/* 1 / sqrt(x) for x > 0: the hardware estimate (or glm's bit trick without SSE) refined by a Newton step */
+inline float FastInverseSqrt(float x) {
+#ifdef __SSE__
+    float estimate = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+    float estimate = glm::fastInverseSqrt(x);
+#endif
+    return estimate * (1.5f - 0.5f * x * estimate * estimate);
+}
+
+/* sqrt(x) for x > 0 */
+inline float FastSqrt(float x) {
+    return x * FastInverseSqrt(x);
+}
+
+inline glm::vec3 FastNormalize(const glm::vec3 &v) {
+    return v * FastInverseSqrt(glm::dot(v, v));
+}
+
+/* log2(x) for x > 0, from the float's exponent and a series for its mantissa */
+inline float FastLog2(float x) {
+    int32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    float exponent = (float)((bits >> 23) - 127);
+
+    // the mantissa m, moved into [sqrt(1/2), sqrt(2)) where the series converges fastest,
+    // log2(m) = 2 / ln(2) * atanh((m - 1) / (m + 1))
+    bits = (bits & 0x007fffff) | 0x3f800000;
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+    if (m > 1.41421356f) {
+        m *= 0.5f;
+        exponent += 1.0f;
+    }
+    float t = (m - 1.0f) / (m + 1.0f), t2 = t * t;
+    float series = t * (2.88539008f + t2 * (0.961796694f + t2 * (0.577078016f + t2 * (0.412198583f + t2 * 0.320598898f))));
+    return exponent + series;
+}
+
+/* 2^x, split into a power of two for the exponent and a polynomial for the rest in [-0.5, 0.5] */
+inline float FastExp2(float x) {
+    if (x < -126.0f) {
+        return 0.0f;
+    }
+    if (x > 127.0f) {
+        return INFINITY;
+    }
+
+    // x + 127.5 is positive, so truncating it rounds x to the nearest whole number
+    int whole = (int)(x + 127.5f) - 127;
+    float f = x - (float)whole;
+    float p = 1.0f + f * (0.693147181f + f * (0.240226507f + f * (0.0555041087f + f * (0.00961812911f + f * (0.00133335581f + f * 0.000154035304f)))));
+
+    int32_t bits = (whole + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+/* x^y for x >= 0. Whole exponents, which is what the materials use, are done by repeated squaring */
+inline float FastPow(float x, float y) {
+    if (x <= 0.0f) {
+        return y == 0.0f ? 1.0f : 0.0f;
+    }
+
+    if (fabsf(y) <= 1024.0f && (float)(int)y == y) {
+        unsigned int n = (unsigned int)fabsf(y);
+        float result = 1.0f, power = x;
+        while (n) {
+            if (n & 1) {
+                result *= power;
+            }
+            power *= power;
+            n >>= 1;
+        }
+        return y < 0.0f ? 1.0f / result : result;
+    }
+
+    return FastExp2(y * FastLog2(x));
+}
+
+// The functions the shading code calls, which pick the fast or the exact version
+
+inline float ShadingSqrt(float x) {
+    return fastMath ? FastSqrt(x) : sqrtf(x);
+}
+
+inline float ShadingPow(float x, float y) {
+    return fastMath ? FastPow(x, y) : (float)pow(x, y);
+}
+
+inline glm::vec3 ShadingNormalize(const glm::vec3 &v) {
+    return fastMath ? FastNormalize(v) : glm::normalize(v);
+}
@@ -0,0 +1,164 @@
+#include "FrameCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void TileDependencies::Clear() {
+    objectsHit.clear();
+    segments.clear();
+    segmentBounds = AABB();
+    escapedRays.clear();
+}
+
+void TileDependencies::RecordHit(const Object *object) {
+
+    if (!object || object->id < 0) {
+        return;
+    }
+
+    size_t word = object->id / 64;
+    if (word >= objectsHit.size()) {
+        objectsHit.resize(word + 1, 0);
+    }
+    objectsHit[word] |= (uint64_t)1 << (object->id % 64);
+}
+
+void TileDependencies::RecordSegment(const glm::vec3 &from, const glm::vec3 &to) {
+    segments.push_back(Ray(from, to - from));
+    segmentBounds.Extend(from);
+    segmentBounds.Extend(to);
+}
+
+bool TileDependencies::DependsOn(int id) const {
+    size_t word = id / 64;
+    return word < objectsHit.size() && (objectsHit[word] >> (id % 64)) & 1;
+}
+
+bool TileDependencies::MayBeReachedBy(const AABB &bounds) const {
+
+    float tNear, tFar;
+
+    if (segmentBounds.Overlaps(bounds)) {
+        for (size_t i = 0; i < segments.size(); i++) {
+            if (bounds.Intersect(segments[i], tNear, tFar) && tNear <= 1.0f) {
+                return true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < escapedRays.size(); i++) {
+        if (bounds.Intersect(escapedRays[i], tNear, tFar)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FrameCache::Reset(int width, int height, const glm::mat4 &viewProj) {
+
+    this->width = width;
+    this->height = height;
+    this->viewProj = viewProj;
+
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+    tiles.assign(tilesX * tilesY, TileDependencies());
+
+    versions.clear();
+    valid = false;
+}
+
+bool FrameCache::Matches(int width, int height, const glm::mat4 &viewProj) const {
+    return valid && this->width == width && this->height == height && this->viewProj == viewProj;
+}
+
+void FrameCache::Snapshot(const std::vector<Object*> &objects) {
+
+    versions.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        versions[i] = objects[i]->version;
+    }
+    valid = true;
+}
+
+void FrameCache::TileRect(int tile, int &x0, int &y0, int &x1, int &y1) const {
+    x0 = (tile % tilesX) * tileSize;
+    y0 = (tile / tilesX) * tileSize;
+    x1 = std::min(x0 + tileSize, width);
+    y1 = std::min(y0 + tileSize, height);
+}
+
+void FrameCache::MarkProjectedBounds(const AABB &bounds, std::vector<bool> &invalid) const {
+
+    float minX = std::numeric_limits<float>::infinity(), minY = minX;
+    float maxX = -minX, maxY = -minX;
+
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec4 point((corner & 1) ? bounds.max.x : bounds.min.x,
+                        (corner & 2) ? bounds.max.y : bounds.min.y,
+                        (corner & 4) ? bounds.max.z : bounds.min.z, 1.0f);
+        glm::vec4 clip = viewProj * point;
+
+        if (clip.w <= 0.0f) {
+            // part of the box is behind the camera, so it can cover any part of the screen
+            invalid.assign(invalid.size(), true);
+            return;
+        }
+
+        // the same mapping from normalised device coordinates to pixels as the ray setup
+        float x = ((clip.x / clip.w) + 1.0f) * 0.5f * width - 0.5f;
+        float y = (1.0f - (clip.y / clip.w)) * 0.5f * height - 0.5f;
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+    }
+
+    // one pixel of margin for rounding, and clamped to the screen
+    int tileX0 = (int)glm::clamp(minX - 1.0f, 0.0f, width - 1.0f) / tileSize;
+    int tileY0 = (int)glm::clamp(minY - 1.0f, 0.0f, height - 1.0f) / tileSize;
+    int tileX1 = (int)glm::clamp(maxX + 1.0f, 0.0f, width - 1.0f) / tileSize;
+    int tileY1 = (int)glm::clamp(maxY + 1.0f, 0.0f, height - 1.0f) / tileSize;
+
+    for (int ty = tileY0; ty <= tileY1; ty++) {
+        for (int tx = tileX0; tx <= tileX1; tx++) {
+            invalid[ty * tilesX + tx] = true;
+        }
+    }
+}
+
+std::vector<int> FrameCache::InvalidTiles(const std::vector<Object*> &objects) const {
+
+    std::vector<bool> invalid(tiles.size(), !valid || versions.size() != objects.size());
+
+    for (size_t i = 0; valid && i < versions.size() && i < objects.size(); i++) {
+        if (objects[i]->version == versions[i]) {
+            continue;
+        }
+
+        AABB bounds = objects[i]->Bounds();
+        if (!bounds.IsFinite()) {
+            invalid.assign(invalid.size(), true);
+            break;
+        }
+
+        MarkProjectedBounds(bounds, invalid);
+
+        for (size_t t = 0; t < tiles.size(); t++) {
+            if (!invalid[t] && (tiles[t].DependsOn(objects[i]->id) || tiles[t].MayBeReachedBy(bounds))) {
+                invalid[t] = true;
+            }
+        }
+    }
+
+    std::vector<int> result;
+    for (size_t t = 0; t < invalid.size(); t++) {
+        if (invalid[t]) {
+            result.push_back(t);
+        }
+    }
+
+    return result;
+}
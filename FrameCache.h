@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include "Object.h"
+
+// Everything one tile of the previous frame depended on, recorded while its rays were traced.
+class TileDependencies {
+  public:
+    TileDependencies() {}
+
+    /* Bit i is set when a ray of the tile hit (or was shadowed by) the object with id i */
+    std::vector<uint64_t> objectsHit;
+    /* Every finite secondary and shadow ray traced for the tile, as a ray that ends at t = 1 */
+    std::vector<Ray> segments;
+    /* Encloses all of the segments, to reject most objects without looking at them one by one */
+    AABB segmentBounds;
+    /* The secondary rays that left the scene without hitting anything */
+    std::vector<Ray> escapedRays;
+
+    void Clear();
+    void RecordHit(const Object *object);
+    void RecordSegment(const glm::vec3 &from, const glm::vec3 &to);
+    void RecordEscape(const Ray &ray) { escapedRays.push_back(ray); }
+
+    bool DependsOn(int id) const;
+    /* Whether an object now occupying bounds could change what any of the tile's rays see */
+    bool MayBeReachedBy(const AABB &bounds) const;
+};
+
+/*
+** Remembers what every tile of the last frame depended on, so that after a scene edit only the
+** tiles the edit can have changed are retraced. A tile is redone if one of the changed objects
+** - was hit by any of its rays last frame (which covers where the object used to be),
+** - now projects onto the tile (it may be seen directly at its new position), or
+** - now overlaps one of the tile's secondary or shadow rays (it may be seen in a reflection,
+**   through a refraction, or start casting a shadow).
+** Changing the camera or the window size invalidates everything.
+*/
+class FrameCache {
+  public:
+    FrameCache(int tileSize = 16):
+      tileSize(tileSize),
+      width(0),
+      height(0),
+      tilesX(0),
+      tilesY(0),
+      valid(false)
+    {}
+
+    int tileSize;
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+    std::vector<TileDependencies> tiles;
+
+    /* Forgets the previous frame and sets up the tiles for a new one */
+    void Reset(int width, int height, const glm::mat4 &viewProj);
+    /* Whether the previous frame was made with the same image size and camera */
+    bool Matches(int width, int height, const glm::mat4 &viewProj) const;
+
+    /* The tiles that have to be retraced for the objects' changes since the last Snapshot() */
+    std::vector<int> InvalidTiles(const std::vector<Object*> &objects) const;
+    /* Records the object versions the tiles were just rendered with */
+    void Snapshot(const std::vector<Object*> &objects);
+
+    /* The pixel rectangle [x0, x1) x [y0, y1) covered by a tile */
+    void TileRect(int tile, int &x0, int &y0, int &x1, int &y1) const;
+
+  private:
+    void MarkProjectedBounds(const AABB &bounds, std::vector<bool> &invalid) const;
+
+    bool valid;
+    glm::mat4 viewProj;
+    std::vector<unsigned int> versions;
+};
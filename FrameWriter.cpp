@@ -0,0 +1,113 @@
+#include "FrameWriter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+bool PPMSequenceSink::WriteFrame(int frame, const Image &image) {
+
+    std::string path = FramePath(pattern, frame);
+    if (!WritePPM(path, image)) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string FramePath(const std::string &pattern, int frame) {
+
+    size_t percent = pattern.find('%');
+    size_t end = pattern.find('d', percent);
+    if (percent == std::string::npos || end == std::string::npos ||
+        pattern.find_first_not_of("0123456789", percent + 1) != end) {
+        size_t dot = pattern.rfind('.');
+        return FramePath(pattern.substr(0, dot) + "_%04d" + (dot == std::string::npos ? "" : pattern.substr(dot)), frame);
+    }
+
+    std::ostringstream path;
+    path << pattern.substr(0, percent) << std::setfill('0') << std::setw(atoi(pattern.c_str() + percent + 1)) << frame << pattern.substr(end + 1);
+    return path.str();
+}
+
+FrameWriter::FrameWriter(FrameSink &sink, int depth):
+    sink(sink),
+    ring(std::max(depth, 1)),
+    head(0),
+    count(0),
+    nextFrame(0),
+    stopping(false),
+    failed(false)
+  {
+    thread = std::thread(&FrameWriter::Run, this);
+}
+
+FrameWriter::~FrameWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        changed.notify_all();
+    }
+    thread.join();
+}
+
+bool FrameWriter::Write(Image &image) {
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (count == (int)ring.size() && !failed) {
+        changed.wait(lock);
+    }
+    if (failed) {
+        return false;
+    }
+
+    // the slot's old buffer goes back to the renderer, so after the first lap nothing is allocated
+    Image &slot = ring[(head + count) % ring.size()];
+    std::swap(slot, image);
+    if (image.width != slot.width || image.height != slot.height) {
+        image = Image(slot.width, slot.height);
+    }
+    count++;
+
+    changed.notify_all();
+    return true;
+}
+
+bool FrameWriter::Finish() {
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (count > 0 && !failed) {
+        changed.wait(lock);
+    }
+
+    return !failed;
+}
+
+void FrameWriter::Run() {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        if (count == 0 || failed) {
+            if (stopping) {
+                return;
+            }
+            changed.wait(lock);
+            continue;
+        }
+
+        // the slot stays taken while it is written, Write only fills the ones after it
+        const Image &frame = ring[head];
+        int number = nextFrame++;
+
+        lock.unlock();
+        bool written = sink.WriteFrame(number, frame);
+        lock.lock();
+
+        failed = !written;
+        head = (head + 1) % ring.size();
+        count--;
+        changed.notify_all();
+    }
+}
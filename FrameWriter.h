@@ -0,0 +1,71 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Image.h"
+
+// Where the frames of an animation end up. WriteFrame is called on the FrameWriter's thread, in frame order.
+class FrameSink {
+  public:
+    virtual ~FrameSink() {}
+
+    /* Encodes and writes one frame, false if it could not */
+    virtual bool WriteFrame(int frame, const Image &image) = 0;
+};
+
+// One PPM file per frame, named after a pattern (see FramePath).
+class PPMSequenceSink : public FrameSink {
+  public:
+    PPMSequenceSink(const std::string &pattern):
+      pattern(pattern)
+    {}
+
+    virtual bool WriteFrame(int frame, const Image &image);
+
+  private:
+    std::string pattern;
+};
+
+/* The printf style %d (or %04d) in pattern replaced by frame, or the number added before the extension if there is none */
+std::string FramePath(const std::string &pattern, int frame);
+
+/*
+** Hands rendered frames to a sink on a thread of its own, so that encoding and writing frame N
+** overlaps with tracing frame N + 1. The frames wait in a ring of depth buffers: Write swaps the
+** renderer's framebuffer with a free buffer of the ring instead of copying it, and the renderer
+** only blocks when the sink has fallen a whole ring behind.
+*/
+class FrameWriter {
+  public:
+    FrameWriter(FrameSink &sink, int depth = 2);
+    /* Writes whatever is still queued */
+    ~FrameWriter();
+
+    /*
+    ** Queues image as the next frame. image comes back as a buffer of the same size (with
+    ** old contents) to render the next frame into. False once the sink has failed
+    */
+    bool Write(Image &image);
+
+    /* Waits until everything queued is written. False if any of it could not be */
+    bool Finish();
+
+  private:
+    void Run();
+
+    FrameSink &sink;
+    std::vector<Image> ring;
+    int head;   // the oldest queued frame, which the thread is writing
+    int count;  // how many frames are queued
+    int nextFrame;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool stopping;
+    bool failed;
+    std::thread thread;
+};
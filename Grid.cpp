@@ -0,0 +1,188 @@
+#include "Grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Objects a ray remembers having tested, so that it doesn't test one again in every cell it overlaps
+static const int mailboxSize = 8;
+
+void UniformGrid::Build(const std::vector<const Object *> &objects) {
+
+    this->objects = objects;
+    bounds = AABB();
+    cellStart.clear();
+    cellObjects.clear();
+    resolution = glm::ivec3(0);
+
+    if (objects.empty()) {
+        return;
+    }
+
+    std::vector<AABB> boxes(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        boxes[i] = objects[i]->Bounds();
+        bounds.Extend(boxes[i]);
+    }
+
+    // gridDensity cells per object over the volume, with flat boxes made a little thick first
+    glm::vec3 extent = bounds.Extent();
+    float largest = std::max(extent.x, std::max(extent.y, extent.z));
+    extent = glm::max(extent, glm::vec3(std::max(largest, 1e-6f) * 1e-3f));
+    float cellsPerUnit = cbrtf(gridDensity * objects.size() / (extent.x * extent.y * extent.z));
+    for (int axis = 0; axis < 3; axis++) {
+        resolution[axis] = std::max(1, std::min(gridMaxResolution, (int)ceilf(extent[axis] * cellsPerUnit)));
+    }
+    bounds.max = bounds.min + extent;
+    cellSize = extent / glm::vec3(resolution);
+
+    // count each cell's objects, place the cells one after another, then fill them in
+    int cellCount = resolution.x * resolution.y * resolution.z;
+    cellStart.assign(cellCount + 1, 0);
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < objects.size(); i++) {
+            glm::ivec3 low = Cell(boxes[i].min), high = Cell(boxes[i].max);
+            for (int z = low.z; z <= high.z; z++) {
+                for (int y = low.y; y <= high.y; y++) {
+                    for (int x = low.x; x <= high.x; x++) {
+                        int cell = CellIndex(glm::ivec3(x, y, z));
+                        if (pass == 0) {
+                            cellStart[cell + 1]++;
+                        } else {
+                            cellObjects[cellStart[cell]++] = i;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (int cell = 0; cell < cellCount; cell++) {
+                cellStart[cell + 1] += cellStart[cell];
+            }
+            cellObjects.resize(cellStart[cellCount]);
+        } else {
+            // filling moved every cell's start to the next one's
+            for (int cell = cellCount; cell > 0; cell--) {
+                cellStart[cell] = cellStart[cell - 1];
+            }
+            cellStart[0] = 0;
+        }
+    }
+}
+
+glm::ivec3 UniformGrid::Cell(const glm::vec3 &point) const {
+    glm::ivec3 cell;
+    for (int axis = 0; axis < 3; axis++) {
+        cell[axis] = std::max(0, std::min(resolution[axis] - 1, (int)((point[axis] - bounds.min[axis]) / cellSize[axis])));
+    }
+    return cell;
+}
+
+template<class Visit>
+void UniformGrid::Walk(const Ray &ray, float tMax, const Visit &visit) const {
+
+    float tEnter, tExit;
+    if (objects.empty() || !bounds.Intersect(ray, tEnter, tExit)) {
+        return;
+    }
+    tExit = std::min(tExit, tMax);
+
+    // the cell the ray enters by, and along each axis where it crosses into the next cell and how far apart those crossings are
+    glm::ivec3 cell = Cell(ray(tEnter)), step;
+    glm::vec3 tNext, tDelta;
+    for (int axis = 0; axis < 3; axis++) {
+        if (ray.direction[axis] > 0.0f) {
+            step[axis] = 1;
+            tNext[axis] = (bounds.min[axis] + (cell[axis] + 1) * cellSize[axis] - ray.origin[axis]) / ray.direction[axis];
+            tDelta[axis] = cellSize[axis] / ray.direction[axis];
+        } else if (ray.direction[axis] < 0.0f) {
+            step[axis] = -1;
+            tNext[axis] = (bounds.min[axis] + cell[axis] * cellSize[axis] - ray.origin[axis]) / ray.direction[axis];
+            tDelta[axis] = -cellSize[axis] / ray.direction[axis];
+        } else {
+            step[axis] = 0;
+            tNext[axis] = std::numeric_limits<float>::infinity();
+            tDelta[axis] = std::numeric_limits<float>::infinity();
+        }
+    }
+
+    float tCell = tEnter;
+    while (tCell <= tExit) {
+        int axis = tNext.x < tNext.y ? (tNext.x < tNext.z ? 0 : 2) : (tNext.y < tNext.z ? 1 : 2);
+        int index = CellIndex(cell);
+        if (visit(cellStart[index], cellStart[index + 1], std::min(tNext[axis], tExit))) {
+            return;
+        }
+
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= resolution[axis]) {
+            return;
+        }
+        tCell = tNext[axis];
+        tNext[axis] += tDelta[axis];
+    }
+}
+
+bool UniformGrid::Intersect(const Ray &ray, IntersectInfo &info) const {
+
+    // the cells give ray parameters, the hits give distances
+    float length = glm::length(ray.direction);
+
+    IntersectInfo closest;
+    bool hit = false;
+    const Object *tested[mailboxSize] = { NULL };
+    int nextBox = 0;
+
+    // a hit beyond the cell may be in front of another object in the cells after it, so the walk
+    // only stops once the closest hit so far is in the cell it was found in or one before
+    Walk(ray, std::numeric_limits<float>::infinity(), [&](int first, int last, float tLeave) {
+        for (int i = first; i < last; i++) {
+            const Object *object = objects[cellObjects[i]];
+            if (std::find(tested, tested + mailboxSize, object) != tested + mailboxSize) {
+                continue;
+            }
+            tested[nextBox] = object;
+            nextBox = (nextBox + 1) % mailboxSize;
+
+            IntersectInfo candidate;
+            if (object->Intersect(ray, candidate) && candidate.time < closest.time) {
+                closest = candidate;
+                hit = true;
+            }
+        }
+        return hit && closest.time <= tLeave * length;
+    });
+
+    if (hit) {
+        info = closest;
+    }
+
+    return hit;
+}
+
+const Object *UniformGrid::Occluder(const Ray &ray, float distance) const {
+
+    const Object *occluder = NULL;
+    const Object *tested[mailboxSize] = { NULL };
+    int nextBox = 0;
+
+    Walk(ray, distance / glm::length(ray.direction), [&](int first, int last, float /*tLeave*/) {
+        for (int i = first; i < last; i++) {
+            const Object *object = objects[cellObjects[i]];
+            if (std::find(tested, tested + mailboxSize, object) != tested + mailboxSize) {
+                continue;
+            }
+            tested[nextBox] = object;
+            nextBox = (nextBox + 1) % mailboxSize;
+
+            IntersectInfo candidate;
+            if (object->Intersect(ray, candidate) && candidate.time < distance) {
+                occluder = object;
+                return true;
+            }
+        }
+        return false;
+    });
+
+    return occluder;
+}
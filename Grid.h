@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include "Arena.h"
+#include "Object.h"
+
+// How many cells the grid has per object, which sets its resolution
+const float gridDensity = 3.0f;
+// The most cells along any axis
+const int gridMaxResolution = 256;
+
+/*
+** A uniform grid over objects with finite bounds: their box is cut into equal cells, and every cell
+** lists the objects whose boxes overlap it. A ray walks the cells it passes through in order (the 3D
+** DDA of Amanatides and Woo) and stops in the first cell that holds a hit. It builds in time linear
+** in the number of objects and walks quickly where they are spread evenly and of about the same
+** size, like the spheres of particle or molecule data; a few big objects among many small ones are
+** better served by a BVH. It doesn't own the objects.
+*/
+class UniformGrid {
+  public:
+    UniformGrid():
+      resolution(0)
+    {}
+
+    /* Builds the grid over the objects, with about gridDensity cells per object, as near to cubes as the box allows */
+    void Build(const std::vector<const Object *> &objects);
+
+    /* Finds the closest hit along the ray, like Object::Intersect */
+    bool Intersect(const Ray &ray, IntersectInfo &info) const;
+
+    /* Any object the ray hits less than distance away, NULL if there is none, like BVH::Occluder */
+    const Object *Occluder(const Ray &ray, float distance) const;
+
+    glm::ivec3 Resolution() const { return resolution; }
+    int References() const { return cellObjects.size(); }
+
+  private:
+    glm::ivec3 Cell(const glm::vec3 &point) const;
+    int CellIndex(const glm::ivec3 &cell) const { return (cell.z * resolution.y + cell.y) * resolution.x + cell.x; }
+
+    /* Walks the cells along the ray up to tMax (a ray parameter), calling visit(first, last) with the range of
+       cellObjects of each cell and the parameter where the ray leaves it, until visit returns true */
+    template<class Visit>
+    void Walk(const Ray &ray, float tMax, const Visit &visit) const;
+
+    std::vector<const Object *> objects;
+    AABB bounds;
+    glm::ivec3 resolution;
+    glm::vec3 cellSize;
+    CacheAlignedVector<int> cellStart;    // where each cell's objects start in cellObjects, and one past the last cell's
+    CacheAlignedVector<int> cellObjects;  // indices into objects
+};
@@ -0,0 +1,161 @@
+#include "Image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// The largest side a PPM that is read may have, so a broken header can't ask for gigabytes
+static const int maxPPMSide = 1 << 15;
+
+bool WritePPM(const std::string &path, const Image &image) {
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", image.width, image.height);
+
+    std::vector<unsigned char> bytes(image.pixels.size() * 3);
+    for (size_t i = 0; i < image.pixels.size(); i++) {
+        glm::vec3 color = glm::clamp(image.pixels[i], 0.0f, 1.0f);
+        bytes[i * 3 + 0] = (unsigned char)(color.x * 255.0f + 0.5f);
+        bytes[i * 3 + 1] = (unsigned char)(color.y * 255.0f + 0.5f);
+        bytes[i * 3 + 2] = (unsigned char)(color.z * 255.0f + 0.5f);
+    }
+
+    // an empty image is just the header
+    bool written = bytes.empty() || fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    fclose(file);
+
+    return written;
+}
+
+bool ReadPPM(const std::string &path, Image &image) {
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    int width, height, maxValue;
+    if (fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) != 3 || maxValue != 255 ||
+        width <= 0 || height <= 0 || width > maxPPMSide || height > maxPPMSide) {
+        fclose(file);
+        return false;
+    }
+    // exactly one whitespace character separates the header from the pixel data
+    fgetc(file);
+
+    std::vector<unsigned char> bytes((size_t)width * height * 3);
+    bool read = fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    fclose(file);
+
+    if (!read) {
+        return false;
+    }
+
+    image = Image(width, height);
+    for (size_t i = 0; i < image.pixels.size(); i++) {
+        image.pixels[i] = glm::vec3(bytes[i * 3 + 0], bytes[i * 3 + 1], bytes[i * 3 + 2]) / 255.0f;
+    }
+
+    return true;
+}
+
+static float Luminance(const glm::vec3 &color) {
+    return glm::dot(glm::clamp(color, 0.0f, 1.0f), glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// mean structural similarity of the luminance over 8x8 windows, stepping 4 pixels at a time
+static float MeanSSIM(const Image &reference, const Image &test) {
+
+    const int window = 8;
+    const int stride = 4;
+    const float c1 = 0.01f * 0.01f;
+    const float c2 = 0.03f * 0.03f;
+
+    double total = 0.0;
+    int windows = 0;
+
+    for (int wy = 0; wy + window <= reference.height; wy += stride) {
+        for (int wx = 0; wx + window <= reference.width; wx += stride) {
+
+            float sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+            for (int y = wy; y < wy + window; y++) {
+                for (int x = wx; x < wx + window; x++) {
+                    float a = Luminance(reference(x, y));
+                    float b = Luminance(test(x, y));
+                    sumA += a;
+                    sumB += b;
+                    sumAA += a * a;
+                    sumBB += b * b;
+                    sumAB += a * b;
+                }
+            }
+
+            float n = window * window;
+            float meanA = sumA / n;
+            float meanB = sumB / n;
+            float varA = sumAA / n - meanA * meanA;
+            float varB = sumBB / n - meanB * meanB;
+            float covariance = sumAB / n - meanA * meanB;
+
+            total += ((2 * meanA * meanB + c1) * (2 * covariance + c2)) /
+                     ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+            windows++;
+        }
+    }
+
+    return windows > 0 ? (float)(total / windows) : 1.0f;
+}
+
+CompareResult CompareImages(const Image &reference, const Image &test, const CompareTolerance &tolerance, Image *diff) {
+
+    CompareResult result;
+
+    if (reference.width != test.width || reference.height != test.height) {
+        // nothing sensible can be compared, so report the worst possible result, and a diff
+        // of the reference's size that is bad all over
+        result.maxError = 1.0f;
+        result.rmse = 1.0f;
+        result.ssim = 0.0f;
+        result.badPixels = reference.width * reference.height;
+        if (diff) {
+            *diff = Image(reference.width, reference.height);
+            std::fill(diff->pixels.begin(), diff->pixels.end(), glm::vec3(1, 0, 0));
+        }
+        return result;
+    }
+
+    if (diff) {
+        *diff = Image(reference.width, reference.height);
+    }
+
+    double squaredError = 0.0;
+    for (size_t i = 0; i < reference.pixels.size(); i++) {
+        glm::vec3 error = glm::abs(glm::clamp(reference.pixels[i], 0.0f, 1.0f) - glm::clamp(test.pixels[i], 0.0f, 1.0f));
+        float pixelError = glm::max(error.x, glm::max(error.y, error.z));
+
+        squaredError += glm::dot(error, error) / 3.0f;
+        result.maxError = glm::max(result.maxError, pixelError);
+
+        bool bad = pixelError > tolerance.pixelTolerance;
+        if (bad) {
+            result.badPixels++;
+        }
+
+        if (diff) {
+            // amplify small errors so they are visible at all
+            diff->pixels[i] = bad ? glm::vec3(1, 0, 0) : glm::vec3(glm::min(1.0f, pixelError * 10.0f));
+        }
+    }
+
+    result.rmse = (float)sqrt(squaredError / reference.pixels.size());
+    result.ssim = MeanSSIM(reference, test);
+
+    float badFraction = (float)result.badPixels / reference.pixels.size();
+    result.passed = badFraction <= tolerance.maxBadPixelFraction && result.ssim >= tolerance.minSSIM;
+
+    return result;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// A plain float RGB framebuffer. Pixels are stored row by row starting from the top-left,
+// which is the same order the PPM files on disk use.
+class Image {
+  public:
+    Image(int width = 0, int height = 0):
+      width(width),
+      height(height),
+      pixels(width * height, glm::vec3(0.0f))
+    {}
+
+    int width;
+    int height;
+    std::vector<glm::vec3> pixels;
+
+    glm::vec3 &operator() (int x, int y) { return pixels[y * width + x]; }
+    const glm::vec3 &operator() (int x, int y) const { return pixels[y * width + x]; }
+};
+
+/* Writes the image as a binary (P6) PPM, clamping every channel to [0, 1] */
+bool WritePPM(const std::string &path, const Image &image);
+/* Reads a binary (P6) PPM with a maxval of 255, false for anything else or sides of more than 32768 */
+bool ReadPPM(const std::string &path, Image &image);
+
+// Tolerances used when comparing a render against a stored reference image.
+class CompareTolerance {
+  public:
+    CompareTolerance():
+      pixelTolerance(2.0f / 255.0f),
+      maxBadPixelFraction(0.001f),
+      minSSIM(0.98f)
+    {}
+
+    /* A pixel is "bad" once any channel differs from the reference by more than this */
+    float pixelTolerance;
+    /* The fraction of bad pixels that is still accepted */
+    float maxBadPixelFraction;
+    /* The lowest accepted mean structural similarity of the luminance */
+    float minSSIM;
+};
+
+class CompareResult {
+  public:
+    CompareResult():
+      maxError(0.0f),
+      rmse(0.0f),
+      ssim(1.0f),
+      badPixels(0),
+      passed(false)
+    {}
+
+    float maxError;
+    float rmse;
+    float ssim;
+    int badPixels;
+    bool passed;
+};
+
+/*
+** Compares a render against a reference, both per pixel and perceptually (mean SSIM over
+** 8x8 luminance windows). If diff is given it receives a visualisation of the per-pixel
+** error: the error magnitude in grey, with pixels over the tolerance painted red (all of them,
+** when the sizes differ).
+*/
+CompareResult CompareImages(const Image &reference, const Image &test, const CompareTolerance &tolerance, Image *diff = NULL);
@@ -0,0 +1,99 @@
+#include "Instance.h"
+
+Instance::Instance(const glm::mat4 &transform, const BVH *shape):
+    Object(transform),
+    shape(shape),
+    inverse(glm::inverse(transform))
+  {
+    UpdateBounds();
+}
+
+void Instance::UpdateBounds() {
+
+    AABB local = shape->Bounds();
+
+    bounds = AABB();
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec4 point((corner & 1) ? local.max.x : local.min.x,
+                        (corner & 2) ? local.max.y : local.min.y,
+                        (corner & 4) ? local.max.z : local.min.z, 1.0f);
+        bounds.Extend(glm::vec3(transform * point));
+    }
+}
+
+bool Instance::Intersect(const Ray &ray, IntersectInfo &info) const {
+
+    // the direction isn't renormalised, so the ray parameter means the same in both spaces
+    Ray local(glm::vec3(inverse * glm::vec4(ray.origin, 1.0f)), glm::vec3(inverse * glm::vec4(ray.direction, 0.0f)));
+
+    IntersectInfo localInfo;
+    if (!shape->Intersect(local, localInfo)) {
+        return false;
+    }
+
+    // back to world space, normals go through the inverse transpose
+    info.hitPoint = glm::vec3(transform * glm::vec4(localInfo.hitPoint, 1.0f));
+    info.time = glm::length(ray.origin - info.hitPoint);
+    info.normal = glm::normalize(glm::vec3(glm::transpose(inverse) * glm::vec4(localInfo.normal, 0.0f)));
+    info.material = localInfo.material;
+    info.object = this;
+
+    return true;
+}
+
+void Instance::Translate(const glm::vec3 &offset) {
+    SetTransform(glm::translate(glm::mat4(1.0f), offset) * transform);
+}
+
+void Instance::SetTransform(const glm::mat4 &newTransform) {
+    transform = newTransform;
+    inverse = glm::inverse(transform);
+    UpdateBounds();
+    MarkChanged();
+}
+
+void InstanceGroup::Build() {
+    topLevel.Build(std::vector<const Object *>(instances.begin(), instances.end()));
+
+    versions.resize(instances.size());
+    for (size_t i = 0; i < instances.size(); i++) {
+        versions[i] = instances[i]->version;
+    }
+}
+
+void InstanceGroup::Update() {
+
+    bool moved = false;
+    for (size_t i = 0; i < instances.size(); i++) {
+        if (versions[i] != instances[i]->version) {
+            versions[i] = instances[i]->version;
+            moved = true;
+        }
+    }
+
+    // the tree keeps the structure it was built with, which stays good enough while the
+    // instances move a little from frame to frame
+    if (moved) {
+        topLevel.Refit();
+        MarkChanged();
+    }
+}
+
+bool InstanceGroup::Intersect(const Ray &ray, IntersectInfo &info) const {
+
+    if (!topLevel.Intersect(ray, info)) {
+        return false;
+    }
+
+    // the instances aren't objects of the scene themselves, the group stands in for them
+    info.object = this;
+    return true;
+}
+
+void InstanceGroup::Translate(const glm::vec3 &offset) {
+    for (size_t i = 0; i < instances.size(); i++) {
+        instances[i]->Translate(offset);
+    }
+    Build();
+    MarkChanged();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include "BVH.h"
+
+/*
+** A placement of a shared shape (the bottom level: a BVH over its primitives) in the scene.
+** The object's transform maps the shape into the world. Rays are taken into the shape's own
+** space with the inverse transform, so a shape repeated a thousand times is stored once.
+*/
+class Instance : public Object {
+
+    const BVH *shape;
+    glm::mat4 inverse;  // of transform, kept up to date by Translate
+    AABB bounds;        // of the transformed shape, in world space
+
+    public:
+        Instance(const glm::mat4 &transform, const BVH *shape);
+
+        virtual bool Intersect(const Ray &ray, IntersectInfo &info) const;
+        virtual AABB Bounds() const { return bounds; }
+        virtual void Translate(const glm::vec3 &offset);
+        virtual void SetTransform(const glm::mat4 &newTransform);
+
+    private:
+        void UpdateBounds();
+};
+
+/*
+** The top level over many instances: a BVH over their world space bounds. The group is one
+** object of the scene, so a ray that misses all of it costs a single box test.
+*/
+class InstanceGroup : public Object {
+
+    BVH topLevel;
+    std::vector<Instance *> instances;
+    std::vector<unsigned int> versions;  // of the instances when the top level was last built or refitted
+
+    public:
+        InstanceGroup():
+                Object() {}
+
+        void Add(Instance *instance) { instances.push_back(instance); }
+        /* Has to be called after adding instances and before tracing any rays */
+        void Build();
+
+        const std::vector<Instance *> &Instances() const { return instances; }
+
+        virtual bool Intersect(const Ray &ray, IntersectInfo &info) const;
+        virtual AABB Bounds() const { return topLevel.Bounds(); }
+        virtual void Translate(const glm::vec3 &offset);
+        /* Refits the top level if any of the instances have moved */
+        virtual void Update();
+};
@@ -0,0 +1,226 @@
+#include "IrradianceCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+HemisphereStrata::HemisphereStrata(const glm::vec3 &normal, int rays):
+  normal(normal)
+{
+    glm::vec3 helper = fabsf(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    tangent = glm::normalize(glm::cross(helper, normal));
+    bitangent = glm::cross(normal, tangent);
+
+    thetaStrata = std::max(1, (int)(sqrtf(rays / (float)M_PI) + 0.5f));
+    phiStrata = std::max(1, rays / thetaStrata);
+}
+
+glm::vec3 HemisphereStrata::Direction(int index, const glm::vec2 &jitter) const {
+
+    int ring = index / phiStrata, sector = index % phiStrata;
+    // the rings are of equal sin^2, which is what makes the cosine weighting
+    float sinTheta = sqrtf((ring + jitter.x) / thetaStrata);
+    float cosTheta = sqrtf(std::max(0.0f, 1.0f - sinTheta * sinTheta));
+    float phi = 2.0f * (float)M_PI * (sector + jitter.y) / phiStrata;
+    return sinTheta * (cosf(phi) * tangent + sinf(phi) * bitangent) + cosTheta * normal;
+}
+
+IrradianceRecord MakeIrradianceRecord(const glm::vec3 &point, const HemisphereStrata &strata,
+                                      const std::vector<glm::vec3> &radiance, const std::vector<float> &distance) {
+
+    int rings = strata.thetaStrata, sectors = strata.phiStrata;
+
+    IrradianceRecord record;
+    record.position = point;
+    record.normal = strata.normal;
+    record.irradiance = glm::vec3(0.0f);
+    float inverseDistances = 0.0f;
+    glm::vec3 translation[3] = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) };
+    glm::vec3 rotation[3] = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) };
+
+    for (int sector = 0; sector < sectors; sector++) {
+        float phi = 2.0f * (float)M_PI * (sector + 0.5f) / sectors;
+        float phiEdge = 2.0f * (float)M_PI * sector / sectors;
+        // toward the middle of the sector, and across its edge with the one before
+        glm::vec3 u = cosf(phi) * strata.tangent + sinf(phi) * strata.bitangent;
+        glm::vec3 v = cosf(phi + 0.5f * (float)M_PI) * strata.tangent + sinf(phi + 0.5f * (float)M_PI) * strata.bitangent;
+        glm::vec3 vEdge = cosf(phiEdge + 0.5f * (float)M_PI) * strata.tangent + sinf(phiEdge + 0.5f * (float)M_PI) * strata.bitangent;
+        int previous = (sector + sectors - 1) % sectors;
+
+        glm::vec3 tilt(0.0f), acrossRings(0.0f), acrossSectors(0.0f);
+        for (int ring = 0; ring < rings; ring++) {
+            int index = ring * sectors + sector;
+            record.irradiance += radiance[index];
+            inverseDistances += 1.0f / distance[index];
+
+            // turning the normal toward a sector brings its light in by the tangent of the ring
+            float sinTheta = sqrtf((ring + 0.5f) / rings);
+            tilt += radiance[index] * (sinTheta / sqrtf(1.0f - sinTheta * sinTheta));
+
+            // moving the point changes the share of each stratum through its walls, by how far
+            // away what is seen on either side of a wall is
+            float sinLower = sqrtf((float)ring / rings), sinUpper = sqrtf((ring + 1.0f) / rings);
+            if (ring > 0) {
+                int below = index - sectors;
+                float nearest = std::min(distance[index], distance[below]);
+                acrossRings += (radiance[index] - radiance[below]) * (sinLower * (1.0f - sinLower * sinLower) / nearest);
+            }
+            int beside = ring * sectors + previous;
+            float nearest = std::min(distance[index], distance[beside]);
+            acrossSectors += (radiance[index] - radiance[beside]) * ((sinUpper - sinLower) / nearest);
+        }
+
+        for (int c = 0; c < 3; c++) {
+            rotation[c] += v * tilt[c];
+            translation[c] += u * (2.0f * (float)M_PI / sectors * acrossRings[c]) + vEdge * acrossSectors[c];
+        }
+    }
+
+    // everything over pi, like the irradiance
+    float samples = (float)(rings * sectors);
+    record.irradiance /= samples;
+    for (int c = 0; c < 3; c++) {
+        record.rotation[c] = rotation[c] / samples;
+        record.translation[c] = translation[c] / (float)M_PI;
+    }
+
+    float harmonicMean = inverseDistances > 0.0f ? samples / inverseDistances : INFINITY;
+    record.reach = std::min(std::max(irradianceCacheError * harmonicMean, irradianceMinReach), irradianceMaxReach);
+    return record;
+}
+
+void IrradianceCache::Clear(const AABB &bounds) {
+
+    records.clear();
+    nodes.assign(1, Node());
+    nodes[0].center = bounds.Center();
+    glm::vec3 extent = bounds.Extent();
+    nodes[0].half = std::max(0.5f * std::max(extent.x, std::max(extent.y, extent.z)), irradianceMaxReach);
+    nodes[0].firstChild = -1;
+}
+
+void IrradianceCache::Accumulate(const IrradianceRecord &record, const glm::vec3 &point, const glm::vec3 &normal, glm::vec3 &sum, float &weights) {
+
+    glm::vec3 offset = point - record.position;
+    float error = glm::length(offset) / record.reach + sqrtf(std::max(0.0f, 1.0f - glm::dot(normal, record.normal))) / irradianceCacheError;
+    if (error >= 1.0f) {
+        return;
+    }
+    // a record in front of the point may see light the point doesn't
+    if (glm::dot(offset, record.normal + normal) < -0.1f * record.reach) {
+        return;
+    }
+
+    // Ward's weight, less one so it falls to nothing at the edge of the reach rather than jumping there
+    float weight = 1.0f / std::max(error, 1e-6f) - 1.0f;
+    glm::vec3 turn = glm::cross(record.normal, normal);
+    glm::vec3 irradiance = record.irradiance;
+    for (int c = 0; c < 3; c++) {
+        irradiance[c] += glm::dot(turn, record.rotation[c]) + glm::dot(offset, record.translation[c]);
+    }
+    sum += weight * irradiance;
+    weights += weight;
+}
+
+bool IrradianceCache::Lookup(const glm::vec3 &point, const glm::vec3 &normal, const IrradianceStaging *staging, glm::vec3 &irradiance) const {
+
+    glm::vec3 sum(0.0f);
+    float weights = 0.0f;
+    // down to the point, through the one node of each level it is in
+    for (int node = nodes.empty() ? -1 : 0; node >= 0;) {
+        const Node &cube = nodes[node];
+        for (size_t i = 0; i < cube.records.size(); i++) {
+            Accumulate(records[cube.records[i]], point, normal, sum, weights);
+        }
+        if (cube.firstChild < 0) {
+            break;
+        }
+        glm::vec3 side = glm::step(cube.center, point);
+        node = cube.firstChild + (int)side.x + 2 * (int)side.y + 4 * (int)side.z;
+    }
+    if (staging) {
+        for (size_t i = 0; i < staging->records.size(); i++) {
+            Accumulate(staging->records[i], point, normal, sum, weights);
+        }
+    }
+    if (weights <= 0.0f) {
+        return false;
+    }
+
+    // the gradients can overshoot a little past the darker records
+    irradiance = glm::max(sum / weights, glm::vec3(0.0f));
+    return true;
+}
+
+void IrradianceCache::Subdivide(int node) {
+
+    int first = nodes.size();
+    for (int child = 0; child < 8; child++) {
+        Node cube;
+        cube.half = 0.5f * nodes[node].half;
+        cube.center = nodes[node].center + cube.half * glm::vec3((child & 1) ? 1.0f : -1.0f, (child & 2) ? 1.0f : -1.0f, (child & 4) ? 1.0f : -1.0f);
+        cube.firstChild = -1;
+        nodes.push_back(cube);
+    }
+    nodes[node].firstChild = first;
+}
+
+void IrradianceCache::Insert(int node, int record, const AABB &reach) {
+
+    // a node no bigger than the reach keeps the record, bigger ones hand it down to the children it reaches into
+    if (nodes[node].half <= records[record].reach || nodes[node].half <= nodes[0].half / (1 << irradianceOctreeDepth)) {
+        nodes[node].records.push_back(record);
+        return;
+    }
+    if (nodes[node].firstChild < 0) {
+        Subdivide(node);
+    }
+    for (int child = nodes[node].firstChild; child < nodes[node].firstChild + 8; child++) {
+        glm::vec3 center = nodes[child].center;
+        float half = nodes[child].half;
+        if (reach.max.x >= center.x - half && reach.min.x <= center.x + half &&
+            reach.max.y >= center.y - half && reach.min.y <= center.y + half &&
+            reach.max.z >= center.z - half && reach.min.z <= center.z + half) {
+            Insert(child, record, reach);
+        }
+    }
+}
+
+void IrradianceCache::Merge(IrradianceStaging &staging) {
+
+    if (nodes.empty()) {
+        Clear(AABB(glm::vec3(0.0f), glm::vec3(0.0f)));
+    }
+    for (size_t i = 0; i < staging.records.size(); i++) {
+        const IrradianceRecord &record = staging.records[i];
+        AABB reach(record.position - glm::vec3(record.reach), record.position + glm::vec3(record.reach));
+
+        // the root grows toward records outside it, which the planes that go on forever can have anywhere:
+        // it becomes the child of a root twice its size, and stays at the front
+        bool inside;
+        for (;;) {
+            glm::vec3 offset = record.position - nodes[0].center;
+            glm::vec3 distance = glm::abs(offset);
+            inside = std::max(distance.x, std::max(distance.y, distance.z)) <= nodes[0].half - record.reach;
+            if (inside || nodes[0].half >= irradianceMaxRoot) {
+                break;
+            }
+            Node old = nodes[0];
+            nodes[0].records.clear();
+            nodes[0].half = 2.0f * old.half;
+            nodes[0].center = old.center + old.half * glm::vec3(offset.x < 0.0f ? -1.0f : 1.0f, offset.y < 0.0f ? -1.0f : 1.0f, offset.z < 0.0f ? -1.0f : 1.0f);
+            Subdivide(0);
+            glm::vec3 side = glm::step(nodes[0].center, old.center);
+            nodes[nodes[0].firstChild + (int)side.x + 2 * (int)side.y + 4 * (int)side.z] = old;
+        }
+
+        // once the root can't grow any more, the records still outside it stay with the root itself,
+        // which every lookup goes through, as no node below would hold them
+        records.push_back(record);
+        if (inside) {
+            Insert(0, records.size() - 1, reach);
+        } else {
+            nodes[0].records.push_back(records.size() - 1);
+        }
+    }
+    staging.records.clear();
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+
+#include "AABB.h"
+
+// Ward's a, how far a record reaches relative to the harmonic mean distance of what surrounds it:
+// smaller is more accurate, with more records
+const float irradianceCacheError = 0.25f;
+// The nearest and farthest a record may reach, so records aren't crowded into corners or stretched
+// over a whole wall
+const float irradianceMinReach = 0.02f;
+const float irradianceMaxReach = 1.0f;
+// How many levels the octree has below its root at most, and how far out its root may grow (the records
+// beyond that are kept by the root itself)
+const int irradianceOctreeDepth = 20;
+const float irradianceMaxRoot = 1e5f;
+
+/*
+** The rays a record is sampled with, spread over the hemisphere above normal with the cosine in
+** thetaStrata rings of equal weight, each cut into phiStrata sectors, about pi times as many sectors
+** as rings. Ray index is ring * phiStrata + sector.
+*/
+class HemisphereStrata {
+  public:
+    HemisphereStrata(const glm::vec3 &normal, int rays);
+
+    int Count() const { return thetaStrata * phiStrata; }
+
+    /* The direction of the ray in stratum index, jitter (in [0, 1)^2) placing it inside */
+    glm::vec3 Direction(int index, const glm::vec2 &jitter) const;
+
+    glm::vec3 normal, tangent, bitangent;
+    int thetaStrata, phiStrata;
+};
+
+// The irradiance at a point, and how it changes nearby
+class IrradianceRecord {
+  public:
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 irradiance;      // over pi, so the mean of the radiance arriving weighted by the cosine
+    float reach;               // how far the record is used: the harmonic mean distance to what the rays hit, times irradianceCacheError
+    glm::vec3 rotation[3];     // the gradient of each color channel as the normal turns (the axis it turns around)
+    glm::vec3 translation[3];  // and as the point moves
+};
+
+/* The record at point from the radiance and distance each ray of strata found, the distance infinite for
+   rays that hit nothing. The gradients are those of Ward and Heckbert, "Irradiance Gradients" (1992) */
+IrradianceRecord MakeIrradianceRecord(const glm::vec3 &point, const HemisphereStrata &strata,
+                                      const std::vector<glm::vec3> &radiance, const std::vector<float> &distance);
+
+// The records made while one tile is traced, used by the rest of the tile and merged into the cache after the pass
+class IrradianceStaging {
+  public:
+    std::vector<IrradianceRecord> records;
+};
+
+/*
+** Ward's irradiance cache: irradiance records made sparsely over the surfaces, at the points where no
+** earlier record is close enough, and interpolated with their gradients everywhere else. Smooth
+** regions, like the big planes, are covered by a few records of long reach, and corners by many small
+** ones. The records are kept in an octree, each in the nodes about as big as its reach that the cube
+** of its reach overlaps, so a lookup only visits the nodes on the way down to the point, one per level.
+** The root grows to take in records outside it.
+**
+** Lookups never change the cache, so any number of threads can do them at once: the records a pass
+** makes are staged per tile in an IrradianceStaging, which the tile's own lookups see as well, and
+** merged into the cache between passes, in the order of the tiles, so the cache comes out the same
+** however the tiles were spread over the threads.
+*/
+class IrradianceCache {
+  public:
+    /* Empties the cache, which will hold records in bounds */
+    void Clear(const AABB &bounds);
+
+    /* Interpolates the irradiance (over pi) at point, on a surface facing normal, from the records of the
+       cache and staging (if given) that reach it. False if there are none */
+    bool Lookup(const glm::vec3 &point, const glm::vec3 &normal, const IrradianceStaging *staging, glm::vec3 &irradiance) const;
+
+    /* Adds the staged records to the cache and empties staging. Must not run during lookups */
+    void Merge(IrradianceStaging &staging);
+
+    int Size() const { return records.size(); }
+
+  private:
+    // a cube of the octree, its children eight in a row from firstChild in the order of the bits x, y, z
+    struct Node {
+        glm::vec3 center;
+        float half;                // of its side
+        int firstChild;            // -1 until it needs children
+        std::vector<int> records;  // that reach into it, and whose reach is about as big as it
+    };
+
+    /* Adds the weight and weighted irradiance of record to the sums if it reaches point */
+    static void Accumulate(const IrradianceRecord &record, const glm::vec3 &point, const glm::vec3 &normal, glm::vec3 &sum, float &weights);
+    void Subdivide(int node);
+    void Insert(int node, int record, const AABB &reach);
+
+    std::vector<Node> nodes;  // the root first
+    std::vector<IrradianceRecord> records;
+};
@@ -0,0 +1,46 @@
+#include "Light.h"
+
+#include <cmath>
+
+bool ParseLightShape(const std::string &name, LightShape &shape) {
+    if (name == "point") {
+        shape = LightPoint;
+    } else if (name == "sphere") {
+        shape = LightSphere;
+    } else if (name == "rect") {
+        shape = LightRectangle;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+glm::vec3 Light::SamplePoint(const glm::vec3 &from, const glm::vec2 &u) const {
+
+    if (shape == LightRectangle) {
+        return position + size * glm::vec3(u.x - 0.5f, 0.0f, u.y - 0.5f);
+    }
+    if (shape != LightSphere) {
+        return position;
+    }
+
+    // Shirley and Chiu's concentric map of the square onto the disc, which keeps strata together
+    float a = 2.0f * u.x - 1.0f, b = 2.0f * u.y - 1.0f, radius, angle;
+    if (a == 0.0f && b == 0.0f) {
+        radius = 0.0f;
+        angle = 0.0f;
+    } else if (fabsf(a) > fabsf(b)) {
+        radius = a;
+        angle = (float)M_PI / 4.0f * (b / a);
+    } else {
+        radius = b;
+        angle = (float)M_PI / 2.0f - (float)M_PI / 4.0f * (a / b);
+    }
+
+    // the disc through the center, facing from
+    glm::vec3 w = glm::normalize(position - from);
+    glm::vec3 helper = fabsf(w.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    glm::vec3 t = glm::normalize(glm::cross(helper, w));
+    glm::vec3 s = glm::cross(w, t);
+    return position + size * radius * (cosf(angle) * t + sinf(angle) * s);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+#include "Ray.h"
+
+enum LightShape {
+    LightPoint,      // hard shadows, one shadow ray per hit
+    LightSphere,     // a sphere of radius size
+    LightRectangle   // a size x size square facing straight down, like a ceiling panel
+};
+
+/* Parses point, sphere or rect, false if it isn't one of them */
+bool ParseLightShape(const std::string &name, LightShape &shape);
+
+// The light of the scene. Shading treats it as a point at position either way; its shape only
+// decides how much of it a hit sees, which is what makes the shadows of an area light soft.
+class Light {
+  public:
+    Light(const glm::vec3 &position, LightShape shape = LightPoint, float size = 1.0f):
+      position(position),
+      shape(shape),
+      size(size)
+    {}
+
+    glm::vec3 position;
+    LightShape shape;
+    float size;
+
+    bool IsArea() const { return shape != LightPoint && size > 0.0f; }
+
+    /* The point of the light that u, in [0, 1)^2, picks as seen from from: an even spread over the
+       square, or over the disc a sphere shows from there. Evenly spread u give evenly spread points */
+    glm::vec3 SamplePoint(const glm::vec3 &from, const glm::vec2 &u) const;
+};
@@ -0,0 +1,379 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+#include "Morton.h"
+#include "Parallel.h"
+
+// How many primitives each parallel task of the build handles
+static const int buildChunk = 4096;
+// The most leaves a treelet is grown to before its topology is optimized
+static const int treeletLeaves = 7;
+// The radix sort's digits, six passes over 63 bit codes
+static const int radixBits = 11;
+static const int radixDigits = 1 << radixBits;
+
+// An interior node of the binary radix tree of the sorted codes, before it is written out as BVHNodes
+class RadixNode {
+  public:
+    AABB bounds;
+    int children[2];
+    int parent;
+    int count;   // of primitives below
+    float cost;  // the SAH cost of the subtree, in the units of BVH::SAHCost times the root's area
+};
+
+// The radix tree: interior nodes are 0 to n - 2 and the leaf of the i-th sorted primitive is n - 1 + i,
+// with one primitive per leaf. The leaves' boxes stay where they were before sorting.
+class RadixTree {
+  public:
+    RadixTree(int n, const std::vector<AABB> &bounds, const std::vector<int> &order):
+      interior(std::max(n - 1, 1)),
+      leafParents(n, -1),
+      leafStart(n - 1),
+      bounds(bounds),
+      order(order)
+    {}
+
+    std::vector<RadixNode> interior;
+    std::vector<int> leafParents;
+    int leafStart;
+
+    bool IsLeaf(int node) const { return node >= leafStart; }
+    const AABB &Bounds(int node) const { return IsLeaf(node) ? bounds[order[node - leafStart]] : interior[node].bounds; }
+    float Cost(int node) const { return IsLeaf(node) ? Bounds(node).HalfArea() : interior[node].cost; }
+    int Count(int node) const { return IsLeaf(node) ? 1 : interior[node].count; }
+    int Parent(int node) const { return IsLeaf(node) ? leafParents[node - leafStart] : interior[node].parent; }
+    void SetParent(int node, int parent) {
+        if (IsLeaf(node)) {
+            leafParents[node - leafStart] = parent;
+        } else {
+            interior[node].parent = parent;
+        }
+    }
+
+  private:
+    const std::vector<AABB> &bounds;
+    const std::vector<int> &order;
+};
+
+// Sorts keys, and values along with them, by radixBits bit digits from the lowest up. Every pass counts the
+// digits of blocks of keys in parallel, and then moves each block's keys to their places in parallel.
+static void RadixSort(std::vector<uint64_t> &keys, std::vector<int> &values) {
+
+    int n = keys.size();
+    int blocks = std::max(1, std::min(4 * WorkerCount(), n / buildChunk));
+    int blockSize = (n + blocks - 1) / blocks;
+
+    std::vector<uint64_t> keyBuffer(n);
+    std::vector<int> valueBuffer(n);
+    std::vector<int> offsets(blocks * radixDigits);
+
+    for (int shift = 0; shift < 64; shift += radixBits) {
+        ParallelFor(blocks, [&](int block) {
+            int *counts = &offsets[block * radixDigits];
+            std::fill(counts, counts + radixDigits, 0);
+            for (int i = block * blockSize; i < std::min(n, (block + 1) * blockSize); i++) {
+                counts[(keys[i] >> shift) & (radixDigits - 1)]++;
+            }
+        });
+
+        // a digit that all keys share doesn't change their order, the high ones mostly are
+        bool shared = false;
+        for (int digit = 0; digit < radixDigits && !shared; digit++) {
+            int total = 0;
+            for (int block = 0; block < blocks; block++) {
+                total += offsets[block * radixDigits + digit];
+            }
+            shared = total == n;
+        }
+        if (shared) {
+            continue;
+        }
+
+        // each block's keys with a digit go after those with smaller digits and those of earlier blocks
+        int sum = 0;
+        for (int digit = 0; digit < radixDigits; digit++) {
+            for (int block = 0; block < blocks; block++) {
+                int count = offsets[block * radixDigits + digit];
+                offsets[block * radixDigits + digit] = sum;
+                sum += count;
+            }
+        }
+
+        ParallelFor(blocks, [&](int block) {
+            int *next = &offsets[block * radixDigits];
+            for (int i = block * blockSize; i < std::min(n, (block + 1) * blockSize); i++) {
+                int to = next[(keys[i] >> shift) & (radixDigits - 1)]++;
+                keyBuffer[to] = keys[i];
+                valueBuffer[to] = values[i];
+            }
+        });
+        keys.swap(keyBuffer);
+        values.swap(valueBuffer);
+    }
+}
+
+// The length of the common prefix of the i-th and j-th sorted codes, -1 if j is out of range. Equal codes
+// are told apart by their positions, as if those were appended to the codes.
+static inline int CommonPrefix(const std::vector<uint64_t> &codes, int i, int j) {
+    if (j < 0 || j >= (int)codes.size()) {
+        return -1;
+    }
+    if (codes[i] == codes[j]) {
+        return 64 + __builtin_clz((uint32_t)(i ^ j));
+    }
+    return __builtin_clzll(codes[i] ^ codes[j]);
+}
+
+// Finds the range of sorted codes under interior node i and where it splits, as in Karras' paper: the
+// node's range starts or ends at i, extends away from the neighbour with the shorter common prefix for
+// as long as the prefix stays longer than that, and splits where its codes' common prefix ends.
+static void FindChildren(const std::vector<uint64_t> &codes, RadixTree &tree, int i) {
+
+    int direction = CommonPrefix(codes, i, i + 1) > CommonPrefix(codes, i, i - 1) ? 1 : -1;
+    int minPrefix = CommonPrefix(codes, i, i - direction);
+
+    // an upper bound for the length of the range, then the length itself by binary search
+    int maxLength = 2;
+    while (CommonPrefix(codes, i, i + maxLength * direction) > minPrefix) {
+        maxLength *= 2;
+    }
+    int length = 0;
+    for (int step = maxLength / 2; step >= 1; step /= 2) {
+        if (CommonPrefix(codes, i, i + (length + step) * direction) > minPrefix) {
+            length += step;
+        }
+    }
+    int j = i + length * direction;
+
+    // the last code that shares more than the node's prefix with code i
+    int nodePrefix = CommonPrefix(codes, i, j);
+    int split = 0;
+    for (int step = length; step > 1;) {
+        step = (step + 1) / 2;
+        if (CommonPrefix(codes, i, i + (split + step) * direction) > nodePrefix) {
+            split += step;
+        }
+    }
+    int gamma = i + split * direction + std::min(direction, 0);
+
+    RadixNode &node = tree.interior[i];
+    node.children[0] = std::min(i, j) == gamma ? tree.leafStart + gamma : gamma;
+    node.children[1] = std::max(i, j) == gamma + 1 ? tree.leafStart + gamma + 1 : gamma + 1;
+    tree.SetParent(node.children[0], i);
+    tree.SetParent(node.children[1], i);
+}
+
+static void Combine(RadixTree &tree, int index) {
+    RadixNode &node = tree.interior[index];
+    node.bounds = tree.Bounds(node.children[0]);
+    node.bounds.Extend(tree.Bounds(node.children[1]));
+    node.count = tree.Count(node.children[0]) + tree.Count(node.children[1]);
+    node.cost = bvhBoxTestCost * node.bounds.HalfArea() + tree.Cost(node.children[0]) + tree.Cost(node.children[1]);
+}
+
+/*
+** Treelet restructuring: the subtree at root is cut off at up to treeletLeaves nodes, by opening the
+** biggest leaf of the treelet (by surface area) until there are enough, and those leaves are joined
+** again in the way of lowest SAH cost, found by dynamic programming over all subsets of them. The
+** treelet's interior nodes are reused, so the tree stays the same size.
+*/
+static void OptimizeTreelet(RadixTree &tree, int root) {
+
+    int leaves[treeletLeaves] = { tree.interior[root].children[0], tree.interior[root].children[1] };
+    int leafCount = 2;
+    int interior[treeletLeaves];
+    int interiorCount = 0;
+
+    while (leafCount < treeletLeaves) {
+        int biggest = -1;
+        for (int i = 0; i < leafCount; i++) {
+            if (!tree.IsLeaf(leaves[i]) && (biggest < 0 || tree.Bounds(leaves[i]).HalfArea() > tree.Bounds(leaves[biggest]).HalfArea())) {
+                biggest = i;
+            }
+        }
+        if (biggest < 0) {
+            break;
+        }
+        int opened = leaves[biggest];
+        interior[interiorCount++] = opened;
+        leaves[biggest] = tree.interior[opened].children[0];
+        leaves[leafCount++] = tree.interior[opened].children[1];
+    }
+    if (leafCount < 3) {
+        return;
+    }
+
+    // the cost of the best tree over every subset of the leaves, and its first split
+    int full = (1 << leafCount) - 1;
+    float best[1 << treeletLeaves];
+    int split[1 << treeletLeaves];
+    AABB bounds[1 << treeletLeaves];
+    for (int subset = 1; subset <= full; subset++) {
+        int lowest = subset & -subset;
+        if (subset == lowest) {
+            int leaf = leaves[__builtin_ctz(subset)];
+            bounds[subset] = tree.Bounds(leaf);
+            best[subset] = tree.Cost(leaf);
+            continue;
+        }
+
+        bounds[subset] = bounds[lowest];
+        bounds[subset].Extend(bounds[subset ^ lowest]);
+
+        // every way to split the subset in two, each counted once by keeping the lowest leaf on the left
+        best[subset] = std::numeric_limits<float>::infinity();
+        for (int left = (subset - 1) & subset; left > 0; left = (left - 1) & subset) {
+            if ((left & lowest) && best[left] + best[subset ^ left] < best[subset]) {
+                best[subset] = best[left] + best[subset ^ left];
+                split[subset] = left;
+            }
+        }
+        best[subset] += bvhBoxTestCost * bounds[subset].HalfArea();
+    }
+
+    if (best[full] >= tree.interior[root].cost * 0.999f) {
+        return;
+    }
+
+    // rebuild the treelet from the splits, top down, with root as its root again
+    int stack[treeletLeaves][2] = { { full, root } };
+    int top = 1, unused = 0;
+    while (top > 0) {
+        top--;
+        int subset = stack[top][0], index = stack[top][1];
+        int halves[2] = { split[subset], subset ^ split[subset] };
+        for (int side = 0; side < 2; side++) {
+            int child;
+            if ((halves[side] & (halves[side] - 1)) == 0) {
+                child = leaves[__builtin_ctz(halves[side])];
+            } else {
+                child = interior[unused++];
+                stack[top][0] = halves[side];
+                stack[top][1] = child;
+                top++;
+            }
+            tree.interior[index].children[side] = child;
+            tree.SetParent(child, index);
+        }
+    }
+
+    // the new interior nodes' bounds and costs, which were numbered parents before children
+    for (int i = interiorCount - 1; i >= 0; i--) {
+        Combine(tree, interior[i]);
+    }
+    Combine(tree, root);
+}
+
+// Writes out the subtree at index depth first, with every subtree of at most bvhMaxLeafSize primitives as one leaf
+static int Flatten(const RadixTree &tree, const std::vector<int> &order, const std::vector<const Object *> &objects,
+                   CacheAlignedVector<BVHNode> &nodes, std::vector<const Object *> &primitives, int index) {
+
+    int out = nodes.size();
+    nodes.push_back(BVHNode());
+    nodes[out].bounds = tree.Bounds(index);
+
+    if (tree.Count(index) <= bvhMaxLeafSize) {
+        nodes[out].offset = primitives.size();
+        nodes[out].count = tree.Count(index);
+
+        int stack[bvhMaxLeafSize];
+        int top = 0;
+        stack[top++] = index;
+        while (top > 0) {
+            int node = stack[--top];
+            if (tree.IsLeaf(node)) {
+                primitives.push_back(objects[order[node - tree.leafStart]]);
+            } else {
+                stack[top++] = tree.interior[node].children[1];
+                stack[top++] = tree.interior[node].children[0];
+            }
+        }
+        return out;
+    }
+
+    Flatten(tree, order, objects, nodes, primitives, tree.interior[index].children[0]);
+    int second = Flatten(tree, order, objects, nodes, primitives, tree.interior[index].children[1]);
+    nodes[out].offset = second;
+    nodes[out].count = 0;
+    return out;
+}
+
+void BVH::BuildLinear(const std::vector<const Object *> &objects, bool optimizeTreelets) {
+
+    nodes.clear();
+    primitives.clear();
+
+    int n = objects.size();
+    if (n == 0) {
+        return;
+    }
+    int chunks = (n + buildChunk - 1) / buildChunk;
+
+    // the primitives' boxes, and the box of all their centroids for the codes
+    std::vector<AABB> bounds(n);
+    std::vector<AABB> centroidBounds(chunks);
+    ParallelFor(chunks, [&](int chunk) {
+        for (int i = chunk * buildChunk; i < std::min(n, (chunk + 1) * buildChunk); i++) {
+            bounds[i] = objects[i]->Bounds();
+            centroidBounds[chunk].Extend(bounds[i].Center());
+        }
+    });
+    AABB centroids;
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        centroids.Extend(centroidBounds[chunk]);
+    }
+
+    std::vector<uint64_t> codes(n);
+    std::vector<int> order(n);
+    ParallelFor(chunks, [&](int chunk) {
+        for (int i = chunk * buildChunk; i < std::min(n, (chunk + 1) * buildChunk); i++) {
+            codes[i] = MortonCode63(bounds[i].Center(), centroids);
+            order[i] = i;
+        }
+    });
+    RadixSort(codes, order);
+
+    // every interior node on its own
+    RadixTree tree(n, bounds, order);
+    ParallelFor((n - 1 + buildChunk - 1) / buildChunk, [&](int chunk) {
+        for (int i = chunk * buildChunk; i < std::min(n - 1, (chunk + 1) * buildChunk); i++) {
+            FindChildren(codes, tree, i);
+        }
+    });
+    tree.interior[0].parent = -1;
+
+    // bounds (and treelets) bottom up: every leaf walks up towards the root, and the second of a node's
+    // children to arrive there finishes the node and walks on, the first stops
+    std::unique_ptr<std::atomic<int>[]> arrivals(new std::atomic<int>[std::max(n - 1, 1)]);
+    for (int i = 0; i < n - 1; i++) {
+        arrivals[i] = 0;
+    }
+    ParallelFor(chunks, [&](int chunk) {
+        for (int i = chunk * buildChunk; i < std::min(n, (chunk + 1) * buildChunk); i++) {
+            for (int node = tree.Parent(tree.leafStart + i); node >= 0; node = tree.Parent(node)) {
+                if (arrivals[node]++ == 0) {
+                    break;
+                }
+                Combine(tree, node);
+                if (optimizeTreelets && tree.interior[node].count >= treeletLeaves) {
+                    OptimizeTreelet(tree, node);
+                }
+            }
+        }
+    });
+
+    nodes.reserve(2 * n);
+    primitives.reserve(n);
+    Flatten(tree, order, objects, nodes, primitives, n > 1 ? 0 : tree.leafStart);
+
+    // the Morton codes leave the depth unbounded for clustered primitives, and the treelets can add to it;
+    // a tree too deep for the traversal stacks is built again the usual way
+    if (Depth() > bvhStackSize - 1) {
+        Build(objects);
+    }
+}
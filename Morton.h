@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <stdint.h>
+
+#include "AABB.h"
+
+/* Spreads the low 10 bits of v out to every third bit */
+inline uint32_t SpreadBits(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+/*
+** The 30 bit Morton code of point inside bounds: its coordinates quantized to 1024 steps per axis
+** and their bits interleaved. Sorting by it walks a Z shaped curve through the box, on which points
+** that follow each other are mostly close together in space.
+*/
+inline uint32_t MortonCode(const glm::vec3 &point, const AABB &bounds) {
+    glm::vec3 extent = bounds.Extent();
+    uint32_t code = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        float unit = extent[axis] > 0.0f ? (point[axis] - bounds.min[axis]) / extent[axis] : 0.0f;
+        uint32_t step = (uint32_t)std::min(std::max(unit * 1024.0f, 0.0f), 1023.0f);
+        code |= SpreadBits(step) << (2 - axis);
+    }
+    return code;
+}
+
+/* Spreads the low 21 bits of v out to every third bit */
+inline uint64_t SpreadBits21(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | (v << 32)) & 0x1f00000000ffffull;
+    v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+    v = (v | (v << 8)) & 0x100f00f00f00f00full;
+    v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+    v = (v | (v << 2)) & 0x1249249249249249ull;
+    return v;
+}
+
+/* The 63 bit Morton code of point inside bounds, 2^21 steps per axis, for when 1024 steps don't tell enough points apart */
+inline uint64_t MortonCode63(const glm::vec3 &point, const AABB &bounds) {
+    glm::vec3 extent = bounds.Extent();
+    uint64_t code = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        float unit = extent[axis] > 0.0f ? (point[axis] - bounds.min[axis]) / extent[axis] : 0.0f;
+        uint64_t step = (uint64_t)std::min(std::max(unit * 2097152.0f, 0.0f), 2097151.0f);
+        code |= SpreadBits21(step) << (2 - axis);
+    }
+    return code;
+}
@@ -1,5 +1,9 @@
 #include "Object.h"
 
+#include <algorithm>
+
+#include "FastMath.h"
+
 Material::Material():
     ambient(1.0f),
     diffuse(1.0f),
@@ -8,20 +12,45 @@ Material::Material():
     reflection(0.0f)
   {}
 
+void Object::SetTransform(const glm::mat4 &newTransform) {
+    Translate(glm::vec3(newTransform[3]) - Position());
+    transform = newTransform;
+}
+
 Object::Object(const glm::mat4 &transform, const Material &material):
+    id(-1),
+    version(0),
     transform(transform),
     material(material)
   {}
 
+bool ExitPoint(const Object *object, const Ray &ray, IntersectInfo &info) {
+
+    AABB bounds = object->Bounds();
+    if (!bounds.IsFinite()) {
+        return false;
+    }
+
+    // the ray starts inside the box, so this far along it is past the object
+    float length = glm::length(bounds.Extent()) + 1.0f;
+    Ray back(ray(length), -ray.direction);
+    if (!object->Intersect(back, info) || info.time >= length) {
+        return false;
+    }
+    info.time = length - info.time;
+    return true;
+}
+
 
 /* TODO: Implement */
 bool Sphere::Intersect(const Ray &ray, IntersectInfo &info) const {
 
     float a = glm::dot(ray.direction,ray.direction);
     float b = glm::dot(2.0f * ray.direction, (ray.origin - origin));
-    float c = glm::dot(ray.origin - origin, ray.origin - origin) - pow(radius, 2);
+    // pow(x, 2) is a call into the math library, the fast math mode just multiplies
+    float c = glm::dot(ray.origin - origin, ray.origin - origin) - (fastMath ? radius * radius : pow(radius, 2));
 
-    float discriminant = pow(b, 2) - (4.0f * a * c);
+    float discriminant = (fastMath ? b * b : pow(b, 2)) - (4.0f * a * c);
 
     if (discriminant <= 0) {
         // case for when ray doesn't intersect
@@ -30,7 +59,7 @@ bool Sphere::Intersect(const Ray &ray, IntersectInfo &info) const {
     } else {
         // case for when ray intersects
         // we only require the "-" as we want the smallest, closest value
-        float time = (-b - sqrt(discriminant)) / (2.0f * a);
+        float time = (-b - ShadingSqrt(discriminant)) / (2.0f * a);
 
         if (time < 0) {
             // case for when object is behind camera
@@ -40,8 +69,9 @@ bool Sphere::Intersect(const Ray &ray, IntersectInfo &info) const {
 
             info.hitPoint = ray.origin + time * ray.direction;
             info.time = glm::length(ray.origin - info.hitPoint);
-            info.normal = glm::normalize(info.hitPoint - origin);
+            info.normal = ShadingNormalize(info.hitPoint - origin);
             info.material = MaterialPtr();
+            info.object = this;
 
             return true;
         }
@@ -50,6 +80,15 @@ bool Sphere::Intersect(const Ray &ray, IntersectInfo &info) const {
 
 }
 
+AABB Sphere::Bounds() const {
+    return AABB(origin - glm::vec3(radius), origin + glm::vec3(radius));
+}
+
+void Sphere::Translate(const glm::vec3 &offset) {
+    origin += offset;
+    MarkChanged();
+}
+
 /* TODO: Implement */
 bool Plane::Intersect(const Ray &ray, IntersectInfo &info) const {
 
@@ -65,11 +104,17 @@ bool Plane::Intersect(const Ray &ray, IntersectInfo &info) const {
     info.time = glm::length(ray.origin - info.hitPoint);
     info.normal = normal;
     info.material = MaterialPtr();
+    info.object = this;
 
     return true;
 
 }
 
+void Plane::Translate(const glm::vec3 &offset) {
+    point += offset;
+    MarkChanged();
+}
+
 /* TODO: Implement */
 bool Triangle::Intersect(const Ray &ray, IntersectInfo &info) const {
 
@@ -104,8 +149,60 @@ bool Triangle::Intersect(const Ray &ray, IntersectInfo &info) const {
     info.time = glm::length(ray.origin - info.hitPoint);
     info.normal = normal;
     info.material = MaterialPtr();
+    info.object = this;
 
     return true;
 
 
 }
+
+AABB Triangle::Bounds() const {
+    AABB bounds;
+    bounds.Extend(pointA);
+    bounds.Extend(pointB);
+    bounds.Extend(pointC);
+    return bounds;
+}
+
+AABB Triangle::ClippedBounds(const AABB &box) const {
+
+    // clip the triangle against the box's six planes in turn (Sutherland-Hodgman); each plane adds at
+    // most one corner, so the polygon never has more than nine
+    glm::vec3 polygon[9] = { pointA, pointB, pointC }, clipped[9];
+    int count = 3;
+    for (int plane = 0; plane < 6 && count > 0; plane++) {
+        int axis = plane / 2;
+        float side = plane % 2 ? -1.0f : 1.0f;
+        float bound = plane % 2 ? box.max[axis] : box.min[axis];
+
+        int clippedCount = 0;
+        for (int i = 0; i < count; i++) {
+            const glm::vec3 &from = polygon[i], &to = polygon[(i + 1) % count];
+            float fromDistance = side * (from[axis] - bound), toDistance = side * (to[axis] - bound);
+            if (fromDistance >= 0.0f) {
+                clipped[clippedCount++] = from;
+            }
+            if ((fromDistance < 0.0f) != (toDistance < 0.0f)) {
+                glm::vec3 crossing = from + (to - from) * (fromDistance / (fromDistance - toDistance));
+                crossing[axis] = bound;
+                clipped[clippedCount++] = crossing;
+            }
+        }
+        std::copy(clipped, clipped + clippedCount, polygon);
+        count = clippedCount;
+    }
+
+    // the crossings are rounded, so the result is kept inside the box
+    AABB bounds;
+    for (int i = 0; i < count; i++) {
+        bounds.Extend(polygon[i]);
+    }
+    return bounds.Intersection(box);
+}
+
+void Triangle::Translate(const glm::vec3 &offset) {
+    pointA += offset;
+    pointB += offset;
+    pointC += offset;
+    MarkChanged();
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Ray.h"
+#include "AABB.h"
 
 class Material {
   public:
@@ -23,15 +24,45 @@ class Material {
             refractiveIndex(refractiveIndex){}
 };
 
+// The index of refraction of the materials that refract, for what needs a real one. Material::refractiveIndex is
+// how much of the refraction is mixed into the color, not an index of refraction, so they use glass's.
+const float dielectricIndexOfRefraction = 1.5f;
+
 // The father class of all the objects displayed. Some features would be shared between objects, others will be overloaded.
 class Object {
   public:
     Object(const glm::mat4 &transform = glm::mat4(1.0f), const Material &material = Material());
     //  The keyword const here will check the type of the parameters and make sure no changes are made
     //  to them in the function. It's not necessary but better for robustness
+    virtual ~Object() {}
 
     virtual bool Intersect(const Ray &ray, IntersectInfo &info) const { return true; }
 
+    /* A box enclosing the whole object, infinite unless a subclass knows better */
+    virtual AABB Bounds() const { return AABB::Infinite(); }
+
+    /* A box enclosing the part of the object inside box, for spatial splits. The overlap of box and
+       Bounds() unless a subclass can clip itself tighter */
+    virtual AABB ClippedBounds(const AABB &box) const { return Bounds().Intersection(box); }
+
+    /* Moves the object by offset and marks it as changed */
+    virtual void Translate(const glm::vec3 &offset) {
+      transform = glm::translate(transform, offset);
+      MarkChanged();
+    }
+
+    /* Places the object with a new transform. The geometry of the primitives is stored in world space
+       (their transforms start out as the identity), so they only follow its translation */
+    virtual void SetTransform(const glm::mat4 &newTransform);
+
+    /* Brings whatever the object derives from its parts up to date after they were edited */
+    virtual void Update() {}
+
+    /* Any edit to an object has to call this, so the renderer knows which parts of the frame to redo */
+    void MarkChanged() { version++; }
+
+    int id;                // the index of the object in the scene, -1 when it isn't in one
+    unsigned int version;  // bumped by every change to the object
 
     glm::vec3 Position() const { return glm::vec3(transform[3][0], transform[3][1], transform[3][2]); }
     const Material *MaterialPtr() const { return &material; }
@@ -41,6 +72,10 @@ class Object {
     Material material;
 };
 
+/* Where a ray starting inside object leaves it again, false if it doesn't. For a convex object like a sphere
+   this is where a ray coming back from beyond the object hits it first */
+bool ExitPoint(const Object *object, const Ray &ray, IntersectInfo &info);
+
 //  For all those objects added into the scene. Describing them in proper ways and the implement of function Intersect() is what needs to be done.
 //  Actually, it's also possible to use some other objects, but those geometries are easy to describe and the intersects are easier to calculate.
 //  Try something else if you like, for instance, a box?
@@ -58,6 +93,8 @@ class Sphere : public Object {
                 radius(radius) {}
 
         virtual bool Intersect(const Ray &ray, IntersectInfo &info) const;  //  To figure out if the Ray hit this object.
+        virtual AABB Bounds() const;
+        virtual void Translate(const glm::vec3 &offset);
 };
 
 /* TODO: Implement */
@@ -73,6 +110,7 @@ class Plane : public Object {
             normal(normal) {}
 
     virtual bool Intersect(const Ray &ray, IntersectInfo &info) const;
+    virtual void Translate(const glm::vec3 &offset);
 };
 
 /* TODO: Implement */
@@ -90,4 +128,7 @@ class Triangle : public Object {
                 pointC(pointC) {}
 
         virtual bool Intersect(const Ray &ray, IntersectInfo &info) const;
+        virtual AABB Bounds() const;
+        virtual AABB ClippedBounds(const AABB &box) const;
+        virtual void Translate(const glm::vec3 &offset);
 };
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// The number of threads used for rendering, at least one
+inline int WorkerCount() {
+    int count = (int)std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+// Runs body(i) for every i in [0, count) spread over all the cores. Items are handed out
+// one at a time from a shared counter, so uneven work (tiles with lots of reflections)
+// still balances. body must be safe to call from several threads at once.
+template<class Body>
+void ParallelFor(int count, const Body &body) {
+
+    std::atomic<int> next(0);
+    int threadCount = WorkerCount() < count ? WorkerCount() : count;
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; t++) {
+        threads.push_back(std::thread([&]() {
+            for (int i = next++; i < count; i = next++) {
+                body(i);
+            }
+        }));
+    }
+
+    // the calling thread does its share too
+    for (int i = next++; i < count; i = next++) {
+        body(i);
+    }
+
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+}
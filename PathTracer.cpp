@@ -0,0 +1,322 @@
+#include "PathTracer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// How far along its new direction a path starts after a bounce, to keep it off the surface it left
+static const float pathOffset = 0.001f;
+
+bool ParseIntegrator(const std::string &name, Integrator &integrator) {
+    if (name == "whitted") {
+        integrator = IntegratorWhitted;
+    } else if (name == "path") {
+        integrator = IntegratorPath;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/* The direction at cosTheta from axis, turned by phi around it */
+static glm::vec3 AroundAxis(const glm::vec3 &axis, float cosTheta, float phi) {
+
+    glm::vec3 helper = fabsf(axis.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    glm::vec3 tangent = glm::normalize(glm::cross(helper, axis));
+    glm::vec3 bitangent = glm::cross(axis, tangent);
+    float sinTheta = sqrtf(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    return sinTheta * (cosf(phi) * tangent + sinf(phi) * bitangent) + cosTheta * axis;
+}
+
+/* Veach's power heuristic, the weight of a sample of the strategy with pdf among those of both */
+static float PowerHeuristic(float pdf, float otherPdf) {
+    float a = pdf * pdf, b = otherPdf * otherPdf;
+    return a + b > 0.0f ? a / (a + b) : 0.0f;
+}
+
+/* Where a path going in direction goes at a glass surface facing normal (toward it), eta being the index
+   of refraction it comes from over the one beyond. True if it passes through, false if it is reflected,
+   which u picks with Schlick's approximation of the Fresnel reflectance */
+static bool Refract(const glm::vec3 &direction, const glm::vec3 &normal, float eta, float u, glm::vec3 &next) {
+
+    float cosIn = -glm::dot(normal, direction);
+    float k = 1.0f - eta * eta * (1.0f - cosIn * cosIn);
+    if (k >= 0.0f) {
+        float cosOut = sqrtf(k);
+        // with the angle on the outside
+        float r0 = (1.0f - dielectricIndexOfRefraction) / (1.0f + dielectricIndexOfRefraction);
+        r0 *= r0;
+        float c = 1.0f - (eta > 1.0f ? cosOut : cosIn);
+        if (u >= r0 + (1.0f - r0) * c * c * c * c * c) {
+            next = eta * direction + (eta * cosIn - cosOut) * normal;
+            return true;
+        }
+    }
+    next = direction + 2.0f * cosIn * normal;
+    return false;
+}
+
+// A material as the mix of BSDFs the path tracer sees, at a hit facing normal and seen from outgoing
+class SurfaceBSDF {
+  public:
+    SurfaceBSDF(const Material *material, const glm::vec3 &normal, const glm::vec3 &outgoing):
+      normal(normal)
+    {
+        dielectric = material->refraction > 0.0f ? std::min(std::max(material->refractiveIndex, 0.0f), 1.0f) : 0.0f;
+        mirror = (1.0f - dielectric) * std::min(std::max(material->reflection, 0.0f), 1.0f);
+        smooth = 1.0f - dielectric - mirror;
+        reflected = 2.0f * glm::dot(normal, outgoing) * normal - outgoing;
+        exponent = std::max(material->specularIntensity, 0.0f);
+
+        // the two lobes reflect diffuse + specular of the light between them, which the materials
+        // made for the Whitted shading let go over one, so that is scaled back to one
+        glm::vec3 total = material->diffuse + material->specular;
+        float scale = smooth / std::max(std::max(total.x, std::max(total.y, total.z)), 1.0f);
+        diffuse = scale * material->diffuse;
+        specular = scale * material->specular;
+        float diffuseSum = diffuse.x + diffuse.y + diffuse.z, specularSum = specular.x + specular.y + specular.z;
+        diffuseShare = diffuseSum + specularSum > 0.0f ? diffuseSum / (diffuseSum + specularSum) : 1.0f;
+    }
+
+    /* The diffuse and Phong lobes for light arriving from incoming */
+    glm::vec3 Evaluate(const glm::vec3 &incoming) const {
+        if (glm::dot(normal, incoming) <= 0.0f) {
+            return glm::vec3(0.0f);
+        }
+        glm::vec3 f = diffuse * (1.0f / (float)M_PI);
+        float cosAlpha = glm::dot(reflected, incoming);
+        if (cosAlpha > 0.0f) {
+            f += specular * ((exponent + 2.0f) / (2.0f * (float)M_PI) * powf(cosAlpha, exponent));
+        }
+        return f;
+    }
+
+    /* The pdf of SampleSmooth picking incoming, times the share of the smooth lobes */
+    float Pdf(const glm::vec3 &incoming) const {
+        float cosTheta = glm::dot(normal, incoming);
+        if (cosTheta <= 0.0f) {
+            return 0.0f;
+        }
+        float pdf = diffuseShare * cosTheta / (float)M_PI;
+        float cosAlpha = glm::dot(reflected, incoming);
+        if (cosAlpha > 0.0f) {
+            pdf += (1.0f - diffuseShare) * (exponent + 1.0f) / (2.0f * (float)M_PI) * powf(cosAlpha, exponent);
+        }
+        return smooth * pdf;
+    }
+
+    /* A direction from u, in [0, 1)^2: by the cosine around the normal or by the Phong lobe around
+       the mirror direction, in proportion to how much each reflects. It may point into the surface */
+    glm::vec3 SampleSmooth(const glm::vec2 &u) const {
+        float phi = 2.0f * (float)M_PI * u.y;
+        if (u.x < diffuseShare) {
+            return AroundAxis(normal, sqrtf(1.0f - u.x / diffuseShare), phi);
+        }
+        float v = (u.x - diffuseShare) / (1.0f - diffuseShare);
+        return AroundAxis(reflected, powf(v, 1.0f / (exponent + 1.0f)), phi);
+    }
+
+    glm::vec3 normal;
+    glm::vec3 reflected;                // the mirror direction
+    float dielectric, mirror, smooth;   // the shares of the lobes, summing to one
+    glm::vec3 diffuse, specular;        // the smooth lobes' albedos, with their share
+    float exponent;                     // of the Phong lobe
+    float diffuseShare;                 // of the smooth samples that go to the diffuse lobe
+};
+
+PathTracer::PathTracer(const SceneBVH &scene, const Light &light, const glm::vec3 &intensity):
+  scene(scene),
+  light(light),
+  intensity(intensity * ((float)M_PI * pathLightDistance * pathLightDistance)),
+  radiance(0.0f)
+{
+    // a sphere of radiance L has the intensity L pi r^2 every way, a square L size^2 facing it
+    if (light.IsArea()) {
+        float area = light.shape == LightSphere ? (float)M_PI * light.size * light.size : light.size * light.size;
+        radiance = this->intensity / area;
+    }
+}
+
+bool PathTracer::SampleLight(const glm::vec3 &point, const glm::vec2 &u, LightSample &sample) const {
+
+    if (!light.IsArea()) {
+        glm::vec3 toLight = light.position - point;
+        sample.distance = glm::length(toLight);
+        if (sample.distance <= 0.0f) {
+            return false;
+        }
+        sample.direction = toLight / sample.distance;
+        sample.radiance = intensity / (sample.distance * sample.distance);
+        sample.pdf = 0.0f;
+        return true;
+    }
+
+    if (light.shape == LightSphere) {
+        glm::vec3 toCenter = light.position - point;
+        float distance2 = glm::dot(toCenter, toCenter);
+        float radius2 = light.size * light.size;
+        if (distance2 <= radius2) {
+            return false;
+        }
+        float distance = sqrtf(distance2);
+        // evenly over the cone the sphere fills, 1 - cos written so it keeps its digits for small lights
+        float cosMax = sqrtf(1.0f - radius2 / distance2);
+        float cone = (radius2 / distance2) / (1.0f + cosMax);
+        float cosTheta = 1.0f - u.x * cone;
+        sample.direction = AroundAxis(toCenter / distance, cosTheta, 2.0f * (float)M_PI * u.y);
+        float sinTheta2 = std::max(0.0f, 1.0f - cosTheta * cosTheta);
+        sample.distance = distance * cosTheta - sqrtf(std::max(0.0f, radius2 - distance2 * sinTheta2));
+        sample.radiance = radiance;
+        sample.pdf = 1.0f / (2.0f * (float)M_PI * cone);
+        return true;
+    }
+
+    glm::vec3 toLight = light.SamplePoint(point, u) - point;
+    sample.distance = glm::length(toLight);
+    if (sample.distance <= 0.0f) {
+        return false;
+    }
+    sample.direction = toLight / sample.distance;
+    float cosLight = fabsf(sample.direction.y);
+    if (cosLight <= 0.0f) {
+        return false;
+    }
+    sample.radiance = radiance;
+    sample.pdf = sample.distance * sample.distance / (light.size * light.size * cosLight);
+    return true;
+}
+
+bool PathTracer::HitLight(const Ray &ray, float &distance, float &pdf) const {
+
+    if (!light.IsArea()) {
+        return false;
+    }
+
+    if (light.shape == LightSphere) {
+        glm::vec3 offset = ray.origin - light.position;
+        float distance2 = glm::dot(offset, offset);
+        float radius2 = light.size * light.size;
+        float b = glm::dot(offset, ray.direction);
+        float discriminant = b * b - (distance2 - radius2);
+        if (distance2 <= radius2 || discriminant < 0.0f) {
+            return false;
+        }
+        distance = -b - sqrtf(discriminant);
+        if (distance <= 0.0f) {
+            return false;
+        }
+        float cosMax = sqrtf(1.0f - radius2 / distance2);
+        pdf = 1.0f / (2.0f * (float)M_PI * (radius2 / distance2) / (1.0f + cosMax));
+        return true;
+    }
+
+    float cosLight = fabsf(ray.direction.y);
+    if (cosLight <= 0.0f) {
+        return false;
+    }
+    distance = (light.position.y - ray.origin.y) / ray.direction.y;
+    glm::vec3 hit = ray(distance);
+    float half = 0.5f * light.size;
+    if (distance <= 0.0f || fabsf(hit.x - light.position.x) > half || fabsf(hit.z - light.position.z) > half) {
+        return false;
+    }
+    pdf = distance * distance / (light.size * light.size * cosLight);
+    return true;
+}
+
+glm::vec3 PathTracer::Radiance(const Ray &cameraRay, Payload &payload) const {
+
+    glm::vec3 color(0.0f);
+    glm::vec3 throughput(1.0f);  // the BSDFs so far over the pdfs of the directions taken
+    Ray ray = cameraRay;
+    const Object *inside = NULL;  // the glass the path is in, which it can only leave
+    // whether the light counts in full if the path hits it next, as it does after the camera, a mirror or
+    // glass, which the light samples can't find it through; otherwise the sample of the smooth lobes the
+    // path took, of pdf bsdfPdf, weighs against the light samples
+    bool specular = true;
+    float bsdfPdf = 0.0f;
+
+    for (int depth = 0; depth < maxPathDepth; depth++) {
+
+        IntersectInfo info;
+        bool hit = inside ? ExitPoint(inside, ray, info) : scene.Intersect(ray, info);
+
+        float lightDistance, lightPdf;
+        if (!inside && HitLight(ray, lightDistance, lightPdf) && (!hit || lightDistance < info.time)) {
+            color += throughput * radiance * (specular ? 1.0f : PowerHeuristic(bsdfPdf, lightPdf));
+            break;
+        }
+        if (!hit) {
+            break;
+        }
+
+        glm::vec3 normal = glm::dot(info.normal, ray.direction) < 0.0f ? info.normal : -info.normal;
+        glm::vec3 next;
+
+        if (inside) {
+            // the inside of glass is glass all the way to where the path leaves it
+            if (Refract(ray.direction, normal, dielectricIndexOfRefraction, payload.Random(), next)) {
+                inside = NULL;
+            }
+            specular = true;
+        } else {
+            SurfaceBSDF bsdf(info.material, normal, -ray.direction);
+
+            // next event estimation, of the smooth lobes, the others can't reflect the light a sample finds
+            LightSample sample;
+            if (bsdf.smooth > 0.0f && SampleLight(info.hitPoint, glm::vec2(payload.Random(), payload.Random()), sample)) {
+                float cosTheta = glm::dot(normal, sample.direction);
+                if (cosTheta > 0.0f &&
+                    !scene.Occluder(Ray(info.hitPoint + pathOffset * sample.direction, sample.direction), sample.distance - 2.0f * pathOffset)) {
+                    glm::vec3 f = bsdf.Evaluate(sample.direction);
+                    if (sample.pdf > 0.0f) {
+                        color += throughput * f * sample.radiance * (cosTheta * PowerHeuristic(sample.pdf, bsdf.Pdf(sample.direction)) / sample.pdf);
+                    } else {
+                        color += throughput * f * sample.radiance * cosTheta;
+                    }
+                }
+            }
+
+            // the next direction, from a lobe picked by its share, which the share then cancels out of
+            float pick = payload.Random();
+            if (pick < bsdf.dielectric) {
+                if (Refract(ray.direction, normal, 1.0f / dielectricIndexOfRefraction, payload.Random(), next)) {
+                    // the light takes on the color of the glass; an object without an inside, like a
+                    // triangle, lets it through as it came
+                    IntersectInfo exit;
+                    if (ExitPoint(info.object, Ray(info.hitPoint + pathOffset * next, next), exit)) {
+                        inside = info.object;
+                    } else {
+                        next = ray.direction;
+                    }
+                    throughput *= info.material->diffuse;
+                }
+                specular = true;
+            } else if (pick < bsdf.dielectric + bsdf.mirror) {
+                next = bsdf.reflected;
+                specular = true;
+            } else {
+                next = bsdf.SampleSmooth(glm::vec2(payload.Random(), payload.Random()));
+                float cosTheta = glm::dot(normal, next);
+                bsdfPdf = bsdf.Pdf(next);
+                if (cosTheta <= 0.0f || bsdfPdf <= 0.0f) {
+                    break;
+                }
+                throughput *= bsdf.Evaluate(next) * (cosTheta / bsdfPdf);
+                specular = false;
+            }
+        }
+
+        // Russian roulette, by how much the path can still bring, made up for in those that go on
+        if (depth + 1 >= pathRouletteDepth) {
+            float survival = std::min(1.0f, std::max(throughput.x, std::max(throughput.y, throughput.z)));
+            if (payload.Random() >= survival) {
+                break;
+            }
+            throughput /= survival;
+        }
+
+        ray = Ray(info.hitPoint + pathOffset * next, next);
+    }
+
+    return color;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+
+#include "Light.h"
+#include "SceneBVH.h"
+
+// How the colors of the rays are found
+enum Integrator {
+    IntegratorWhitted,  // Phong shading with the reflections and refractions mixed in, the default
+    IntegratorPath      // Monte Carlo path tracing, see PathTracer
+};
+
+/* Parses whitted or path, false if it isn't one of them */
+bool ParseIntegrator(const std::string &name, Integrator &integrator);
+
+// The most bounces a path takes, and from how many on Russian roulette may end it
+const int maxPathDepth = 16;
+const int pathRouletteDepth = 3;
+// The path tracer's light falls off with the square of the distance, as a real one does, and the Whitted
+// shading's doesn't; this is the distance at which the two light a surface the same
+const float pathLightDistance = 5.0f;
+
+/*
+** An unbiased path tracer, the alternative to the Whitted shading of CastRay. A path goes on from every
+** hit in one direction picked from the material's BSDF, carrying the product of the BSDFs over the
+** probabilities of the directions it took, and at every hit that isn't a perfect mirror or glass the
+** light is sampled as well (next event estimation). The materials are the same as the Whitted shading's,
+** taken as a mix of BSDFs: refractiveIndex of a dielectric where refraction is set (glass of index
+** dielectricIndexOfRefraction, tinted by diffuse), reflection of a perfect mirror, and the rest a Lambertian
+** diffuse lobe and a normalized Phong lobe around the mirror direction, of specularIntensity. Ambient is left
+** out, as the light the surfaces get from each other is traced.
+**
+** An area light is seen by the paths that hit it too, so both ways of finding it count, weighted by
+** Veach's power heuristic (multiple importance sampling): light samples where the BSDF is broad, hits
+** where it is narrow, like the highlights of the glossy lobes. A point light can only be sampled.
+** The sphere light is sampled by the cone of directions it fills, the rectangle, which shines both
+** ways, by its area. The path is a loop with its state in locals, never a recursion.
+*/
+class PathTracer {
+  public:
+    /* Traces through scene, lit by light, intensity being the Whitted shading's lightIntensity */
+    PathTracer(const SceneBVH &scene, const Light &light, const glm::vec3 &intensity);
+
+    /* One estimate of the light arriving along ray, with the random numbers of payload */
+    glm::vec3 Radiance(const Ray &ray, Payload &payload) const;
+
+  private:
+    // A direction toward the light from a point, and what arrives along it
+    struct LightSample {
+        glm::vec3 direction;
+        float distance;
+        glm::vec3 radiance;  // of an area light, or the irradiance a point light brings at normal incidence
+        float pdf;           // of the direction, per solid angle, 0 for a point light
+    };
+
+    /* Picks a direction toward the light from point with u, in [0, 1)^2, false if there is none */
+    bool SampleLight(const glm::vec3 &point, const glm::vec2 &u, LightSample &sample) const;
+
+    /* How far along ray an area light is, false if it misses it, and the pdf SampleLight
+       has of picking that direction from the ray's origin */
+    bool HitLight(const Ray &ray, float &distance, float &pdf) const;
+
+    const SceneBVH &scene;
+    Light light;
+    glm::vec3 intensity;  // of the point light, per steradian
+    glm::vec3 radiance;   // of the surface of an area light of the same power
+};
@@ -0,0 +1,426 @@
+#include "PhotonMap.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Parallel.h"
+#include "Sampler.h"
+
+// How far along its new direction a photon starts after a bounce, to keep it off the surface it left
+static const float photonOffset = 0.001f;
+// How many photons EmitCausticPhotons traces per task
+static const int photonChunk = 4096;
+
+// The cone of directions from the light around the bounding sphere of a refracting object, and the photons aimed into it
+class PhotonTarget {
+  public:
+    glm::vec3 axis, tangent, bitangent;
+    float cosMax;      // of the angle between the axis and the edge of the cone
+    float solidAngle;  // of the cone
+    int first, count;  // of the photons, by index
+};
+
+/* Traces the photon of the given index through the refracting objects, adding it to landed if it makes it onto a diffuse surface */
+static void TracePhoton(const SceneBVH &scene, const std::vector<PhotonTarget> &targets, int target, int index,
+                        const glm::vec3 &lightPosition, const glm::vec3 &lightIntensity, std::vector<Photon> &landed) {
+
+    const PhotonTarget &cone = targets[target];
+
+    // spread evenly over the cone with a scrambled Sobol sequence of its own
+    int sample = index - cone.first;
+    glm::vec2 u = ScrambledSobol(sample, 0x9e3779b9u * (target + 1), 0x85ebca6bu * (target + 1));
+    float cosTheta = 1.0f - u.x * (1.0f - cone.cosMax);
+    float sinTheta = sqrtf(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    float phi = 2.0f * (float)M_PI * u.y;
+    glm::vec3 direction = sinTheta * cosf(phi) * cone.tangent + sinTheta * sinf(phi) * cone.bitangent + cosTheta * cone.axis;
+
+    // the photons per unit of solid angle in this direction, where the cones overlap those of all of them
+    float density = cone.count / cone.solidAngle;
+    for (size_t i = 0; i < targets.size(); i++) {
+        if ((int)i != target && glm::dot(direction, targets[i].axis) >= targets[i].cosMax) {
+            density += targets[i].count / targets[i].solidAngle;
+        }
+    }
+    glm::vec3 power = lightIntensity / density;
+
+    Payload payload;
+    payload.seed = index;
+
+    Ray ray(lightPosition, direction);
+    const Object *inside = NULL;  // the object the photon travels through, if any
+    bool focused = false;         // whether it was refracted or reflected by a refracting object yet
+    for (int bounce = 0; bounce < maxPhotonBounces; bounce++) {
+
+        IntersectInfo info;
+        if (inside ? !ExitPoint(inside, ray, info) : !scene.Intersect(ray, info)) {
+            return;
+        }
+
+        // the tracer's light doesn't fall off with distance, so neither does the power the photons
+        // bring; what spreads over the square of the distance is made up for where they first land
+        if (bounce == 0) {
+            power *= info.time * info.time;
+        }
+
+        const Material *material = info.material;
+        if (material->refraction <= 0) {
+            // the light that lands here straight from the light is the tracer's direct lighting
+            if (focused) {
+                landed.push_back(Photon(info.hitPoint, power, ray.direction));
+            }
+            return;
+        }
+        focused = true;
+
+        glm::vec3 normal = glm::dot(info.normal, ray.direction) < 0.0f ? info.normal : -info.normal;
+        float eta = inside ? dielectricIndexOfRefraction : 1.0f / dielectricIndexOfRefraction;
+        float cosIn = -glm::dot(normal, ray.direction);
+        float k = 1.0f - eta * eta * (1.0f - cosIn * cosIn);
+
+        glm::vec3 next;
+        bool reflect = k < 0.0f;  // totally, when it can't get out
+        if (!reflect) {
+            float cosOut = sqrtf(k);
+            next = eta * ray.direction + (eta * cosIn - cosOut) * normal;
+
+            // Schlick's approximation of the Fresnel reflectance, with the angle on the outside
+            float r0 = (1.0f - dielectricIndexOfRefraction) / (1.0f + dielectricIndexOfRefraction);
+            r0 *= r0;
+            float c = 1.0f - (inside ? cosOut : cosIn);
+            reflect = payload.Random() < r0 + (1.0f - r0) * c * c * c * c * c;
+        }
+
+        if (reflect) {
+            next = ray.direction + 2.0f * cosIn * normal;
+        } else if (inside) {
+            inside = NULL;
+        } else {
+            // the light takes on the color of what it passes through; an object without an inside,
+            // like a triangle, lets it through as it came
+            IntersectInfo exit;
+            if (ExitPoint(info.object, Ray(info.hitPoint + photonOffset * next, next), exit)) {
+                inside = info.object;
+            } else {
+                next = ray.direction;
+            }
+            power *= material->diffuse;
+        }
+
+        ray = Ray(info.hitPoint + photonOffset * next, next);
+    }
+}
+
+void EmitCausticPhotons(const SceneBVH &scene, const std::vector<Object *> &objects, const glm::vec3 &lightPosition,
+                        const glm::vec3 &lightIntensity, int count, std::vector<Photon> &photons) {
+
+    photons.clear();
+
+    std::vector<PhotonTarget> targets;
+    for (size_t i = 0; i < objects.size(); i++) {
+        AABB bounds = objects[i]->Bounds();
+        if (objects[i]->MaterialPtr()->refraction <= 0 || !bounds.IsFinite()) {
+            continue;
+        }
+
+        PhotonTarget target;
+        glm::vec3 toCenter = bounds.Center() - lightPosition;
+        float distance = glm::length(toCenter);
+        float radius = 0.5f * glm::length(bounds.Extent());
+        target.axis = distance > 0.0f ? toCenter / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+        // all around when the light is inside the sphere
+        target.cosMax = distance > radius ? sqrtf(1.0f - (radius / distance) * (radius / distance)) : -1.0f;
+        target.solidAngle = 2.0f * (float)M_PI * (1.0f - target.cosMax);
+
+        glm::vec3 helper = fabsf(target.axis.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        target.tangent = glm::normalize(glm::cross(helper, target.axis));
+        target.bitangent = glm::cross(target.axis, target.tangent);
+        target.first = target.count = 0;
+        targets.push_back(target);
+    }
+    if (targets.empty() || count <= 0) {
+        return;
+    }
+
+    // the same number of photons for each, the first ones take the rest
+    int first = 0;
+    for (size_t i = 0; i < targets.size(); i++) {
+        targets[i].first = first;
+        targets[i].count = count / targets.size() + ((int)i < count % (int)targets.size());
+        first += targets[i].count;
+    }
+
+    // every task keeps its own photons, put together in order at the end
+    int chunks = (count + photonChunk - 1) / photonChunk;
+    std::vector<std::vector<Photon> > landed(chunks);
+    ParallelFor(chunks, [&](int chunk) {
+        int target = 0;
+        for (int index = chunk * photonChunk; index < std::min(count, (chunk + 1) * photonChunk); index++) {
+            while (index >= targets[target].first + targets[target].count) {
+                target++;
+            }
+            TracePhoton(scene, targets, target, index, lightPosition, lightIntensity, landed[chunk]);
+        }
+    });
+
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        photons.insert(photons.end(), landed[chunk].begin(), landed[chunk].end());
+    }
+}
+
+void PhotonMap::Split(std::vector<Photon> &photons, const Range &range, int deferLevel, std::vector<Range> *deferred, std::vector<int> &leafBegin) {
+
+    if (range.level == depth) {
+        leafBegin[range.node - InteriorNodes()] = range.begin;
+        return;
+    }
+    if (deferred && range.level == deferLevel) {
+        deferred->push_back(range);
+        return;
+    }
+
+    AABB bounds;
+    for (int i = range.begin; i < range.end; i++) {
+        bounds.Extend(photons[i].position);
+    }
+    glm::vec3 extent = bounds.Extent();
+    int axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+
+    // the photons before the median are no farther along the axis than it, the ones after no nearer
+    int middle = range.begin + (range.end - range.begin) / 2;
+    std::nth_element(photons.begin() + range.begin, photons.begin() + middle, photons.begin() + range.end,
+                     [axis](const Photon &a, const Photon &b) { return a.position[axis] < b.position[axis]; });
+    nodes[range.node].split = photons[middle].position[axis];
+    nodes[range.node].axis = axis;
+
+    Range left = { range.begin, middle, 2 * range.node + 1, range.level + 1 };
+    Range right = { middle, range.end, 2 * range.node + 2, range.level + 1 };
+    Split(photons, left, deferLevel, deferred, leafBegin);
+    Split(photons, right, deferLevel, deferred, leafBegin);
+}
+
+void PhotonMap::Build(const std::vector<Photon> &input) {
+
+    count = input.size();
+    depth = 0;
+    while (count > photonLeafSize << depth) {
+        depth++;
+    }
+    int leaves = 1 << depth;
+    nodes.assign(InteriorNodes(), Node());
+
+    // the top of the tree on this thread, until there are enough subtrees to keep all the others busy
+    int deferLevel = 0;
+    while ((1 << deferLevel) < 4 * WorkerCount() && deferLevel < depth) {
+        deferLevel++;
+    }
+
+    bounds = AABB();
+    for (int i = 0; i < count; i++) {
+        bounds.Extend(input[i].position);
+    }
+
+    std::vector<Photon> photons(input);
+    std::vector<int> leafBegin(leaves + 1, count);
+    std::vector<Range> subtrees;
+    Range root = { 0, count, 0, 0 };
+    Split(photons, root, deferLevel, &subtrees, leafBegin);
+    ParallelFor(subtrees.size(), [&](int i) {
+        Split(photons, subtrees[i], 0, NULL, leafBegin);
+    });
+
+    leafStart.assign(leaves + 1, 0);
+    for (int leaf = 0; leaf < leaves; leaf++) {
+        leafStart[leaf + 1] = leafStart[leaf] + (leafBegin[leaf + 1] - leafBegin[leaf] + 3) / 4;
+    }
+
+    // the padding is so far away that it is never gathered
+    PhotonPacket padding;
+    for (int lane = 0; lane < 4; lane++) {
+        padding.x[lane] = padding.y[lane] = padding.z[lane] = FLT_MAX;
+        padding.dx[lane] = padding.dy[lane] = padding.dz[lane] = 0.0f;
+        padding.r[lane] = padding.g[lane] = padding.b[lane] = 0.0f;
+    }
+    packets.assign(leafStart[leaves], padding);
+    ParallelFor(leaves, [&](int leaf) {
+        for (int i = leafBegin[leaf]; i < leafBegin[leaf + 1]; i++) {
+            PhotonPacket &packet = packets[leafStart[leaf] + (i - leafBegin[leaf]) / 4];
+            int lane = (i - leafBegin[leaf]) % 4;
+            const Photon &photon = photons[i];
+            packet.x[lane] = photon.position.x;
+            packet.y[lane] = photon.position.y;
+            packet.z[lane] = photon.position.z;
+            packet.dx[lane] = photon.direction.x;
+            packet.dy[lane] = photon.direction.y;
+            packet.dz[lane] = photon.direction.z;
+            packet.r[lane] = photon.power.x;
+            packet.g[lane] = photon.power.y;
+            packet.b[lane] = photon.power.z;
+        }
+    });
+}
+
+/* The squared distances of the packet's photons from point, and a bit for each that arrived from the side normal faces */
+static inline int PacketDistances(const PhotonPacket &packet, const glm::vec3 &point, const glm::vec3 &normal, float distance2[4]) {
+
+#ifdef __SSE2__
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(packet.x), _mm_set1_ps(point.x));
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(packet.y), _mm_set1_ps(point.y));
+    __m128 dz = _mm_sub_ps(_mm_loadu_ps(packet.z), _mm_set1_ps(point.z));
+    _mm_storeu_ps(distance2, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+
+    __m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(packet.dx), _mm_set1_ps(normal.x)),
+                                          _mm_mul_ps(_mm_loadu_ps(packet.dy), _mm_set1_ps(normal.y))),
+                               _mm_mul_ps(_mm_loadu_ps(packet.dz), _mm_set1_ps(normal.z)));
+    return _mm_movemask_ps(_mm_cmplt_ps(cosine, _mm_setzero_ps()));
+#else
+    int facing = 0;
+    for (int lane = 0; lane < 4; lane++) {
+        float dx = packet.x[lane] - point.x, dy = packet.y[lane] - point.y, dz = packet.z[lane] - point.z;
+        distance2[lane] = dx * dx + dy * dy + dz * dz;
+        if (packet.dx[lane] * normal.x + packet.dy[lane] * normal.y + packet.dz[lane] * normal.z < 0.0f) {
+            facing |= 1 << lane;
+        }
+    }
+    return facing;
+#endif
+}
+
+void PhotonMap::Nearest(int node, const glm::vec3 &point, const glm::vec3 &normal, int k, Neighbour *heap, int &found, float &radius2) const {
+
+    if (node >= InteriorNodes()) {
+        int leaf = node - InteriorNodes();
+        for (int p = leafStart[leaf]; p < leafStart[leaf + 1]; p++) {
+            float distance2[4];
+            int facing = PacketDistances(packets[p], point, normal, distance2);
+            for (int lane = 0; lane < 4; lane++) {
+                if (!(facing >> lane & 1) || distance2[lane] >= radius2) {
+                    continue;
+                }
+
+                // the farthest of the k nearest so far is at the top of the heap, and sets the radius once there are k
+                Neighbour neighbour = { distance2[lane], 4 * p + lane };
+                if (found < k) {
+                    heap[found++] = neighbour;
+                    std::push_heap(heap, heap + found);
+                } else {
+                    std::pop_heap(heap, heap + k);
+                    heap[k - 1] = neighbour;
+                    std::push_heap(heap, heap + k);
+                }
+                if (found == k) {
+                    radius2 = heap[0].distance2;
+                }
+            }
+        }
+        return;
+    }
+
+    // the side the point is on first, the other only if it is still within reach
+    const Node &split = nodes[node];
+    float offset = point[split.axis] - split.split;
+    Nearest(offset <= 0.0f ? 2 * node + 1 : 2 * node + 2, point, normal, k, heap, found, radius2);
+    if (offset * offset < radius2) {
+        Nearest(offset <= 0.0f ? 2 * node + 2 : 2 * node + 1, point, normal, k, heap, found, radius2);
+    }
+}
+
+glm::vec3 PhotonMap::Irradiance(const glm::vec3 &point, const glm::vec3 &normal, int k, float maxRadius) const {
+
+    k = std::min(k, photonMaxNeighbours);
+    if (Empty() || k <= 0 || OutOfReach(point, maxRadius)) {
+        return glm::vec3(0.0f);
+    }
+
+    Neighbour heap[photonMaxNeighbours];
+    int found = 0;
+    float radius2 = maxRadius * maxRadius;
+    Nearest(0, point, normal, k, heap, found, radius2);
+    if (found == 0 || radius2 <= 0.0f) {
+        return glm::vec3(0.0f);
+    }
+
+    float coneRadius = photonFilterCone * sqrtf(radius2);
+    glm::vec3 sum(0.0f);
+    for (int i = 0; i < found; i++) {
+        const PhotonPacket &packet = packets[heap[i].photon / 4];
+        int lane = heap[i].photon % 4;
+        float weight = 1.0f - sqrtf(heap[i].distance2) / coneRadius;
+        sum += weight * glm::vec3(packet.r[lane], packet.g[lane], packet.b[lane]);
+    }
+    return sum / ((1.0f - 2.0f / (3.0f * photonFilterCone)) * (float)M_PI * radius2);
+}
+
+void PhotonMap::Gather(int node, const glm::vec3 &point, const glm::vec3 &normal, float radius, float *sums) const {
+
+    if (node >= InteriorNodes()) {
+        int leaf = node - InteriorNodes();
+        float radius2 = radius * radius, scale = 1.0f / (photonFilterCone * radius);
+#ifdef __SSE2__
+        // the weights of the photons out of reach are masked to zero, so whole packets are summed
+        __m128 r = _mm_setzero_ps(), g = _mm_setzero_ps(), b = _mm_setzero_ps();
+        for (int p = leafStart[leaf]; p < leafStart[leaf + 1]; p++) {
+            const PhotonPacket &packet = packets[p];
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(packet.x), _mm_set1_ps(point.x));
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(packet.y), _mm_set1_ps(point.y));
+            __m128 dz = _mm_sub_ps(_mm_loadu_ps(packet.z), _mm_set1_ps(point.z));
+            __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            __m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(packet.dx), _mm_set1_ps(normal.x)),
+                                                  _mm_mul_ps(_mm_loadu_ps(packet.dy), _mm_set1_ps(normal.y))),
+                                       _mm_mul_ps(_mm_loadu_ps(packet.dz), _mm_set1_ps(normal.z)));
+            __m128 within = _mm_and_ps(_mm_cmplt_ps(distance2, _mm_set1_ps(radius2)), _mm_cmplt_ps(cosine, _mm_setzero_ps()));
+            __m128 weight = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_sqrt_ps(distance2), _mm_set1_ps(scale)));
+            weight = _mm_and_ps(within, weight);
+            r = _mm_add_ps(r, _mm_mul_ps(weight, _mm_loadu_ps(packet.r)));
+            g = _mm_add_ps(g, _mm_mul_ps(weight, _mm_loadu_ps(packet.g)));
+            b = _mm_add_ps(b, _mm_mul_ps(weight, _mm_loadu_ps(packet.b)));
+        }
+        float lanes[3][4];
+        _mm_storeu_ps(lanes[0], r);
+        _mm_storeu_ps(lanes[1], g);
+        _mm_storeu_ps(lanes[2], b);
+        for (int c = 0; c < 3; c++) {
+            sums[c] += (lanes[c][0] + lanes[c][1]) + (lanes[c][2] + lanes[c][3]);
+        }
+#else
+        for (int p = leafStart[leaf]; p < leafStart[leaf + 1]; p++) {
+            const PhotonPacket &packet = packets[p];
+            float distance2[4];
+            int facing = PacketDistances(packet, point, normal, distance2);
+            for (int lane = 0; lane < 4; lane++) {
+                if ((facing >> lane & 1) && distance2[lane] < radius2) {
+                    float weight = 1.0f - sqrtf(distance2[lane]) * scale;
+                    sums[0] += weight * packet.r[lane];
+                    sums[1] += weight * packet.g[lane];
+                    sums[2] += weight * packet.b[lane];
+                }
+            }
+        }
+#endif
+        return;
+    }
+
+    const Node &split = nodes[node];
+    float offset = point[split.axis] - split.split;
+    if (offset <= radius) {
+        Gather(2 * node + 1, point, normal, radius, sums);
+    }
+    if (offset >= -radius) {
+        Gather(2 * node + 2, point, normal, radius, sums);
+    }
+}
+
+glm::vec3 PhotonMap::IrradianceInRadius(const glm::vec3 &point, const glm::vec3 &normal, float radius) const {
+
+    if (Empty() || radius <= 0.0f || OutOfReach(point, radius)) {
+        return glm::vec3(0.0f);
+    }
+
+    float sums[3] = { 0.0f, 0.0f, 0.0f };
+    Gather(0, point, normal, radius, sums);
+    return glm::vec3(sums[0], sums[1], sums[2]) / ((1.0f - 2.0f / (3.0f * photonFilterCone)) * (float)M_PI * radius * radius);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+
+#include "SceneBVH.h"
+
+// The most photons in a leaf of the kd-tree
+const int photonLeafSize = 8;
+// The most photons an estimate may gather
+const int photonMaxNeighbours = 256;
+// The cone filter's k: a photon at distance d of the radius r weighs 1 - d / (k r), so the
+// ones at the edge still count a little. It sharpens the blurry edges of caustics.
+const float photonFilterCone = 1.1f;
+
+// How many photons a caustic estimate gathers, and the farthest it looks for them
+const int causticNeighbours = 64;
+const float causticMaxRadius = 0.25f;
+// How many times a photon may be refracted or reflected before it is given up
+const int maxPhotonBounces = 16;
+
+// A photon where it landed on a diffuse surface
+class Photon {
+  public:
+    Photon():
+      position(0.0f),
+      power(0.0f),
+      direction(0.0f)
+    {}
+
+    Photon(const glm::vec3 &position, const glm::vec3 &power, const glm::vec3 &direction):
+      position(position),
+      power(power),
+      direction(direction)
+    {}
+
+    glm::vec3 position;
+    glm::vec3 power;      // the flux it carries
+    glm::vec3 direction;  // it arrived in
+};
+
+/*
+** Shoots count photons from a point light at lightPosition through the objects that refract, and
+** returns in photons those that land on a diffuse surface after being refracted or reflected by them:
+** the photons of the caustics. They are aimed at cones around the refracting objects only, as the
+** rest of the light is the direct lighting the tracer computes itself, and their power is what makes
+** the density of photons landing on a lit surface its irradiance in the tracer's terms, that of a light
+** whose intensity doesn't fall off with distance. Fresnel reflection is chosen by Russian roulette, so
+** every stored photon carries the full power. The photons are traced in parallel, and always come out
+** the same and in the same order for the same scene.
+*/
+void EmitCausticPhotons(const SceneBVH &scene, const std::vector<Object *> &objects, const glm::vec3 &lightPosition,
+                        const glm::vec3 &lightIntensity, int count, std::vector<Photon> &photons);
+
+// Four photons of a leaf, one coordinate of all of them after the other, so they are tested together
+struct PhotonPacket {
+    float x[4], y[4], z[4];
+    float dx[4], dy[4], dz[4];  // the directions they arrived in
+    float r[4], g[4], b[4];     // their power
+};
+
+/*
+** Photons in a balanced kd-tree, for the density estimates of photon mapping. The tree is complete,
+** so it needs no pointers: node i has its children at 2i + 1 and 2i + 2, and only the split of each
+** interior node is stored. Every split is at the median along the widest axis of the node's photons,
+** and the leaves, of photonLeafSize photons at most, are kept in the tree's order in packets of four,
+** which the estimates test at once with SSE. The subtrees below the first few levels are built in
+** parallel. An estimate only counts the photons arriving from the side the normal faces, so light
+** doesn't leak through thin objects.
+*/
+class PhotonMap {
+  public:
+    PhotonMap():
+      depth(0),
+      count(0)
+    {}
+
+    /* Builds the map over the photons */
+    void Build(const std::vector<Photon> &photons);
+
+    bool Empty() const { return count == 0; }
+    int Size() const { return count; }
+
+    /* The irradiance at point, on a surface facing normal, from the k nearest photons no farther than
+       maxRadius: their cone filtered power over the area of the circle through the farthest of them */
+    glm::vec3 Irradiance(const glm::vec3 &point, const glm::vec3 &normal, int k, float maxRadius) const;
+
+    /* The irradiance at point from all the photons within radius of it, cone filtered */
+    glm::vec3 IrradianceInRadius(const glm::vec3 &point, const glm::vec3 &normal, float radius) const;
+
+  private:
+    struct Node {
+        float split;
+        int axis;
+    };
+
+    struct Neighbour {
+        float distance2;
+        int photon;  // four times its packet plus its lane
+        bool operator <(const Neighbour &other) const { return distance2 < other.distance2; }
+    };
+
+    // photons [begin, end) of the build, below node, which is on level
+    struct Range {
+        int begin, end;
+        int node, level;
+    };
+
+    int InteriorNodes() const { return (1 << depth) - 1; }
+    bool OutOfReach(const glm::vec3 &point, float radius) const {
+        glm::vec3 outside = glm::max(glm::max(bounds.min - point, point - bounds.max), glm::vec3(0.0f));
+        return glm::dot(outside, outside) > radius * radius;
+    }
+
+    /* Splits the photons of range down to the leaves, setting the nodes and where the leaves begin. If deferred
+       is given, the nodes on deferLevel are left to be split later and added to it instead */
+    void Split(std::vector<Photon> &photons, const Range &range, int deferLevel, std::vector<Range> *deferred, std::vector<int> &leafBegin);
+    void Nearest(int node, const glm::vec3 &point, const glm::vec3 &normal, int k, Neighbour *heap, int &found, float &radius2) const;
+    void Gather(int node, const glm::vec3 &point, const glm::vec3 &normal, float radius, float *sums) const;
+
+    int depth;                          // of the leaves, which are the last level of the tree
+    int count;                          // of photons
+    AABB bounds;                        // of the photons, estimates farther away than their radius find nothing
+    CacheAlignedVector<Node> nodes;     // the interior nodes
+    std::vector<int> leafStart;         // the first packet of each leaf, and one past the last leaf's
+    CacheAlignedVector<PhotonPacket> packets;  // the leaves' photons, padded to whole packets with photons far away
+};
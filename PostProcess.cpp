@@ -0,0 +1,256 @@
+#include "PostProcess.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Parallel.h"
+
+// the framebuffer is walked as one flat array of floats, three per pixel
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "pixels must be packed floats");
+
+static const int postTileSize = 64;
+
+bool ParseToneMapOperator(const std::string &name, ToneMapOperator &toneMap) {
+    if (name == "clamp") {
+        toneMap = ToneMapClamp;
+    } else if (name == "reinhard") {
+        toneMap = ToneMapReinhard;
+    } else if (name == "aces") {
+        toneMap = ToneMapACES;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Every step exists twice, for one float and for four at once, and both compute the same thing.
+
+static inline float ToneMap(float x, ToneMapOperator toneMap) {
+    x = std::max(x, 0.0f);
+    if (toneMap == ToneMapReinhard) {
+        x = x / (1.0f + x);
+    } else if (toneMap == ToneMapACES) {
+        x = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+    }
+    return std::min(x, 1.0f);
+}
+
+// The sRGB curve, with the power of 1/2.4 approximated from three square roots. It is off by
+// at most a quarter of an 8 bit step, and square roots are something SSE has.
+static inline float EncodeSRGB(float x) {
+    if (x <= 0.0031308f) {
+        return 12.92f * x;
+    }
+    float s1 = sqrtf(x), s2 = sqrtf(s1), s3 = sqrtf(s2);
+    return std::min(0.662002687f * s1 + 0.684122060f * s2 - 0.323583601f * s3 - 0.0225411470f * x, 1.0f);
+}
+
+#ifdef __SSE2__
+static inline __m128 ToneMap4(__m128 x, ToneMapOperator toneMap) {
+    x = _mm_max_ps(x, _mm_setzero_ps());
+    if (toneMap == ToneMapReinhard) {
+        x = _mm_div_ps(x, _mm_add_ps(_mm_set1_ps(1.0f), x));
+    } else if (toneMap == ToneMapACES) {
+        __m128 numerator = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), x), _mm_set1_ps(0.03f)));
+        __m128 denominator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), x), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+        x = _mm_div_ps(numerator, denominator);
+    }
+    return _mm_min_ps(x, _mm_set1_ps(1.0f));
+}
+
+static inline __m128 EncodeSRGB4(__m128 x) {
+    __m128 s1 = _mm_sqrt_ps(x), s2 = _mm_sqrt_ps(s1), s3 = _mm_sqrt_ps(s2);
+    __m128 curve = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.662002687f), s1), _mm_mul_ps(_mm_set1_ps(0.684122060f), s2)),
+                              _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(-0.323583601f), s3), _mm_mul_ps(_mm_set1_ps(0.0225411470f), x)));
+    curve = _mm_min_ps(curve, _mm_set1_ps(1.0f));
+    __m128 linear = _mm_mul_ps(_mm_set1_ps(12.92f), x);
+    __m128 dark = _mm_cmple_ps(x, _mm_set1_ps(0.0031308f));
+    return _mm_or_ps(_mm_and_ps(dark, linear), _mm_andnot_ps(dark, curve));
+}
+#endif
+
+/* The fused pass over count floats: the bloom is added, then exposure, tone mapping and the sRGB curve */
+static void ProcessSpan(float *data, const float *bloom, int count, const PostProcessSettings &settings, float scale) {
+
+    int i = 0;
+#ifdef __SSE2__
+    __m128 scale4 = _mm_set1_ps(scale), strength4 = _mm_set1_ps(settings.bloomStrength);
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(data + i);
+        if (bloom) {
+            x = _mm_add_ps(x, _mm_mul_ps(strength4, _mm_loadu_ps(bloom + i)));
+        }
+        x = ToneMap4(_mm_mul_ps(x, scale4), settings.toneMap);
+        if (settings.sRGB) {
+            x = EncodeSRGB4(x);
+        }
+        _mm_storeu_ps(data + i, x);
+    }
+#endif
+    for (; i < count; i++) {
+        float x = data[i];
+        if (bloom) {
+            x += settings.bloomStrength * bloom[i];
+        }
+        x = ToneMap(x * scale, settings.toneMap);
+        data[i] = settings.sRGB ? EncodeSRGB(x) : x;
+    }
+}
+
+/* out = sum of weights[k] * in[k * step], for count floats */
+static void WeightedSum(float *out, const float *const *in, const float *weights, int taps, int count) {
+
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < taps; k++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(in[k] + i)));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count; i++) {
+        float sum = 0.0f;
+        for (int k = 0; k < taps; k++) {
+            sum += weights[k] * in[k][i];
+        }
+        out[i] = sum;
+    }
+}
+
+/*
+** The highlights of the image (what is over the threshold), blurred with a separable gaussian.
+** The blur runs at half the resolution, which is a quarter of the work and memory and looks
+** the same for something this soft. Returned as a flat array of floats like the framebuffer.
+*/
+static std::vector<float> Bloom(const Image &image, const PostProcessSettings &settings, int &width, int &height) {
+
+    width = (image.width + 1) / 2;
+    height = (image.height + 1) / 2;
+    int rowFloats = 3 * width;
+    int radius = std::max(settings.bloomRadius / 2, 1);
+
+    std::vector<float> weights(2 * radius + 1);
+    float sigma = radius / 2.0f, total = 0.0f;
+    for (int k = -radius; k <= radius; k++) {
+        weights[k + radius] = expf(-0.5f * k * k / (sigma * sigma));
+        total += weights[k + radius];
+    }
+    for (size_t k = 0; k < weights.size(); k++) {
+        weights[k] /= total;
+    }
+
+    // the bright pass, averaged over 2x2 pixels
+    std::vector<float> bright(rowFloats * height);
+    ParallelFor(height, [&](int y) {
+        int y0 = 2 * y, y1 = std::min(y0 + 1, image.height - 1);
+        for (int x = 0; x < width; x++) {
+            int x0 = 2 * x, x1 = std::min(x0 + 1, image.width - 1);
+            glm::vec3 threshold(settings.bloomThreshold);
+            glm::vec3 sum = glm::max(image(x0, y0) - threshold, 0.0f) + glm::max(image(x1, y0) - threshold, 0.0f) +
+                            glm::max(image(x0, y1) - threshold, 0.0f) + glm::max(image(x1, y1) - threshold, 0.0f);
+            for (int c = 0; c < 3; c++) {
+                bright[y * rowFloats + 3 * x + c] = 0.25f * sum[c];
+            }
+        }
+    });
+
+    // horizontally: the taps are whole pixels, 3 floats, apart, clamped to the edge of the row
+    std::vector<float> horizontal(bright.size());
+    ParallelFor(height, [&](int y) {
+        const float *row = &bright[y * rowFloats];
+        float *out = &horizontal[y * rowFloats];
+        std::vector<const float *> taps(weights.size());
+
+        int inner0 = std::min(radius, width), inner1 = std::max(width - radius, inner0);
+        if (inner1 > inner0) {
+            for (int k = 0; k < (int)taps.size(); k++) {
+                taps[k] = row + 3 * (inner0 + k - radius);
+            }
+            WeightedSum(out + 3 * inner0, &taps[0], &weights[0], taps.size(), 3 * (inner1 - inner0));
+        }
+
+        for (int x = 0; x < width; x++) {
+            if (x >= inner0 && x < inner1) {
+                continue;
+            }
+            for (int c = 0; c < 3; c++) {
+                float sum = 0.0f;
+                for (int k = -radius; k <= radius; k++) {
+                    sum += weights[k + radius] * row[3 * std::min(std::max(x + k, 0), width - 1) + c];
+                }
+                out[3 * x + c] = sum;
+            }
+        }
+    });
+
+    // vertically: whole rows at a time
+    ParallelFor(height, [&](int y) {
+        std::vector<const float *> taps(weights.size());
+        for (int k = -radius; k <= radius; k++) {
+            taps[k + radius] = &horizontal[std::min(std::max(y + k, 0), height - 1) * rowFloats];
+        }
+        WeightedSum(&bright[y * rowFloats], &taps[0], &weights[0], taps.size(), rowFloats);
+    });
+
+    return bright;
+}
+
+/* Bilinearly upsamples pixels [x0, x1) of row y of the half resolution bloom into out */
+static void UpsampleRow(const std::vector<float> &bloom, int width, int height, int y, int x0, int x1, float *out) {
+
+    float v = std::min(std::max((y + 0.5f) * 0.5f - 0.5f, 0.0f), height - 1.0f);
+    int row0 = (int)v, row1 = std::min(row0 + 1, height - 1);
+    float fy = v - row0;
+    const float *top = &bloom[row0 * 3 * width], *bottom = &bloom[row1 * 3 * width];
+
+    for (int x = x0; x < x1; x++) {
+        float u = std::min(std::max((x + 0.5f) * 0.5f - 0.5f, 0.0f), width - 1.0f);
+        int column0 = (int)u, column1 = std::min(column0 + 1, width - 1);
+        float fx = u - column0;
+        for (int c = 0; c < 3; c++) {
+            float upper = top[3 * column0 + c] + fx * (top[3 * column1 + c] - top[3 * column0 + c]);
+            float lower = bottom[3 * column0 + c] + fx * (bottom[3 * column1 + c] - bottom[3 * column0 + c]);
+            *out++ = upper + fy * (lower - upper);
+        }
+    }
+}
+
+void PostProcess(Image &image, const PostProcessSettings &settings) {
+
+    // the defaults would only clamp, which every output does as it quantizes anyway
+    if (image.pixels.empty() || settings.IsIdentity()) {
+        return;
+    }
+
+    std::vector<float> bloom;
+    int bloomWidth = 0, bloomHeight = 0;
+    if (settings.bloomStrength > 0.0f) {
+        bloom = Bloom(image, settings, bloomWidth, bloomHeight);
+    }
+
+    float scale = powf(2.0f, settings.exposure);
+    float *pixels = &image.pixels[0].x;
+    int tilesX = (image.width + postTileSize - 1) / postTileSize;
+    int tilesY = (image.height + postTileSize - 1) / postTileSize;
+
+    ParallelFor(tilesX * tilesY, [&](int tile) {
+        int x0 = (tile % tilesX) * postTileSize, y0 = (tile / tilesX) * postTileSize;
+        int x1 = std::min(x0 + postTileSize, image.width), y1 = std::min(y0 + postTileSize, image.height);
+
+        // each row of the tile is a contiguous run of floats
+        float bloomRow[3 * postTileSize];
+        for (int y = y0; y < y1; y++) {
+            if (!bloom.empty()) {
+                UpsampleRow(bloom, bloomWidth, bloomHeight, y, x0, x1, bloomRow);
+            }
+            ProcessSpan(pixels + 3 * (y * image.width + x0), bloom.empty() ? NULL : bloomRow, 3 * (x1 - x0), settings, scale);
+        }
+    });
+}
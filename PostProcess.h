@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+
+#include "Image.h"
+
+enum ToneMapOperator {
+    ToneMapClamp,     // cut off at 1, what the window and PPM output always did
+    ToneMapReinhard,  // x / (1 + x) per channel
+    ToneMapACES       // Narkowicz's fit of the ACES filmic curve
+};
+
+/* Parses clamp, reinhard or aces, false if it isn't one of them */
+bool ParseToneMapOperator(const std::string &name, ToneMapOperator &toneMap);
+
+// What the post-process does to a frame. The defaults leave a render as the clamping output always showed it.
+class PostProcessSettings {
+  public:
+    PostProcessSettings():
+      exposure(0.0f),
+      toneMap(ToneMapClamp),
+      sRGB(false),
+      bloomStrength(0.0f),
+      bloomThreshold(1.0f),
+      bloomRadius(8)
+    {}
+
+    float exposure;           // in stops, every stop doubles the brightness
+    ToneMapOperator toneMap;
+    bool sRGB;                // encode with the sRGB transfer curve instead of writing linear values
+    float bloomStrength;      // how much of the blurred highlights is added back, 0 for no bloom
+    float bloomThreshold;     // only what is brighter than this blooms
+    int bloomRadius;          // of the gaussian blur, in pixels
+
+    /* Whether the post-process leaves the image as the outputs show it without one */
+    bool IsIdentity() const { return exposure == 0.0f && toneMap == ToneMapClamp && !sRGB && bloomStrength <= 0.0f; }
+};
+
+/*
+** Turns a linear HDR render into displayable [0, 1] values, in place. Exposure, the bloom,
+** tone mapping and the sRGB curve are fused into a single pass over the framebuffer, which
+** runs tile by tile on every core and works on four floats at a time with SSE (the channels
+** all get the same treatment, so the pixels are processed as a flat array of floats). The
+** bloom needs its neighbourhood, so its bright pass and blur are passes of their own first.
+*/
+void PostProcess(Image &image, const PostProcessSettings &settings);
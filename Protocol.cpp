@@ -0,0 +1,295 @@
+#include "Protocol.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// messages bigger than this are treated as a broken connection rather than allocated
+static const uint32_t maxMessageSize = 256 << 20;
+
+void MessageWriter::PutInt(int32_t value) {
+    uint32_t bits = (uint32_t)value;
+    for (int i = 0; i < 4; i++) {
+        data.push_back((char)((bits >> (8 * i)) & 0xff));
+    }
+}
+
+void MessageWriter::PutFloat(float value) {
+    int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    PutInt(bits);
+}
+
+void MessageWriter::PutVec3(const glm::vec3 &value) {
+    PutFloat(value.x);
+    PutFloat(value.y);
+    PutFloat(value.z);
+}
+
+void MessageWriter::PutString(const std::string &value) {
+    PutInt(value.size());
+    data.insert(data.end(), value.begin(), value.end());
+}
+
+int32_t MessageReader::GetInt() {
+
+    if (position + 4 > data.size()) {
+        ok = false;
+        return 0;
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 4; i++) {
+        bits |= (uint32_t)(unsigned char)data[position + i] << (8 * i);
+    }
+    position += 4;
+
+    return (int32_t)bits;
+}
+
+float MessageReader::GetFloat() {
+    int32_t bits = GetInt();
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+glm::vec3 MessageReader::GetVec3() {
+    float x = GetFloat();
+    float y = GetFloat();
+    float z = GetFloat();
+    return glm::vec3(x, y, z);
+}
+
+std::string MessageReader::GetString() {
+
+    int32_t length = GetInt();
+    if (length < 0 || position + length > data.size()) {
+        ok = false;
+        return std::string();
+    }
+
+    std::string value(data.begin() + position, data.begin() + position + length);
+    position += length;
+
+    return value;
+}
+
+/* Splits host:port, false for anything that should be taken as a Unix socket path */
+static bool ParseTCPAddress(const std::string &address, std::string &host, std::string &port) {
+    size_t colon = address.rfind(':');
+    if (address.find('/') != std::string::npos || colon == std::string::npos) {
+        return false;
+    }
+    host = address.substr(0, colon);
+    port = address.substr(colon + 1);
+    return true;
+}
+
+static bool UnixAddress(const std::string &path, sockaddr_un &address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+int ListenOn(const std::string &address) {
+
+    std::string host, port;
+    if (!ParseTCPAddress(address, host, port)) {
+        sockaddr_un unixAddress;
+        if (!UnixAddress(address, unixAddress)) {
+            return -1;
+        }
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(address.c_str());
+        if (fd >= 0 && (bind(fd, (sockaddr *)&unixAddress, sizeof(unixAddress)) < 0 || listen(fd, 16) < 0)) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    addrinfo hints, *found;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    // an empty host or * listens on every interface
+    if (getaddrinfo(host.empty() || host == "*" ? NULL : host.c_str(), port.c_str(), &hints, &found) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo *i = found; i && fd < 0; i = i->ai_next) {
+        fd = socket(i->ai_family, i->ai_socktype, i->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, i->ai_addr, i->ai_addrlen) < 0 || listen(fd, 16) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+
+    return fd;
+}
+
+int ConnectTo(const std::string &address) {
+
+    std::string host, port;
+    if (!ParseTCPAddress(address, host, port)) {
+        sockaddr_un unixAddress;
+        if (!UnixAddress(address, unixAddress)) {
+            return -1;
+        }
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (sockaddr *)&unixAddress, sizeof(unixAddress)) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    addrinfo hints, *found;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo *i = found; i && fd < 0; i = i->ai_next) {
+        fd = socket(i->ai_family, i->ai_socktype, i->ai_protocol);
+        if (fd >= 0 && connect(fd, i->ai_addr, i->ai_addrlen) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+
+    if (fd >= 0) {
+        // the messages are small and answered one by one, don't let them wait for more data
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+
+    return fd;
+}
+
+static bool WriteAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t received = read(fd, data, size);
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+bool SendMessage(int fd, int type, const std::vector<char> &payload) {
+
+    MessageWriter header;
+    header.PutInt(payload.size() + 1);
+    header.data.push_back((char)type);
+
+    // one buffer, so the message goes out in as few writes as possible
+    header.data.insert(header.data.end(), payload.begin(), payload.end());
+    return WriteAll(fd, &header.data[0], header.data.size());
+}
+
+bool ReceiveMessage(int fd, int &type, std::vector<char> &payload) {
+
+    std::vector<char> header(5);
+    if (!ReadAll(fd, &header[0], header.size())) {
+        return false;
+    }
+
+    MessageReader reader(header);
+    uint32_t length = (uint32_t)reader.GetInt();
+    if (length == 0 || length > maxMessageSize) {
+        return false;
+    }
+    type = (unsigned char)header[4];
+
+    payload.resize(length - 1);
+    return payload.empty() || ReadAll(fd, &payload[0], payload.size());
+}
+
+void RenderJob::Write(MessageWriter &writer) const {
+    writer.PutInt(id);
+    writer.PutString(scene);
+    writer.PutVec3(camera.eye);
+    writer.PutVec3(camera.center);
+    writer.PutVec3(camera.up);
+    writer.PutFloat(camera.fieldOfView);
+    writer.PutInt(width);
+    writer.PutInt(height);
+    writer.PutInt(samples);
+    writer.PutInt(priority);
+    writer.PutInt(x0);
+    writer.PutInt(y0);
+    writer.PutInt(x1);
+    writer.PutInt(y1);
+    writer.PutInt(sampler);
+    writer.PutInt(light);
+    writer.PutFloat(lightSize);
+    writer.PutInt(causticPhotons);
+    writer.PutFloat(causticRadius);
+    writer.PutInt(indirectRays);
+    writer.PutInt(integrator);
+    writer.PutInt(shading);
+}
+
+void RenderJob::Read(MessageReader &reader) {
+    id = reader.GetInt();
+    scene = reader.GetString();
+    camera.eye = reader.GetVec3();
+    camera.center = reader.GetVec3();
+    camera.up = reader.GetVec3();
+    camera.fieldOfView = reader.GetFloat();
+    width = reader.GetInt();
+    height = reader.GetInt();
+    samples = reader.GetInt();
+    priority = reader.GetInt();
+    x0 = reader.GetInt();
+    y0 = reader.GetInt();
+    x1 = reader.GetInt();
+    y1 = reader.GetInt();
+    sampler = reader.GetInt();
+    light = reader.GetInt();
+    lightSize = reader.GetFloat();
+    causticPhotons = reader.GetInt();
+    causticRadius = reader.GetFloat();
+    indirectRays = reader.GetInt();
+    integrator = reader.GetInt();
+    shading = reader.GetInt();
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "Camera.h"
+
+/*
+** The framed protocol spoken over the render sockets. Every message is
+**   uint32 length | uint8 type | length - 1 bytes of payload
+** and all numbers in it are little endian, floats as their IEEE bit pattern.
+*/
+enum MessageType {
+    MessageRenderJob = 1,  // client -> server: a RenderJob
+    MessageCancel = 2,     // client -> server: int32 job id
+    MessageTile = 3,       // server -> client: int32 job id, int32 x0, y0, x1, y1, then (x1 - x0) * (y1 - y0) RGB float pixels
+    MessageJobDone = 4,    // server -> client: int32 job id, int32 1 if it finished or 0 if it was cancelled
+    MessageError = 5       // server -> client: int32 job id, string message
+};
+
+class MessageWriter {
+  public:
+    std::vector<char> data;
+
+    void PutInt(int32_t value);
+    void PutFloat(float value);
+    void PutVec3(const glm::vec3 &value);
+    void PutString(const std::string &value);
+};
+
+// Reads back what a MessageWriter wrote. Reading past the end sets ok to false and returns zeroes.
+class MessageReader {
+  public:
+    MessageReader(const std::vector<char> &data):
+      data(data),
+      position(0),
+      ok(true)
+    {}
+
+    int32_t GetInt();
+    float GetFloat();
+    glm::vec3 GetVec3();
+    std::string GetString();
+
+    const std::vector<char> &data;
+    size_t position;
+    bool ok;
+};
+
+/* Listens on address, host:port for TCP or else the path of a Unix domain socket. Returns the socket, or -1 */
+int ListenOn(const std::string &address);
+/* Connects to an address given the same way as to ListenOn. Returns the socket, or -1 */
+int ConnectTo(const std::string &address);
+
+/* Writes one whole message, false if the connection is gone */
+bool SendMessage(int fd, int type, const std::vector<char> &payload);
+/* Blocks until one whole message has arrived, false if the connection closed or sent garbage */
+bool ReceiveMessage(int fd, int &type, std::vector<char> &payload);
+
+// The shading modes of --shading, exact or with the approximations of FastMath.h
+enum ShadingMode {
+    ShadingExact = 0,
+    ShadingFast = 1
+};
+
+// What to render: a scene by name, seen from camera, at a resolution and a number of samples per pixel
+// placed by a sampler (a SamplerType, see Sampler.h), lit by a light of a shape (a LightShape, see Light.h)
+// and size, with the caustics of causticPhotons photons (estimated within causticRadius, or from the nearest
+// photons when 0) and the indirect light of irradiance records made with
+// indirectRays rays each (none when 0), by an integrator (an Integrator, see PathTracer.h) and in a
+// shading mode (a ShadingMode).
+// Only the pixels [x0, x1) x [y0, y1) of the frame are rendered, where x1 and y1 below zero mean up to
+// the edge. Higher priorities are rendered first, jobs of the same priority in the order they arrived.
+class RenderJob {
+  public:
+    RenderJob():
+      id(0),
+      scene("default"),
+      width(640),
+      height(480),
+      samples(1),
+      priority(0),
+      x0(0),
+      y0(0),
+      x1(-1),
+      y1(-1),
+      sampler(0),
+      light(0),
+      lightSize(1.0f),
+      causticPhotons(0),
+      causticRadius(0.0f),
+      indirectRays(0),
+      integrator(0),
+      shading(ShadingExact)
+    {}
+
+    int id;
+    std::string scene;
+    Camera camera;
+    int width;
+    int height;
+    int samples;
+    int priority;
+    int x0, y0, x1, y1;
+    int sampler;
+    int light;
+    float lightSize;
+    int causticPhotons;
+    float causticRadius;
+    int indirectRays;
+    int integrator;
+    int shading;
+
+    int RegionX1() const { return x1 < 0 ? width : x1; }
+    int RegionY1() const { return y1 < 0 ? height : y1; }
+
+    void Write(MessageWriter &writer) const;
+    void Read(MessageReader &reader);
+};
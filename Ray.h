@@ -4,6 +4,9 @@
 #include "glm/gtc/matrix_transform.hpp"
 
 class Material;
+class Object;
+class TileDependencies;
+class IrradianceStaging;
 
 class Ray {
   public:
@@ -28,7 +31,8 @@ class IntersectInfo {
       time(std::numeric_limits<float>::infinity()),
       hitPoint(0.0f),
       normal(0.0f),
-      material(NULL)
+      material(NULL),
+      object(NULL)
     {}
     // It allows you to init variables in another way. Equal to:
     // IntersectInfo(){
@@ -46,8 +50,17 @@ class IntersectInfo {
     float time;
     /* The material of the object that was intersected */
     const Material *material;
-    /* The material of the object that was intersected */
+    /* The object that was intersected */
+    const Object *object;
 
+    // Copies like "operator =" below; declared alongside it, as C++11 deprecates the implicit one then
+    IntersectInfo(const IntersectInfo &other):
+      hitPoint(other.hitPoint),
+      normal(other.normal),
+      time(other.time),
+      material(other.material),
+      object(other.object)
+    {}
 
     // Reloading "operator =" for class IntersectInfo
     IntersectInfo &operator =(const IntersectInfo &rhs) {
@@ -55,6 +68,7 @@ class IntersectInfo {
       material = rhs.material;
       normal = rhs.normal;
       time = rhs.time;
+      object = rhs.object;
       return *this;
     }
 };
@@ -63,12 +77,49 @@ class Payload {//In this case, it stands for the light particle shot from a cert
   public:
     Payload():
       color(0.0f),
-      numBounces(0) ,
-      hasRefracted(false)
+      numBounces(0),
+      weight(1.0f),
+      seed(0),
+      deps(NULL),
+      irradiance(NULL),
+      isPrimary(true)
     {}
-    
+
+    /* The payload of a secondary ray spawned from this one, which ends up in the pixel with the given weight */
+    Payload Secondary(float secondaryWeight) {
+      Payload secondary;
+      secondary.numBounces = numBounces + 1;
+      secondary.weight = secondaryWeight;
+      secondary.seed = NextInt();
+      secondary.deps = deps;
+      secondary.irradiance = irradiance;
+      secondary.isPrimary = false;
+      return secondary;
+    }
+
+    /* A uniformly distributed random number in [0, 1), from the payload's own generator */
+    float Random() {
+      return (NextInt() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    /* 32 random bits from the same generator */
+    unsigned int RandomBits() {
+      return NextInt();
+    }
+
     glm::vec3 color;//  Each time, intersecting with something will change the color of this Payload.
-    int numBounces; //  To make the calculation not so expensive, Ray hits more times than a certain number of bounces will not be taken into consideration.
-    bool hasRefracted; // setting something to ensure refraction occurs only once
-};
+    int numBounces; //  How many reflections and refractions deep the ray is, 0 for the camera ray.
+    float weight;   //  How much of the ray's color ends up in the pixel, the product of the reflection and refraction levels on the way.
+    unsigned int seed; // the state of the random numbers, seeded per sample so a render doesn't depend on how it is split into tiles
+    TileDependencies *deps; // if set, every object and ray segment the pixel depends on is recorded here
+    IrradianceStaging *irradiance; // if set, where the irradiance records the ray makes go, see IrradianceCache.h
+    bool isPrimary; // true until the camera ray itself has been traced, the later rays are secondary
 
+  private:
+    // PCG's 32 bit RXS-M-XS variant
+    unsigned int NextInt() {
+      seed = seed * 747796405u + 2891336453u;
+      unsigned int word = ((seed >> ((seed >> 28u) + 4u)) ^ seed) * 277803737u;
+      return (word >> 22u) ^ word;
+    }
+};
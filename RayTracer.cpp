@@ -6,24 +6,144 @@ int windowY = 480;
 /*
 ** std::vector is a data format similar with list in most of  script language, which allows users to change its size after claiming.
 ** The difference is that std::vector is based on array rather than list, so it is not so effective when you try to insert a new element, but faster while calling for values randomly or add elements by order.
+**
+** These are the objects of the scene that is being rendered, the objects of mainScene unless the render server switched to another one.
 */
 std::vector<Object*> objects;
 
+// Every object in the scene lives in the scene's arena, so the whole scene is freed in one go
+// and the objects sit next to each other in memory in the order they were added.
+Scene mainScene;
+
+Camera camera;
+
 // Lighting constants
 const glm::vec3 lightSource(-6, 6, 2);
 const glm::vec3 lightIntensity(1, 1, 1);
 //const float specularIntensity = 10.0;
 
+// The light's shape, at lightSource, set from the command line
+Light light(lightSource);
+
+// The objects are owned by mainScene (see BuildScene below), so they are all freed together
 void cleanup() {
-	for(unsigned int i = 0; i < objects.size(); ++i){
-		if(objects[i]){
-			delete objects[i];
-		}
-	}
+	objects.clear();
+	mainScene.Release();
+}
+
+// The scene being rendered, whose objects objects holds, and whose hierarchy the rays are traced through
+// (updated before tracing whenever objects may have moved): mainScene unless the render server switched
+// to another one
+Scene *activeScene = &mainScene;
+
+void ActivateScene(Scene *scene) {
+    activeScene = scene;
+    objects = scene->objects;
+}
+
+// The caustics: the light the refracting objects focus onto the others, as photons in the active scene's
+// photon map that is shot again whenever objects changed. causticPhotons is how many are shot, set from the
+// command line, and none by default. causticRadius, when set, estimates them from all the photons within it
+// instead of from the nearest ones.
+int causticPhotons = 0;
+float causticRadius = 0.0f;
+
+// Shoots the caustic photons again if objects changed since they were last shot, or they were shot with
+// another count or shading mode, and returns whether it did. Must not run while rays are traced, and after the scene's
+// hierarchy is up to date.
+bool UpdateCaustics() {
+
+    Scene &scene = *activeScene;
+    bool changed = scene.causticSnapshot.Update(objects);
+    int count = std::max(causticPhotons, 0);
+    if (count == scene.causticPhotons && (count == 0 || (!changed && fastMath == scene.causticFastMath))) {
+        return false;
+    }
+
+    scene.causticPhotons = count;
+    scene.causticFastMath = fastMath;
+    std::vector<Photon> photons;
+    if (count == 0) {
+        scene.causticMap = PhotonMap();
+        return true;
+    }
+    EmitCausticPhotons(scene.bvh, objects, lightSource, lightIntensity, count, photons);
+    scene.causticMap.Build(photons);
+    return true;
+}
+
+// The indirect diffuse lighting: the light the surfaces get from the others, which are seen through
+// the hemisphere rays of irradiance records (see IrradianceCache.h) lit by the light directly. The active
+// scene's cache is emptied whenever objects changed, and filled by coarse passes over the frame before it
+// is traced. indirectRays is how many rays a record is made with, set from the command line, and none by default.
+int indirectRays = 0;
+// The coarse passes trace every irradiancePrepassStride-th pixel of every row and column, then half as
+// many apart, down to every second; after them most hits of the frame find records that reach them
+const int irradiancePrepassStride = 8;
+// How much of the pixel a hit has to make up to make a record where it finds none, see IndirectDiffuse
+const float irradianceRecordWeight = 0.5f;
+
+// Empties the active scene's irradiance cache, for records made with indirectRays rays and seeing light
+void ClearIrradianceCache() {
+
+    Scene &scene = *activeScene;
+    scene.irradianceSnapshot.Update(objects);
+    scene.indirectRays = indirectRays;
+    scene.indirectLight = light;
+
+    // records off the objects' box, on the planes far away, stay in the octree's root
+    AABB bounds;
+    for (size_t i = 0; i < objects.size(); i++) {
+        AABB box = objects[i]->Bounds();
+        if (box.IsFinite()) {
+            bounds.Extend(box);
+        }
+    }
+    if (bounds.IsEmpty()) {
+        bounds = AABB(glm::vec3(-1.0f), glm::vec3(1.0f));
+    }
+    glm::vec3 margin = 0.5f * bounds.Extent() + glm::vec3(1.0f);
+    scene.irradianceCache.Clear(AABB(bounds.min - margin, bounds.max + margin));
+}
+
+// Empties the irradiance cache if objects changed since it was last emptied, or its records were made with
+// other rays or another light, and returns whether it did
+bool UpdateIndirect() {
+
+    Scene &scene = *activeScene;
+    if (indirectRays <= 0) {
+        return false;
+    }
+    bool changed = scene.irradianceSnapshot.Update(objects);
+    if (!changed && scene.indirectRays == indirectRays && scene.indirectLight.shape == light.shape && scene.indirectLight.size == light.size) {
+        return false;
+    }
+    ClearIrradianceCache();
+    return true;
+}
+
+// Whether the frames are Whitted shaded, by CastRay and RenderRegion's batches, or path traced (see
+// PathTracer.h), set from the command line. Caustics and indirect light are the Whitted shading's.
+Integrator integrator = IntegratorWhitted;
+ObjectsSnapshot pathSnapshot;  // of objects when the window's frame was last path traced from scratch
+
+// The light of the caustics the hit reflects, estimated from the nearest caustic photons, or from those
+// within causticRadius if it is set
+glm::vec3 Caustics(const IntersectInfo &info) {
+
+    const PhotonMap &causticMap = activeScene->causticMap;
+    if (causticMap.Empty()) {
+        return glm::vec3(0.0f);
+    }
+    // a diffuse surface, like the direct lighting of GetPhong without the 1 / pi
+    if (causticRadius > 0.0f) {
+        return info.material->diffuse * causticMap.IrradianceInRadius(info.hitPoint, info.normal, causticRadius);
+    }
+    return info.material->diffuse * causticMap.Irradiance(info.hitPoint, info.normal, causticNeighbours, causticMaxRadius);
 }
 
 /*
-** TODO: Function for testing intersection against all the objects in the scene
+** Tests the ray against all the objects in the scene
 **
 ** If an object is hit then the IntersectionInfo object should contain
 ** the information about the intersection. Returns true if any object is hit,
@@ -31,51 +151,63 @@ void cleanup() {
 **
 */
 bool CheckIntersection(const Ray &ray, IntersectInfo &info) {
+    return activeScene->bvh.Intersect(ray, info);
+}
 
-    float minDepth = LONG_MAX;
-    int closestObject = 0;
+// Whether anything lies between the hit point and target, the point light or a point on an area light
+bool Occluded(const glm::vec3 &hitPoint, const glm::vec3 &target, TileDependencies *deps) {
 
-    for (int i = 0; i < objects.size(); i++ ){
-        if (objects[i] -> Intersect(ray, info)) {
-            if (info.time < minDepth) {
-                minDepth = info.time;
-                closestObject = i;
-            }
-        }
+    // setting an offset slightly above the surface for floating point errors
+    float threshold = 0.01;
+
+    glm::vec3 direction = glm::normalize(target - hitPoint);
+    Ray shadow = Ray(hitPoint + threshold * direction, direction);
+    float lightDistance = glm::length(target - shadow.origin);
+
+    if (deps) {
+        deps->RecordSegment(shadow.origin, target);
     }
 
-    return objects[closestObject]->Intersect(ray, info);
+    const Object *occluder = activeScene->bvh.Occluder(shadow, lightDistance);
+    if (occluder && deps) {
+        deps->RecordHit(occluder);
+    }
 
-	//You need to add your own solution for this funtion, to replace the 'return true'.
-	//Runing the function Intersect() of each of the objects would be one of the options.
-	//Each time when intersect happens, the payload of ray will need to be updated, but that's no business of this function.
-	//To make it clear, keyword const prevents the function from changing parameter ray.
+    return occluder != NULL;
 }
 
-// checks to see if the object hit by the ray is in shadow
-bool hasShadow(const IntersectInfo info) {
+// Shadow rays of an area light are cast shadowRound at a time, and all of a hit's rays are spread over the
+// light as one scrambled Sobol sequence, so each round fills in between the earlier ones. If the first round
+// agrees the hit is taken to be fully lit or fully in shadow; only in the penumbra, where they disagree, do
+// more rounds follow, up to maxShadowSamples. A secondary ray's hit that ends up in the pixel with a weight under
+// shadowRoundWeight only gets a single shadow ray: its noise is scaled down by that weight, and it is unbiased.
+const int shadowRound = 4;
+const int maxShadowSamples = 64;
+const float shadowRoundWeight = 0.25f;
 
-    // setting an offset slightly above the surface for floating point errors
-    float threshold = 0.01;
-
-    Ray light = Ray(info.hitPoint, lightSource - info.hitPoint);
-    glm::vec3 withOffset = light(threshold);
-    Ray shadow = Ray(withOffset, lightSource);
+// How much of the light the hit point sees, from 0 in full shadow to 1 fully lit
+float LightVisibility(const IntersectInfo &info, Payload &payload) {
 
-    float lightDistance = glm::length(lightSource - shadow.origin);
-    IntersectInfo shadowIntersect;
+    if (!light.IsArea()) {
+        return Occluded(info.hitPoint, lightSource, payload.deps) ? 0.0f : 1.0f;
+    }
 
-    // checking to see if there is intersections between shadow ray and objects and if that intersect isn't behind light source
-    for (int i=0; i<objects.size(); i++) {
-        if (objects[i]->Intersect(shadow, shadowIntersect) && shadowIntersect.time < lightDistance) {
-            return true;
+    unsigned int scramble0 = payload.RandomBits(), scramble1 = payload.RandomBits();
+    int round = payload.weight < shadowRoundWeight ? 1 : shadowRound;
+    int visible = 0, taken = 0;
+    do {
+        for (int end = taken + round; taken < end; taken++) {
+            glm::vec3 target = light.SamplePoint(info.hitPoint, ScrambledSobol(taken, scramble0, scramble1));
+            visible += !Occluded(info.hitPoint, target, payload.deps);
         }
-    }
+    } while (round > 1 && visible != 0 && visible != taken && taken < maxShadowSamples);
 
-    return false;
+    return (float)visible / taken;
 }
 
-glm::vec3 GetPhong(const Ray &ray, IntersectInfo &info, bool inShadow) {
+// The Phong color of the hit, where visibility is how much of the light reaches it (see LightVisibility):
+// the ambient term is always there, the diffuse and specular ones are scaled by it.
+glm::vec3 GetPhong(const Ray &ray, IntersectInfo &info, float visibility) {
 
     glm::vec3 illumination;
     glm::vec3 specular;
@@ -83,8 +215,10 @@ glm::vec3 GetPhong(const Ray &ray, IntersectInfo &info, bool inShadow) {
     glm::vec3 ambient;
 
     glm::vec3 n = info.normal;
-    glm::vec3 l = glm::normalize(lightSource - info.hitPoint);
-    glm::vec3 v = glm::normalize(ray.origin - info.hitPoint);
+    glm::vec3 l = ShadingNormalize(lightSource - info.hitPoint);
+    // a secondary ray can hit right where it starts, then the way back along it is the direction to the viewer
+    glm::vec3 toOrigin = ray.origin - info.hitPoint;
+    glm::vec3 v = glm::dot(toOrigin, toOrigin) > 0.0f ? ShadingNormalize(toOrigin) : -ray.direction;
 
     // calculate diffuse
     float cosTheta = fmax(0, glm::dot(l, n));
@@ -98,17 +232,18 @@ glm::vec3 GetPhong(const Ray &ray, IntersectInfo &info, bool inShadow) {
     ambient[2] = lightIntensity[2] * info.material->ambient[2];
 
     // calculate specular
-    glm::vec3 r = glm::normalize((2.0f * n * glm::dot(l, n)) - l);
+    glm::vec3 r = ShadingNormalize((2.0f * n * glm::dot(l, n)) - l);
     float cosAlpha = fmax(0, glm::dot(r, v));
-    specular[0] = lightIntensity[0] * info.material->specular[0] * pow(cosAlpha, info.material->specularIntensity);
-    specular[1] = lightIntensity[1] * info.material->specular[1] * pow(cosAlpha, info.material->specularIntensity);
-    specular[2] = lightIntensity[2] * info.material->specular[2] * pow(cosAlpha, info.material->specularIntensity);
+    float highlight = ShadingPow(cosAlpha, info.material->specularIntensity);
+    specular[0] = lightIntensity[0] * info.material->specular[0] * highlight;
+    specular[1] = lightIntensity[1] * info.material->specular[1] * highlight;
+    specular[2] = lightIntensity[2] * info.material->specular[2] * highlight;
 
-    if (!inShadow) {
-        // if not in shadow, add them all up
-        illumination[0] = specular[0] + diffuse[0] + ambient[0];
-        illumination[1] = specular[1] + diffuse[1] + ambient[1];
-        illumination[2] = specular[2] + diffuse[2] + ambient[2];
+    if (visibility > 0.0f) {
+        // if not fully in shadow, add them all up, the light's share in proportion to how much of it is seen
+        illumination[0] = visibility * specular[0] + visibility * diffuse[0] + ambient[0];
+        illumination[1] = visibility * specular[1] + visibility * diffuse[1] + ambient[1];
+        illumination[2] = visibility * specular[2] + visibility * diffuse[2] + ambient[2];
 
     } else {
         // if in shadow, just return the ambient illumination
@@ -123,9 +258,104 @@ glm::vec3 GetPhong(const Ray &ray, IntersectInfo &info, bool inShadow) {
 
 }
 
-glm::vec3 GetReflection(const Ray &ray, IntersectInfo &info, Payload &payload, glm::vec3 color) {
+// Most secondary rays hardly show in the pixel: a reflection off a sphere that reflects 0.1 of the
+// light, reflected again, is weighted by 0.01. A ray that weighs less than minRayWeight is not traced.
+// From rouletteDepth bounces on, a ray lighter than rouletteWeight plays Russian roulette: it is traced
+// with a probability of weight / rouletteWeight and its color is then scaled up by the inverse, which
+// keeps the expected color of the pixel what it was. maxRayDepth stops the rest, such as the rays
+// caught between the insides of refractive spheres.
+const float minRayWeight = 1.0f / 512.0f;
+const int rouletteDepth = 3;
+const float rouletteWeight = 1.0f / 32.0f;
+const int maxRayDepth = 16;
+
+// The light the hit gets from the other surfaces and reflects diffusely, interpolated from the irradiance
+// records that reach it. Where there are none a record is made, from rays over the hemisphere that see
+// the direct lighting of what they hit, and staged in the payload's IrradianceStaging if it has one; but
+// only for hits that end up in the pixel with at least irradianceRecordWeight. The others, mostly on the
+// small curved bits of the spheres seen in their faint reflections, where records would crowd without
+// being reused, only use the records there are, and the material's ambient term stands in for the rest.
+glm::vec3 IndirectDiffuse(const Ray &ray, const IntersectInfo &info, Payload &payload) {
+
+    if (indirectRays <= 0 || info.material->diffuse == glm::vec3(0.0f)) {
+        return glm::vec3(0.0f);
+    }
+
+    // the side of the surface the ray sees
+    glm::vec3 normal = glm::dot(info.normal, ray.direction) > 0.0f ? -info.normal : info.normal;
+    glm::vec3 irradiance;
+    if (!activeScene->irradianceCache.Lookup(info.hitPoint, normal, payload.irradiance, irradiance)) {
+        if (payload.weight < irradianceRecordWeight) {
+            return glm::vec3(0.0f);
+        }
+
+        HemisphereStrata strata(normal, indirectRays);
+        std::vector<glm::vec3> radiance(strata.Count());
+        std::vector<float> distance(strata.Count());
+        unsigned int scramble0 = payload.RandomBits(), scramble1 = payload.RandomBits();
+        for (int i = 0; i < strata.Count(); i++) {
+            glm::vec3 direction = strata.Direction(i, ScrambledSobol(i, scramble0, scramble1));
+            Ray probe(info.hitPoint + 0.01f * direction, direction);
+            IntersectInfo hit;
+            radiance[i] = glm::vec3(0.0f);
+            distance[i] = INFINITY;
+            if (CheckIntersection(probe, hit)) {
+                // each ray counts for little, so an area light gets one shadow ray per ray
+                Payload probePayload;
+                probePayload.seed = payload.RandomBits();
+                probePayload.weight = payload.weight / strata.Count();
+                radiance[i] = GetPhong(probe, hit, LightVisibility(hit, probePayload));
+                distance[i] = hit.time;
+            }
+        }
+
+        IrradianceRecord record = MakeIrradianceRecord(info.hitPoint, strata, radiance, distance);
+        if (payload.irradiance) {
+            payload.irradiance->records.push_back(record);
+        }
+        irradiance = record.irradiance;
+    }
+
+    // it is the irradiance over pi, so this is a Lambertian surface of albedo diffuse
+    return info.material->diffuse * irradiance;
+}
+
+// Whether a secondary ray that ends up in the pixel with the given weight is traced. Returns the factor its
+// color has to be scaled by, which is 1 unless it survived the roulette, or 0 if it is not traced.
+float SecondaryRayScale(Payload &payload, float weight) {
 
-    if (payload.numBounces < 5) {
+    if (weight < minRayWeight || payload.numBounces >= maxRayDepth) {
+        return 0.0f;
+    }
+    if (payload.numBounces < rouletteDepth || weight >= rouletteWeight) {
+        return 1.0f;
+    }
+
+    float survival = weight / rouletteWeight;
+    return payload.Random() < survival ? 1.0f / survival : 0.0f;
+}
+
+// A reflection or refraction ray of a hit, set up by SpawnReflection or SpawnRefraction. It can be traced
+// right away, as GetReflection and GetRefraction do, or queued with others and traced later.
+class SecondaryRay {
+  public:
+    SecondaryRay():
+      ray(glm::vec3(0.0f), glm::vec3(0.0f)),
+      scale(0.0f)
+    {}
+
+    Ray ray;
+    Payload payload;  // its color is the traced color
+    float scale;      // what its color is scaled by (see SecondaryRayScale), 0 if it is not traced
+};
+
+void SpawnReflection(const Ray &ray, const IntersectInfo &info, Payload &payload, SecondaryRay &secondary) {
+
+    float reflection = info.material->reflection;
+
+    // the weight ignores the share refraction may take away below, so it can only overestimate
+    secondary.scale = SecondaryRayScale(payload, payload.weight * reflection);
+    if (secondary.scale > 0.0f) {
 
         // setting an offset slightly above the surface for floating point errors
         float threshold = 0.01;
@@ -133,56 +363,150 @@ glm::vec3 GetReflection(const Ray &ray, IntersectInfo &info, Payload &payload, g
         // create reflection ray
         glm::vec3 direction = ray.direction - 2 * (glm::dot(ray.direction, info.normal)) * info.normal;
         glm::vec3 withOffset = Ray(info.hitPoint, direction)(threshold);
-        Ray reflection = Ray(withOffset, direction);
-        CastRay(reflection, payload);
-        payload.numBounces += 1;
+        secondary.ray = Ray(withOffset, direction);
+        secondary.payload = payload.Secondary(payload.weight * info.material->reflection * secondary.scale);
     }
+}
+
+// The hit's color with its traced reflection mixed in
+glm::vec3 MixReflection(const IntersectInfo &info, const SecondaryRay &secondary, glm::vec3 color) {
 
-    // get reflected color
     float reflection = info.material->reflection;
-    glm::vec3 reflColor = reflection * payload.color;
-    glm::vec3 reflectMix = reflColor + ((1-reflection) * color);
+    glm::vec3 reflColor(0.0f);
+    if (secondary.scale > 0.0f) {
+        reflColor = secondary.scale * secondary.payload.color;
+    }
+
+    // get reflected color
+    glm::vec3 reflectMix = (reflection * reflColor) + ((1-reflection) * color);
 
     return reflectMix;
 }
 
-glm::vec3 GetRefraction(const Ray &ray, IntersectInfo &info, Payload &payload, glm::vec3 reflectMix) {
+glm::vec3 GetReflection(const Ray &ray, IntersectInfo &info, Payload &payload, glm::vec3 color) {
 
-    if (info.material->refraction > 0 || !payload.hasRefracted) {
+    SecondaryRay reflection;
+    SpawnReflection(ray, info, payload, reflection);
+    if (reflection.scale > 0.0f) {
+        CastRay(reflection.ray, reflection.payload);
+    }
+    return MixReflection(info, reflection, color);
+}
 
-        payload.hasRefracted = true;
-        float refractionLevel = 0;
-        float ratio = -1.0 / info.material->refraction;
+// Returns false if the hit has no refraction to mix in at all: the material doesn't refract, or the ray is totally reflected
+bool SpawnRefraction(const Ray &ray, const IntersectInfo &info, Payload &payload, SecondaryRay &secondary) {
 
-        // Compute the direction of the refraction ray
-        float radialDistance =  1.0 - powf(ratio, 2.0) * (1.0 - powf(glm::dot(info.normal,-ray.direction), 2.0));
+    secondary.scale = 0.0f;
+    if (info.material->refraction <= 0) {
+        return false;
+    }
 
-        if (radialDistance > 0) {
+    float ratio = -1.0 / info.material->refraction;
 
-            // setting an offset slightly above the surface for floating point errors
-            float threshold = 0.01;
-            refractionLevel = info.material->refractiveIndex;
+    // Compute the direction of the refraction ray
+    float radialDistance =  1.0 - powf(ratio, 2.0) * (1.0 - powf(glm::dot(info.normal,-ray.direction), 2.0));
 
-            // create reflection ray
-            glm::vec3 direction = (ratio * (glm::dot(info.normal,-ray.direction)) - sqrtf(radialDistance)) * info.normal - (ratio * -ray.direction);
-            glm::vec3 withOffset = Ray(info.hitPoint, direction)(threshold);
-            Ray refraction = Ray(withOffset, direction);
+    if (radialDistance <= 0) {
+        return false;
+    }
 
-            CastRay(refraction, payload);
+    float refractionLevel = info.material->refractiveIndex;
 
-        }
+    secondary.scale = SecondaryRayScale(payload, payload.weight * refractionLevel);
+    if (secondary.scale > 0.0f) {
 
-        glm::vec3 refractionMix = (refractionLevel * payload.color) + ((1-refractionLevel) * reflectMix);
+        // setting an offset slightly above the surface for floating point errors
+        float threshold = 0.01;
 
-        return  refractionMix;
+        // create refraction ray
+        glm::vec3 direction = (ratio * (glm::dot(info.normal,-ray.direction)) - sqrtf(radialDistance)) * info.normal - (ratio * -ray.direction);
+        glm::vec3 withOffset = Ray(info.hitPoint, direction)(threshold);
+        secondary.ray = Ray(withOffset, direction);
+        secondary.payload = payload.Secondary(payload.weight * refractionLevel * secondary.scale);
+    }
+    return true;
+}
 
-    } else {
+// The color with the hit's traced refraction mixed in
+glm::vec3 MixRefraction(const IntersectInfo &info, const SecondaryRay &secondary, glm::vec3 reflectMix) {
 
+    float refractionLevel = info.material->refractiveIndex;
+    glm::vec3 refrColor(0.0f);
+    if (secondary.scale > 0.0f) {
+        refrColor = secondary.scale * secondary.payload.color;
+    }
+
+    glm::vec3 refractionMix = (refractionLevel * refrColor) + ((1-refractionLevel) * reflectMix);
+
+    return refractionMix;
+}
+
+glm::vec3 GetRefraction(const Ray &ray, IntersectInfo &info, Payload &payload, glm::vec3 reflectMix) {
+
+    SecondaryRay refraction;
+    if (!SpawnRefraction(ray, info, payload, refraction)) {
         return reflectMix;
     }
+    if (refraction.scale > 0.0f) {
+        CastRay(refraction.ray, refraction.payload);
+    }
+    return MixRefraction(info, refraction, reflectMix);
+}
+
+// Orders the traced ones of rays so that rays going the same way from nearby origins follow each other,
+// and so mostly visit the same objects: by the octant of their direction (the signs of its coordinates),
+// then along a Morton curve through the bounding box of their origins. order gets their indices.
+void SortSecondaryRays(const std::vector<SecondaryRay> &rays, std::vector<int> &order) {
+
+    AABB origins;
+    for (size_t i = 0; i < rays.size(); i++) {
+        if (rays[i].scale > 0.0f) {
+            origins.Extend(rays[i].ray.origin);
+        }
+    }
+
+    // the octant and the Morton code take the top 33 bits of the key, the index the low 31
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i < rays.size(); i++) {
+        if (rays[i].scale > 0.0f) {
+            const glm::vec3 &direction = rays[i].ray.direction;
+            uint64_t octant = (direction.x < 0.0f ? 4 : 0) | (direction.y < 0.0f ? 2 : 0) | (direction.z < 0.0f ? 1 : 0);
+            uint64_t cell = (octant << 30) | MortonCode(rays[i].ray.origin, origins);
+            keys.push_back((cell << 31) | i);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+
+    order.clear();
+    for (size_t i = 0; i < keys.size(); i++) {
+        order.push_back((int)(keys[i] & 0x7fffffff));
+    }
 }
 
 
+// Intersects the ray with the scene, recording what the pixel depended on if the payload asks for it
+bool TraceRay(const Ray &ray, IntersectInfo &info, Payload &payload) {
+
+	bool hit = CheckIntersection(ray,info);
+
+	if (payload.deps) {
+		// remember what this pixel depended on, for redoing only the affected tiles after an edit
+		if (hit) {
+			payload.deps->RecordHit(info.object);
+		}
+		if (!payload.isPrimary) {
+			if (hit) {
+				payload.deps->RecordSegment(ray.origin, info.hitPoint);
+			} else {
+				payload.deps->RecordEscape(ray);
+			}
+		}
+		payload.isPrimary = false;
+	}
+
+	return hit;
+}
+
 /*
 ** TODO: Recursive ray-casting function. It might be the most important Function in this demo cause it's the one decides the color of pixels.
 **
@@ -196,12 +520,13 @@ glm::vec3 GetRefraction(const Ray &ray, IntersectInfo &info, Payload &payload, g
 float CastRay(Ray &ray, Payload &payload) {
 
 	IntersectInfo info;
+	bool hit = TraceRay(ray, info, payload);
 
-	if (CheckIntersection(ray,info)) {
+	if (hit) {
 		/* TODO: Set payload color based on object materials, not direction */
 
         // COLOR & SHADOWS
-        glm::vec3 color = GetPhong(ray, info, hasShadow(info));
+        glm::vec3 color = GetPhong(ray, info, LightVisibility(info, payload)) + Caustics(info) + IndirectDiffuse(ray, info, payload);
 
         // REFLECTION
         glm::vec3 reflectMix = GetReflection(ray, info, payload, color);
@@ -224,47 +549,271 @@ float CastRay(Ray &ray, Payload &payload) {
 
 // Render Function
 
-// This is the main render function, it draws pixels onto the display
-// using GL_POINTS. It is called every time an update is required.
+// RenderImage transforms each pixel into the space of the virtual
+// scene and casts a ray from the camera in that direction using CastRay,
+// storing the returned color in the framebuffer. It does not touch OpenGL,
+// so it can also be used without a window (see the --render/--compare options).
 
-// This function transforms each pixel into the space of the virtual
-// scene and casts a ray from the camera in that direction using CastRay
+// Render is the display callback, it draws the framebuffer onto the display
+// using GL_POINTS. It is called every time an update is required.
 // And for rendering,
 // 1)Clear the screen so we can draw a new frame
 // 2)Cast a ray into the scene for each pixel on the screen and use the returned color to render the pixel
 // 3)Flush the pipeline so that the instructions we gave are performed.
 
+// The camera ray of one sample, kept between the passes of RenderRegion
+class PrimarySample {
+  public:
+    PrimarySample(const Ray &ray):
+      ray(ray),
+      hit(false),
+      shadingIndex(-1)
+    {}
+
+    Ray ray;
+    IntersectInfo info;
+    Payload payload;
+    bool hit;
+    int shadingIndex;  // of its hit in the ShadingBatch
+};
+
+// The camera ray through the point (x, y), in pixels, of a frame of frameWidth x frameHeight
+Ray CameraRay(const glm::mat4 &inverseViewProj, int frameWidth, int frameHeight, float x, float y) {
+
+	float pixelX =  2*(x/frameWidth)-1;	//Actually, (pixelX, pixelY) are the relative position of the point(x, y).
+	float pixelY = -2*(y/frameHeight)+1;	//The displayzone will be decribed as a 2.0f x 2.0f platform and coordinate origin is the center of the display zone.
+
+	//	Decide the direction of each of the ray.
+	glm::vec4 worldNear = inverseViewProj * glm::vec4(pixelX, pixelY, -1, 1);
+	glm::vec4 worldFar  = inverseViewProj * glm::vec4(pixelX, pixelY,  1, 1);
+	glm::vec3 worldNearPos = glm::vec3(worldNear.x, worldNear.y, worldNear.z) / worldNear.w;
+	glm::vec3 worldFarPos  = glm::vec3(worldFar.x, worldFar.y, worldFar.z) / worldFar.w;
+
+	return Ray(worldNearPos, ShadingNormalize(glm::vec3(worldFarPos - worldNearPos))); //Ray(const glm::vec3 &origin, const glm::vec3 &direction)
+}
+
+// How many samples RenderRegion intersects before shading them together, rounded up to whole pixels
+const int primaryBatchSize = 256;
+
+// Traces the pixels [x0, x1) x [y0, y1) of a frame of frameWidth x frameHeight into target, whose top left
+// pixel is the frame pixel (targetX, targetY), recording what they depended on in deps if it is given.
+// Every pixel gets sampler.SampleCount() samples, placed inside the pixel by the sampler, and averaged.
+// The camera rays are handled in batches: all of a batch's rays are intersected and shadow tested, then
+// their hits are shaded together by a ShadingBatch, and then all their reflection and refraction rays
+// are traced together, sorted by direction and origin.
+void RenderRegion(Image &target, int targetX, int targetY, const Camera &camera, int frameWidth, int frameHeight,
+                  int x0, int y0, int x1, int y1, TileDependencies *deps, const Sampler &sampler) {
+
+	glm::mat4 viewMatrix = camera.ViewMatrix();
+	glm::mat4 projMatrix = camera.ProjectionMatrix((float)frameWidth / (float)frameHeight);
+	glm::mat4 inverseViewProj = glm::inverse(viewMatrix) * glm::inverse(projMatrix);
+
+	int pixelSamples = sampler.SampleCount();
+
+	if (integrator == IntegratorPath) {
+		PathTracer pathTracer(activeScene->bvh, light, lightIntensity);
+		for (int x = x0; x < x1; ++x) {
+			for (int y = y0; y < y1; ++y) {
+				glm::vec3 color(0.0f);
+				for (int s = 0; s < pixelSamples; ++s) {
+					glm::vec2 offset = sampler.Get2D(x, y, s, 0);
+					Payload payload;
+					payload.seed = (unsigned int)(y * frameWidth + x) * pixelSamples + s;
+					color += pathTracer.Radiance(CameraRay(inverseViewProj, frameWidth, frameHeight, x + offset.x, y + offset.y), payload);
+				}
+				target(x - targetX, y - targetY) = color / (float)pixelSamples;
+			}
+		}
+		return;
+	}
+
+	std::vector<PrimarySample> batch;
+	std::vector<glm::ivec2> batchPixels;
+	ShadingBatch shading;
+	std::vector<SecondaryRay> secondaries;  // the reflection and refraction ray of each sample of the batch
+	std::vector<char> refracts;
+	std::vector<int> order;
+	IrradianceStaging staging;  // the records of the region, which only it uses
+
+	for(int x = x0; x < x1; ++x)
+		for(int y = y0; y < y1; ++y){//Cover the entire tile pixel by pixel, but without showing.
+
+			for(int s = 0; s < pixelSamples; ++s){
+				glm::vec2 offset = sampler.Get2D(x, y, s, 0);
+				batch.push_back(PrimarySample(CameraRay(inverseViewProj, frameWidth, frameHeight, x+offset.x, y+offset.y)));
+				PrimarySample &sample = batch.back();
+				sample.payload.deps = deps;
+				sample.payload.irradiance = &staging;
+				sample.payload.seed = (unsigned int)(y * frameWidth + x) * pixelSamples + s;
+
+				// first pass: what the ray hits and whether that is in shadow
+				sample.hit = TraceRay(sample.ray, sample.info, sample.payload);
+				if (sample.hit) {
+					sample.shadingIndex = shading.Add(sample.info.hitPoint, sample.info.normal, sample.ray.origin, sample.info.material,
+					                                  LightVisibility(sample.info, sample.payload));
+				}
+			}
+			batchPixels.push_back(glm::ivec2(x, y));
+
+			if ((int)batch.size() < primaryBatchSize && !(x == x1 - 1 && y == y1 - 1)) {
+				continue;
+			}
+
+			// second pass: the local colors of all the hits at once
+			shading.Shade(lightSource, lightIntensity);
+
+			// third pass: the reflection and refraction rays of all the hits are set up, traced in the order
+			// SortSecondaryRays puts them in (their own reflections and refractions recursively, as before),
+			// and mixed into the colors of their samples, which are then averaged into their pixels
+			secondaries.assign(2 * batch.size(), SecondaryRay());
+			refracts.assign(batch.size(), 0);
+			for (size_t i = 0; i < batch.size(); i++) {
+				PrimarySample &sample = batch[i];
+				if (sample.hit) {
+					SpawnReflection(sample.ray, sample.info, sample.payload, secondaries[2 * i]);
+					refracts[i] = SpawnRefraction(sample.ray, sample.info, sample.payload, secondaries[2 * i + 1]);
+				}
+			}
+			SortSecondaryRays(secondaries, order);
+			for (size_t i = 0; i < order.size(); i++) {
+				SecondaryRay &secondary = secondaries[order[i]];
+				CastRay(secondary.ray, secondary.payload);
+			}
+
+			for (size_t i = 0; i < batchPixels.size(); i++) {
+				glm::vec3 color(0.0f);
+				for (int s = 0; s < pixelSamples; s++) {
+					int index = i * pixelSamples + s;
+					PrimarySample &sample = batch[index];
+					if (sample.hit) {
+						glm::vec3 reflectMix = MixReflection(sample.info, secondaries[2 * index], shading.Color(sample.shadingIndex) + Caustics(sample.info)
+						                                      + IndirectDiffuse(sample.ray, sample.info, sample.payload));
+						sample.payload.color = refracts[index] ? MixRefraction(sample.info, secondaries[2 * index + 1], reflectMix) : reflectMix;
+					}
+					if (sample.hit && sample.info.time > 0.0f) {
+						color += sample.payload.color;
+					}
+					else {
+						color += glm::vec3(1,0,0);
+					}
+				}
+				target(batchPixels[i].x - targetX, batchPixels[i].y - targetY) = color / (float)pixelSamples;
+			}
+
+			batch.clear();
+			batchPixels.clear();
+			shading.Clear();
+		}
+}
+
+// Runs the coarse passes that fill the irradiance cache for a frame of width x height seen by camera:
+// each pass traces its pixels as the frame will, and the records their hits find missing are merged
+// into the cache after the pass, so the next, finer pass finds them
+void FillIrradianceCache(const Camera &camera, int width, int height) {
+
+	if (indirectRays <= 0 || integrator != IntegratorWhitted) {
+		return;
+	}
+
+	glm::mat4 inverseViewProj = glm::inverse(camera.ViewMatrix()) * glm::inverse(camera.ProjectionMatrix((float)width / (float)height));
+	const int tileSize = 64;
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesY = (height + tileSize - 1) / tileSize;
+	std::vector<IrradianceStaging> staged(tilesX * tilesY);
+
+	for (int stride = irradiancePrepassStride; stride > 1; stride /= 2) {
+		ParallelFor(tilesX * tilesY, [&](int tile) {
+			int x0 = (tile % tilesX) * tileSize, y0 = (tile / tilesX) * tileSize;
+			for (int y = y0 + stride / 2; y < std::min(y0 + tileSize, height); y += stride) {
+				for (int x = x0 + stride / 2; x < std::min(x0 + tileSize, width); x += stride) {
+					Ray ray = CameraRay(inverseViewProj, width, height, x + 0.5f, y + 0.5f);
+					Payload payload;
+					payload.seed = (unsigned int)(y * width + x);
+					payload.irradiance = &staged[tile];
+					CastRay(ray, payload);
+				}
+			}
+		});
+		for (size_t tile = 0; tile < staged.size(); tile++) {
+			activeScene->irradianceCache.Merge(staged[tile]);
+		}
+	}
+}
+
+void RenderTile(Image &image, const Camera &camera, int x0, int y0, int x1, int y1, TileDependencies *deps, const Sampler &sampler) {
+	RenderRegion(image, 0, 0, camera, image.width, image.height, x0, y0, x1, y1, deps, sampler);
+}
+
+// Where the samples of the local renders go, set from the command line
+Sampler pixelSampler;
+
+void RenderImage(Image &image) {
+
+	activeScene->bvh.Update();
+	UpdateCaustics();
+	UpdateIndirect();
+	FillIrradianceCache(camera, image.width, image.height);
+
+	const int tileSize = 16;
+	int tilesX = (image.width + tileSize - 1) / tileSize;
+	int tilesY = (image.height + tileSize - 1) / tileSize;
+
+	ParallelFor(tilesX * tilesY, [&](int tile) {
+		int x0 = (tile % tilesX) * tileSize;
+		int y0 = (tile / tilesX) * tileSize;
+		RenderTile(image, camera, x0, y0, std::min(x0 + tileSize, image.width), std::min(y0 + tileSize, image.height), NULL, pixelSampler);
+	});
+}
+
+// How the linear renders are turned into displayable images, set from the command line
+PostProcessSettings postProcess;
+
+// The window keeps the last frame and what each of its tiles depended on, so that after an
+// edit (see Keyboard) only the tiles the edit can have changed are traced again.
+Image framebuffer;
+FrameCache frameCache;
+
 void Render()  {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);// Clear OpenGL Window
 
-	//	Three parameters of lookat(vec3 eye, vec3 center, vec3 up).
-	glm::mat4 viewMatrix = glm::lookAt(glm::vec3(-10.0f,10.0f,10.0f), glm::vec3(0.0f,0.0f,0.0f), glm::vec3(0.0f,1.0f,0.0f));
-	glm::mat4 projMatrix = glm::perspective(45.0f, (float)windowX / (float)windowY, 1.0f, 10000.0f);
+	glm::mat4 viewProj = camera.ViewProjection((float)windowX / (float)windowY);
+	if (!frameCache.Matches(windowX, windowY, viewProj)) {
+		frameCache.Reset(windowX, windowY, viewProj);
+		framebuffer = Image(windowX, windowY);
+	}
+
+	activeScene->bvh.Update();
+	// the caustics and the indirect light of a moved object can land anywhere, on tiles that never saw the object,
+	// and the paths, which don't record what they depend on, go anywhere
+	bool causticsChanged = UpdateCaustics();
+	bool pathsChanged = integrator == IntegratorPath && pathSnapshot.Update(objects);
+	if (UpdateIndirect() || causticsChanged || pathsChanged) {
+		frameCache.Reset(windowX, windowY, viewProj);
+	}
+	FillIrradianceCache(camera, windowX, windowY);
+	std::vector<int> tiles = frameCache.InvalidTiles(objects);
+	ParallelFor(tiles.size(), [&](int i) {
+		int x0, y0, x1, y1;
+		frameCache.TileRect(tiles[i], x0, y0, x1, y1);
+		frameCache.tiles[tiles[i]].Clear();
+		RenderTile(framebuffer, camera, x0, y0, x1, y1, &frameCache.tiles[tiles[i]], pixelSampler);
+	});
+	frameCache.Snapshot(objects);
+
+	std::cout << "Traced " << tiles.size() << " of " << frameCache.tiles.size() << " tiles" << std::endl;
+	// the framebuffer stays linear for the next incremental frame, what is shown is a processed copy
+	Image image = framebuffer;
+	PostProcess(image, postProcess);
 
 	glBegin(GL_POINTS);	//Using GL_POINTS mode. In this mode, every vertex specified is a point.
 	//	Reference https://en.wikibooks.org/wiki/OpenGL_Programming/GLStart/Tut3 if interested.
 
 	for(int x = 0; x < windowX; ++x)
-		for(int y = 0; y < windowY; ++y){//Cover the entire display zone pixel by pixel, but without showing.
-			float pixelX =  2*((x+0.5f)/windowX)-1;	//Actually, (pixelX, pixelY) are the relative position of the point(x, y).
-			float pixelY = -2*((y+0.5f)/windowY)+1;	//The displayzone will be decribed as a 2.0f x 2.0f platform and coordinate origin is the center of the display zone.
-
-			//	Decide the direction of each of the ray.
-			glm::vec4 worldNear = glm::inverse(viewMatrix) * glm::inverse(projMatrix) * glm::vec4(pixelX, pixelY, -1, 1);
-			glm::vec4 worldFar  = glm::inverse(viewMatrix) * glm::inverse(projMatrix) * glm::vec4(pixelX, pixelY,  1, 1);
-			glm::vec3 worldNearPos = glm::vec3(worldNear.x, worldNear.y, worldNear.z) / worldNear.w;
-			glm::vec3 worldFarPos  = glm::vec3(worldFar.x, worldFar.y, worldFar.z) / worldFar.w;
-
-			Payload payload;
-			Ray ray(worldNearPos, glm::normalize(glm::vec3(worldFarPos - worldNearPos))); //Ray(const glm::vec3 &origin, const glm::vec3 &direction)
-
-			if(CastRay(ray,payload) > 0.0f){
-				glColor3f(payload.color.x,payload.color.y,payload.color.z);
-			}
-			else {
-				glColor3f(1,0,0);
-			}
+		for(int y = 0; y < windowY; ++y){
+			float pixelX =  2*((x+0.5f)/windowX)-1;
+			float pixelY = -2*((y+0.5f)/windowY)+1;
 
+			glColor3f(image(x, y).x, image(x, y).y, image(x, y).z);
 			glVertex3f(pixelX,pixelY,0.0f);
 		}
 
@@ -272,129 +821,553 @@ void Render()  {
 	glFlush();
 }
 
+// The object moved by the arrow keys, picked with 'n'
+int selectedObject = -1;
 
+// 'n' selects the next object that can be moved (anything but the planes)
+void Keyboard(unsigned char key, int /*x*/, int /*y*/) {
 
-int main(int argc, char **argv) {
+    if (key != 'n') {
+        return;
+    }
 
-  	//initialise OpenGL
-	glutInit(&argc, argv);
-	//Define the window size with the size specifed at the top of this file
-	glutInitWindowSize(windowX, windowY);
+    for (size_t i = 1; i <= objects.size(); i++) {
+        int candidate = (selectedObject + i) % objects.size();
+        if (objects[candidate]->Bounds().IsFinite()) {
+            selectedObject = candidate;
+            std::cout << "Selected object " << selectedObject << std::endl;
+            return;
+        }
+    }
+}
 
-	//Create the window for drawing
-	glutCreateWindow("RayTracer");
-	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
+// The arrow keys move the selected object along x and z, page up and down move it along y
+void SpecialKeys(int key, int /*x*/, int /*y*/) {
 
-	//Set the function demoDisplay (defined above) as the function that
-	//is called when the window must display.
-	glutDisplayFunc(Render);
+    if (selectedObject < 0) {
+        return;
+    }
+
+    const float step = 0.25f;
+    glm::vec3 offset(0.0f);
+    switch (key) {
+        case GLUT_KEY_LEFT:      offset.x = -step; break;
+        case GLUT_KEY_RIGHT:     offset.x =  step; break;
+        case GLUT_KEY_UP:        offset.z = -step; break;
+        case GLUT_KEY_DOWN:      offset.z =  step; break;
+        case GLUT_KEY_PAGE_UP:   offset.y =  step; break;
+        case GLUT_KEY_PAGE_DOWN: offset.y = -step; break;
+        default: return;
+    }
+
+    objects[selectedObject]->Translate(offset);
+    glutPostRedisplay();
+}
+
+// Renders the scene without opening a window. The image is written to outputPath if
+// one is given, and compared against referencePath if one is given, writing the
+// per-pixel error to diffPath when the comparison fails.
+// Returns the process exit code: zero unless the comparison failed.
+int RenderHeadless(const std::string &outputPath, const std::string &referencePath,
+                   const std::string &diffPath, const CompareTolerance &tolerance) {
+
+    Image image(windowX, windowY);
+    RenderImage(image);
+    PostProcess(image, postProcess);
+
+    if (!outputPath.empty() && !WritePPM(outputPath, image)) {
+        std::cerr << "Could not write " << outputPath << std::endl;
+        return 1;
+    }
+
+    if (referencePath.empty()) {
+        return 0;
+    }
+
+    Image reference;
+    if (!ReadPPM(referencePath, reference)) {
+        std::cerr << "Could not read reference image " << referencePath << std::endl;
+        return 1;
+    }
+
+    if (reference.width != image.width || reference.height != image.height) {
+        std::cerr << "The reference image " << referencePath << " is " << reference.width << "x" << reference.height
+                  << ", the render " << image.width << "x" << image.height << std::endl;
+    }
+
+    Image diff;
+    CompareResult result = CompareImages(reference, image, tolerance, &diff);
+
+    std::cout << (result.passed ? "PASSED" : "FAILED") << " " << referencePath
+              << ": max error " << result.maxError
+              << ", rmse " << result.rmse
+              << ", ssim " << result.ssim
+              << ", " << result.badPixels << " pixels over tolerance" << std::endl;
+
+    if (!result.passed && !diffPath.empty()) {
+        WritePPM(diffPath, diff);
+    }
+
+    return result.passed ? 0 : 1;
+}
+
+// Renders the scene straight into a tiled half float EXR file. Every tile is written as soon
+// as it is traced, so the frame is never held in memory as a whole.
+// Returns the process exit code: zero unless the file could not be written.
+int RenderEXR(const std::string &path, EXRCompression compression) {
+
+    const int tileSize = 64;
+
+    EXRWriter writer;
+    if (!writer.Open(path, windowX, windowY, tileSize, compression)) {
+        std::cerr << "Could not write " << path << std::endl;
+        return 1;
+    }
+    FillIrradianceCache(camera, windowX, windowY);
+
+    ParallelFor(writer.TilesX() * writer.TilesY(), [&](int tile) {
+        int x0 = (tile % writer.TilesX()) * tileSize, y0 = (tile / writer.TilesX()) * tileSize;
+        int x1 = std::min(x0 + tileSize, windowX), y1 = std::min(y0 + tileSize, windowY);
+
+        Image pixels(x1 - x0, y1 - y0);
+        RenderRegion(pixels, x0, y0, camera, windowX, windowY, x0, y0, x1, y1, NULL, pixelSampler);
+        writer.WriteTile(tile % writer.TilesX(), tile / writer.TilesX(), pixels);
+    });
+
+    if (!writer.Close()) {
+        std::cerr << "Could not write " << path << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Renders frames frames of the animation into sink. Each frame is written by a FrameWriter
+// while the next one is traced, with up to bufferDepth frames waiting for the sink.
+// Progress goes to stderr, as stdout may be the video itself.
+// Returns the process exit code: zero unless a frame could not be written.
+int RenderAnimation(const Animation &animation, int frames, FrameSink &sink, int bufferDepth) {
+
+    FrameWriter writer(sink, bufferDepth);
+    Image image(windowX, windowY);
+
+    for (int frame = 0; frame < frames; frame++) {
+        animation.Apply((float)frame, camera, objects);
+        RenderImage(image);
+        PostProcess(image, postProcess);
+        if (!writer.Write(image)) {
+            return 1;
+        }
+        std::clog << "Rendered frame " << frame + 1 << " of " << frames << std::endl;
+    }
 
-	//	TODO: Add Objects to scene
-	//	This part is related to function CheckIntersection().
-	//	Being added into scene means that the object will take part in the intersection checking, so try to make these two connected to each other.
+    return writer.Finish() ? 0 : 1;
+}
 
 
-    glm::mat4 sphereTransform(0.0f);
+//	This part is related to function CheckIntersection().
+//	Being added into scene means that the object will take part in the intersection checking, so try to make these two connected to each other.
+//	The canonical scenes are "default" with the refractive spheres, "saltire", the Scotland flag made of spheres, "sdf" with distance field shapes
+//	and "instances", a forest of one shared shape.
+bool BuildScene(const std::string &name, Scene &scene) {
+
+    glm::mat4 sphereTransform(1.0f);
     Material blueSphereMaterial(glm::vec3(0.1, 0.1, 0.1), glm::vec3(0.1, 0.6, 1), glm::vec3(0.1, 0.1, 0.1), 25.0, 0.1, 0, 1);
     Material whiteSphereMaterial(glm::vec3(0.3, 0.3, 0.3), glm::vec3(1, 1, 1), glm::vec3(0.6, 0.6, 0.6), 50.0, 0.1, 0, 1);
 
     Material refractedWhiteSphereMaterial(glm::vec3(0.3, 0.3, 0.3), glm::vec3(1, 1, 1), glm::vec3(0.6, 0.6, 0.6), 50.0, 0.1, 1, 0.6);
     Material refractedRedSphereMaterial(glm::vec3(0.3, 0.1, 0.1), glm::vec3(0.6, 0.3, 0.1), glm::vec3(0.3, 0.1, 0.1), 50.0, 0.1, 1, 0.6);
     Material refractedGreenSphereMaterial(glm::vec3(0.1, 0.3, 0.1), glm::vec3(0.1, 0.9, 0.1), glm::vec3(0.1, 0.3, 0.1), 50.0, 0.1, 1, 0.6);
+    Material refractedBlueSphereMaterial(glm::vec3(0.1, 0.1, 0.1), glm::vec3(0.1, 0.6, 1), glm::vec3(0.1, 0.1, 0.1), 50.0, 0.1, 1, 0.6);
 
-		Material refractedBlueSphereMaterial(glm::vec3(0.1, 0.1, 0.1), glm::vec3(0.1, 0.6, 1), glm::vec3(0.1, 0.1, 0.1), 50.0, 0.1, 1, 0.6);
-
-    glm::mat4 planeTransform(0.0f);
+    glm::mat4 planeTransform(1.0f);
     Material planeMaterial(glm::vec3(0.09, 0.09, 0.09), glm::vec3(1, 1, 1), glm::vec3(0, 0, 0), 25.0, 0.8, 0, 1);
     Material floorMaterial(glm::vec3(0.09, 0.09, 0.09), glm::vec3(1, 1, 1), glm::vec3(0, 0, 0), 25.0, 0.1, 0, 1);
 
-    glm::mat4 triangleTransform(0.0f);
+    glm::mat4 triangleTransform(1.0f);
     Material triangleMaterial(glm::vec3(0.1, 0.1, 0.1), glm::vec3(0.6, 0.2, 0.2), glm::vec3(0.1, 0.1, 0.1), 25.0, 0.1, 0, 1);
 
+    if (name == "default") {
+
+        scene.Add<Sphere>(sphereTransform, refractedWhiteSphereMaterial, glm::vec3(-3.8, 0.75, 3.4), 0.75);
+        scene.Add<Sphere>(sphereTransform, refractedRedSphereMaterial, glm::vec3(-4.5, 1, 1.8), 1);
+        scene.Add<Sphere>(sphereTransform, refractedGreenSphereMaterial, glm::vec3(-2, 1.5, 2), 1.5);
+        scene.Add<Sphere>(sphereTransform, refractedBlueSphereMaterial, glm::vec3(-2.3, 0.6, 3.9), 0.6);
+
+    } else if (name == "saltire") {
+
+        // equal spheres in a regular pattern, what a grid is made for
+        scene.acceleration = AccelerationGrid;
+
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-2.5, 0.5, 0.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-2.5, 0.5, 1.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-3.5, 0.5, 1.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-3.5, 0.5, 0.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-3.5, 0.5, 2.5), 0.5);
+
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-0.5, 0.5, 1.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-0.5, 0.5, 2.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-1.5, 0.5, 2.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-0.5, 0.5, 3.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-1.5, 0.5, 3.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-2.5, 0.5, 3.5), 0.5);
+
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-4.5, 0.5, 0.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-4.5, 0.5, 1.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-4.5, 0.5, 2.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-4.5, 0.5, 3.5), 0.5);
+
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-0.5, 0.5, 4.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-1.5, 0.5, 4.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-2.5, 0.5, 4.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, blueSphereMaterial, glm::vec3(-3.5, 0.5, 4.5), 0.5);
+
+        scene.Add<Sphere>(sphereTransform, whiteSphereMaterial, glm::vec3(-0.5, 0.5, 0.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, whiteSphereMaterial, glm::vec3(-1.5, 0.5, 1.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, whiteSphereMaterial, glm::vec3(-2.5, 0.5, 2.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, whiteSphereMaterial, glm::vec3(-3.5, 0.5, 3.5), 0.5);
+        scene.Add<Sphere>(sphereTransform, whiteSphereMaterial, glm::vec3(-4.5, 0.5, 4.5), 0.5);
+
+    } else if (name == "sdf") {
+
+        SDFTorus *torus = scene.New<SDFTorus>(glm::vec3(-1.8, 0.3, 1.8), 1.0f, 0.3f);
+        scene.Add<SDFObject>(sphereTransform, whiteSphereMaterial, torus);
+
+        SDFRoundBox *roundBox = scene.New<SDFRoundBox>(glm::vec3(-4, 0.6, 1.5), glm::vec3(0.6), 0.15f);
+        scene.Add<SDFObject>(sphereTransform, triangleMaterial, roundBox);
+
+        // a box with two spheres blended into it, evaluated directly
+        SDFSmoothUnion *blob = scene.New<SDFSmoothUnion>(0.4f);
+        blob->Add(scene.New<SDFBox>(glm::vec3(-1.8, 0.4, 4.2), glm::vec3(0.5, 0.4, 0.5)));
+        blob->Add(scene.New<SDFSphere>(glm::vec3(-1.8, 1.1, 4.2), 0.4f));
+        blob->Add(scene.New<SDFSphere>(glm::vec3(-1.1, 0.4, 4.2), 0.3f));
+        scene.Add<SDFObject>(sphereTransform, blueSphereMaterial, blob);
+
+        // the same kind of composition baked into a distance grid
+        SDFSmoothUnion *rings = scene.New<SDFSmoothUnion>(0.2f);
+        rings->Add(scene.New<SDFTorus>(glm::vec3(-4.2, 0.2, 4), 0.6f, 0.2f));
+        rings->Add(scene.New<SDFTorus>(glm::vec3(-4.2, 0.6, 4), 0.4f, 0.15f));
+        rings->Add(scene.New<SDFSphere>(glm::vec3(-4.2, 0.9, 4), 0.25f));
+        scene.Add<SDFObject>(sphereTransform, whiteSphereMaterial, scene.New<SDFGrid>(*rings, 64));
+
+    } else if (name == "instances") {
+
+        // one small tree shape, a pyramid with a ball on top, stored once and placed 64 times
+        Material treeMaterial(glm::vec3(0.1, 0.3, 0.1), glm::vec3(0.1, 0.9, 0.1), glm::vec3(0.1, 0.3, 0.1), 25.0, 0.1, 0, 1);
+        BVH *tree = scene.New<BVH>();
+        std::vector<const Object *> treeParts;
+        glm::vec3 top(0, 1.2, 0);
+        glm::vec3 base[4] = { glm::vec3(-0.4, 0, -0.4), glm::vec3(0.4, 0, -0.4), glm::vec3(0.4, 0, 0.4), glm::vec3(-0.4, 0, 0.4) };
+        for (int i = 0; i < 4; i++) {
+            treeParts.push_back(scene.New<Triangle>(triangleTransform, treeMaterial, base[i], base[(i + 1) % 4], top));
+        }
+        treeParts.push_back(scene.New<Sphere>(sphereTransform, whiteSphereMaterial, glm::vec3(0, 1.3, 0), 0.2));
+        tree->Build(treeParts);
+
+        InstanceGroup *forest = scene.Add<InstanceGroup>();
+        for (int x = 0; x < 8; x++) {
+            for (int z = 0; z < 8; z++) {
+                glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(-4.7 + x * 0.6, 0, 0.3 + z * 0.6));
+                transform = glm::rotate(transform, (float)((x * 7 + z * 13) % 9) * 10.0f, glm::vec3(0, 1, 0));
+                transform = glm::scale(transform, glm::vec3(0.4f + 0.05f * ((x + 2 * z) % 4)));
+                forest->Add(scene.New<Instance>(transform, tree));
+            }
+        }
+        forest->Build();
+
+    } else {
+        return false;
+    }
+
+    scene.Add<Triangle>(triangleTransform, blueSphereMaterial, glm::vec3(-1,0,5),glm::vec3(-1,0,7),glm::vec3(-1,2,6));
+
+    scene.Add<Plane>(planeTransform, floorMaterial, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+    scene.Add<Plane>(planeTransform, planeMaterial, glm::vec3(0, 0, 0), glm::vec3(-1, 0, 0));
+    scene.Add<Plane>(planeTransform, planeMaterial, glm::vec3(0, 0, 0), glm::vec3(0, 0, 1));
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+
+    // Scene:
+    //   --scene name             which scene to build ("default", "saltire", "sdf" or "instances")
+    // Headless regression mode:
+    //   --render out.ppm         write the render to a file
+    //   --compare ref.ppm        compare the render against a reference image
+    //   --diff diff.ppm          where to write the error image if the comparison fails
+    //   --pixel-tolerance f      per-channel error above which a pixel counts as bad
+    //   --max-bad-pixels f       fraction of bad pixels that is still accepted
+    //   --min-ssim f             lowest accepted mean SSIM
+    // Shading:
+    //   --shading mode           "exact" (the default) or "fast", which approximates pow, sqrt and normalize for previews
+    //   --light shape            "point" (the default), "sphere" or "rect", an area light with soft shadows
+    //   --light-size f           the radius of the sphere or the side of the rectangle, 1 by default
+    //   --accel structure        what the rays find the objects through, instead of what suits the scene: "sah", "linear",
+    //                            "spatial" (BVHs built in these ways) or "grid" (see readme.txt)
+    //   --caustics n             shoot n photons through the refracting objects and add the caustics they make
+    //   --caustics-radius f      estimate them from all the photons within f, instead of the 64 nearest within 0.25
+    //   --indirect n             add the light the surfaces get from each other, through an irradiance cache
+    //                            whose records are made with n rays each
+    //   --integrator i           "whitted" (the default), or "path" for unbiased path tracing, with --samples paths per pixel
+    // Sampling, of local renders and submitted jobs:
+    //   --samples n              samples per pixel, 1 by default
+    //   --sampler s              where they go: "grid" (the default), "random", "stratified", "sobol" or "bluenoise"
+    // Post-process of everything but the EXR output:
+    //   --exposure f             brighten by f stops (or darken, when negative)
+    //   --tonemap op             "clamp" (the default), "reinhard" or "aces"
+    //   --encoding e             "linear" (the default) or "srgb"
+    //   --bloom f                add f times the blurred highlights
+    //   --bloom-threshold f      how bright a highlight has to be to bloom, 1 by default
+    //   --bloom-radius n         of the blur, in pixels, 8 by default
+    // HDR output:
+    //   --exr out.exr            write the unclamped render as a tiled half float OpenEXR file
+    //   --exr-compression c      "rle" (the default) or "none"
+    // Render server:
+    //   --daemon address         run as raytracerd, serving render jobs on address, a Unix socket path or host:port
+    //                            (started under the name raytracerd, it serves on /tmp/raytracerd.sock)
+    //   --submit address         have the server at address render the scene, use with --render
+    //   --coordinate a,b,...     split the frame over the servers at the addresses, use with --render
+    //   --priority n             priority of the submitted job, higher goes first
+    //   --width n, --height n    resolution of the submitted job
+    // Animation:
+    //   --animate file           render the keyframed animation in file (or "turntable") into --render frame_%04d.ppm
+    //   --frames n               how many frames to render, by default up to the last key (120 for a turntable)
+    //   --video format           write the frames as raw rgb24, rgba or yuv420p video to --render instead ("-" is stdout)
+    //   --buffer n               how many finished frames may wait for the output, 4 by default
+    std::string sceneName = "default";
+    AccelerationStructure acceleration = AccelerationSAH;
+    bool accelerationSet = false;
+    std::string outputPath, referencePath, diffPath;
+    std::string exrPath;
+    EXRCompression exrCompression = EXRRLECompression;
+    CompareTolerance tolerance;
+    std::string daemonPath, submitPath, coordinateAddresses;
+    std::string animationPath, videoFormat;
+    int frames = 0;
+    int bufferDepth = 4;
+    RenderJob job;
+    job.width = windowX;
+    job.height = windowY;
+
+    const char *programName = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+    if (!strcmp(programName, "raytracerd")) {
+        daemonPath = "/tmp/raytracerd.sock";
+    }
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--scene")) {
+            sceneName = argv[i + 1];
+        } else if (!strcmp(argv[i], "--render")) {
+            outputPath = argv[i + 1];
+        } else if (!strcmp(argv[i], "--compare")) {
+            referencePath = argv[i + 1];
+        } else if (!strcmp(argv[i], "--diff")) {
+            diffPath = argv[i + 1];
+        } else if (!strcmp(argv[i], "--pixel-tolerance")) {
+            tolerance.pixelTolerance = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--max-bad-pixels")) {
+            tolerance.maxBadPixelFraction = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--min-ssim")) {
+            tolerance.minSSIM = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--shading")) {
+            if (!ParseShadingMode(argv[i + 1], fastMath)) {
+                std::cerr << "Unknown shading mode " << argv[i + 1] << ", use exact or fast" << std::endl;
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--light")) {
+            if (!ParseLightShape(argv[i + 1], light.shape)) {
+                std::cerr << "Unknown light " << argv[i + 1] << ", use point, sphere or rect" << std::endl;
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--light-size")) {
+            light.size = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--accel")) {
+            if (!ParseAccelerationStructure(argv[i + 1], acceleration)) {
+                std::cerr << "Unknown acceleration structure " << argv[i + 1] << ", use sah, linear, spatial or grid" << std::endl;
+                return 1;
+            }
+            accelerationSet = true;
+        } else if (!strcmp(argv[i], "--caustics")) {
+            causticPhotons = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--caustics-radius")) {
+            causticRadius = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--indirect")) {
+            indirectRays = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--integrator")) {
+            if (!ParseIntegrator(argv[i + 1], integrator)) {
+                std::cerr << "Unknown integrator " << argv[i + 1] << ", use whitted or path" << std::endl;
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--exposure")) {
+            postProcess.exposure = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--tonemap")) {
+            if (!ParseToneMapOperator(argv[i + 1], postProcess.toneMap)) {
+                std::cerr << "Unknown tone mapping " << argv[i + 1] << ", use clamp, reinhard or aces" << std::endl;
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--encoding")) {
+            postProcess.sRGB = !strcmp(argv[i + 1], "srgb");
+        } else if (!strcmp(argv[i], "--bloom")) {
+            postProcess.bloomStrength = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--bloom-threshold")) {
+            postProcess.bloomThreshold = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--bloom-radius")) {
+            postProcess.bloomRadius = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--exr")) {
+            exrPath = argv[i + 1];
+        } else if (!strcmp(argv[i], "--exr-compression")) {
+            exrCompression = strcmp(argv[i + 1], "none") ? EXRRLECompression : EXRNoCompression;
+        } else if (!strcmp(argv[i], "--daemon")) {
+            daemonPath = argv[i + 1];
+        } else if (!strcmp(argv[i], "--submit")) {
+            submitPath = argv[i + 1];
+        } else if (!strcmp(argv[i], "--coordinate")) {
+            coordinateAddresses = argv[i + 1];
+        } else if (!strcmp(argv[i], "--width")) {
+            job.width = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--height")) {
+            job.height = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--animate")) {
+            animationPath = argv[i + 1];
+        } else if (!strcmp(argv[i], "--frames")) {
+            frames = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--video")) {
+            videoFormat = argv[i + 1];
+        } else if (!strcmp(argv[i], "--buffer")) {
+            bufferDepth = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--samples")) {
+            job.samples = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--sampler")) {
+            SamplerType type;
+            if (!ParseSamplerType(argv[i + 1], type)) {
+                std::cerr << "Unknown sampler " << argv[i + 1] << ", use grid, random, stratified, sobol or bluenoise" << std::endl;
+                return 1;
+            }
+            job.sampler = type;
+        } else if (!strcmp(argv[i], "--priority")) {
+            job.priority = atoi(argv[i + 1]);
+        }
+    }
+
+    pixelSampler = Sampler((SamplerType)job.sampler, job.samples);
+    job.light = light.shape;
+    job.lightSize = light.size;
+    job.causticPhotons = causticPhotons;
+    job.causticRadius = causticRadius;
+    job.indirectRays = indirectRays;
+    job.integrator = integrator;
+    job.shading = fastMath ? ShadingFast : ShadingExact;
+
+    if (!daemonPath.empty()) {
+        // the server builds the scenes it is asked for itself
+        RenderServer server(WorkerCount());
+        return server.Run(daemonPath);
+    }
+
+    if (!submitPath.empty()) {
+        Image image;
+        job.scene = sceneName;
+        if (!RenderRemote(submitPath, job, image)) {
+            return 1;
+        }
+        PostProcess(image, postProcess);
+        return outputPath.empty() || WritePPM(outputPath, image) ? 0 : 1;
+    }
+
+    if (!coordinateAddresses.empty()) {
+        std::vector<std::string> addresses;
+        std::stringstream list(coordinateAddresses);
+        for (std::string address; std::getline(list, address, ',');) {
+            addresses.push_back(address);
+        }
 
-    Sphere blueSphere3(sphereTransform, blueSphereMaterial, glm::vec3(-2.5, 0.5, 0.5), 0.5);
-    Sphere blueSphere5(sphereTransform, blueSphereMaterial, glm::vec3(-2.5, 0.5, 1.5), 0.5);
-    Sphere blueSphere7(sphereTransform, blueSphereMaterial, glm::vec3(-3.5, 0.5, 1.5), 0.5);
-    Sphere blueSphere8(sphereTransform, blueSphereMaterial, glm::vec3(-3.5, 0.5, 0.5), 0.5);
-    Sphere blueSphere9(sphereTransform, blueSphereMaterial, glm::vec3(-3.5, 0.5, 2.5), 0.5);
-
-    Sphere blueSphere2(sphereTransform, blueSphereMaterial, glm::vec3(-0.5, 0.5, 1.5), 0.5);
-    Sphere blueSphere4(sphereTransform, blueSphereMaterial, glm::vec3(-0.5, 0.5, 2.5), 0.5);
-    Sphere blueSphere6(sphereTransform, blueSphereMaterial, glm::vec3(-1.5, 0.5, 2.5), 0.5);
-    Sphere blueSphere10(sphereTransform, blueSphereMaterial, glm::vec3(-0.5, 0.5, 3.5), 0.5);
-    Sphere blueSphere11(sphereTransform, blueSphereMaterial, glm::vec3(-1.5, 0.5, 3.5), 0.5);
-    Sphere blueSphere12(sphereTransform, blueSphereMaterial, glm::vec3(-2.5, 0.5, 3.5), 0.5);
-
-    Sphere blueSphere13(sphereTransform, blueSphereMaterial, glm::vec3(-4.5, 0.5, 0.5), 0.5);
-    Sphere blueSphere14(sphereTransform, blueSphereMaterial, glm::vec3(-4.5, 0.5, 1.5), 0.5);
-    Sphere blueSphere15(sphereTransform, blueSphereMaterial, glm::vec3(-4.5, 0.5, 2.5), 0.5);
-    Sphere blueSphere16(sphereTransform, blueSphereMaterial, glm::vec3(-4.5, 0.5, 3.5), 0.5);
-
-    Sphere blueSphere17(sphereTransform, blueSphereMaterial, glm::vec3(-0.5, 0.5, 4.5), 0.5);
-    Sphere blueSphere18(sphereTransform, blueSphereMaterial, glm::vec3(-1.5, 0.5, 4.5), 0.5);
-    Sphere blueSphere19(sphereTransform, blueSphereMaterial, glm::vec3(-2.5, 0.5, 4.5), 0.5);
-    Sphere blueSphere20(sphereTransform, blueSphereMaterial, glm::vec3(-3.5, 0.5, 4.5), 0.5);
-
-
-
-    Sphere whiteSphere(sphereTransform, whiteSphereMaterial, glm::vec3(-0.5, 0.5, 0.5), 0.5);
-    Sphere whiteSphere2(sphereTransform, whiteSphereMaterial, glm::vec3(-1.5, 0.5, 1.5), 0.5);
-    Sphere whiteSphere3(sphereTransform, whiteSphereMaterial, glm::vec3(-2.5, 0.5, 2.5), 0.5);
-    Sphere whiteSphere4(sphereTransform, whiteSphereMaterial, glm::vec3(-3.5, 0.5, 3.5), 0.5);
-    Sphere whiteSphere5(sphereTransform, whiteSphereMaterial, glm::vec3(-4.5, 0.5, 4.5), 0.5);
-
-    Plane plane1(planeTransform, floorMaterial, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
-    Plane plane2(planeTransform, planeMaterial, glm::vec3(0, 0, 0), glm::vec3(-1, 0, 0));
-    Plane plane3(planeTransform, planeMaterial, glm::vec3(0, 0, 0), glm::vec3(0, 0, 1));
-
-    Triangle triangle(triangleTransform, blueSphereMaterial, glm::vec3(-1,0,5),glm::vec3(-1,0,7),glm::vec3(-1,2,6));
-
-    Sphere refractedWhiteSphere(sphereTransform, refractedWhiteSphereMaterial, glm::vec3(-3.8, 0.75, 3.4), 0.75);
-    Sphere refractedRedSphere(sphereTransform, refractedRedSphereMaterial, glm::vec3(-4.5, 1, 1.8), 1);
-    Sphere refractedGreenSphere(sphereTransform, refractedGreenSphereMaterial, glm::vec3(-2, 1.5, 2), 1.5);
-
-		Sphere blueSphere(sphereTransform, refractedBlueSphereMaterial, glm::vec3(-2.3, 0.6, 3.9), 0.6);
-
-    objects.push_back(&refractedWhiteSphere);
-    objects.push_back(&refractedRedSphere);
-    objects.push_back(&refractedGreenSphere);
-    objects.push_back(&blueSphere);
-    // objects.push_back(&blueSphere5);
-    // objects.push_back(&blueSphere6);
-		//
-    // objects.push_back(&blueSphere7);
-    // objects.push_back(&blueSphere8);
-    // objects.push_back(&blueSphere9);
-    // objects.push_back(&blueSphere10);
-    // objects.push_back(&blueSphere11);
-    // objects.push_back(&blueSphere12);
-		//
-    // objects.push_back(&blueSphere13);
-    // objects.push_back(&blueSphere14);
-    // objects.push_back(&blueSphere15);
-    // objects.push_back(&blueSphere16);
-		//
-    // objects.push_back(&blueSphere17);
-    // objects.push_back(&blueSphere18);
-    // objects.push_back(&blueSphere19);
-    // objects.push_back(&blueSphere20);
-
-    // objects.push_back(&whiteSphere);
-    // objects.push_back(&whiteSphere2);
-    // objects.push_back(&whiteSphere3);
-    // objects.push_back(&whiteSphere4);
-    // objects.push_back(&whiteSphere5);
-
-//    objects.push_back(&refractedWhiteSphere);
-//    objects.push_back(&refractedRedSphere);
-//    objects.push_back(&refractedGreenSphere);
-//
-   objects.push_back(&triangle);
-
-    objects.push_back(&plane1);
-    objects.push_back(&plane2);
-    objects.push_back(&plane3);
+        Image image;
+        job.scene = sceneName;
+        Coordinator coordinator(addresses);
+        if (!coordinator.Render(job, image)) {
+            return 1;
+        }
+        PostProcess(image, postProcess);
+        return outputPath.empty() || WritePPM(outputPath, image) ? 0 : 1;
+    }
 
     atexit(cleanup);
+
+    if (!BuildScene(sceneName, mainScene)) {
+        std::cerr << "Unknown scene " << sceneName << std::endl;
+        return 1;
+    }
+    if (accelerationSet) {
+        mainScene.acceleration = acceleration;
+    }
+    mainScene.BuildAcceleration();
+    ActivateScene(&mainScene);
+    const SceneBVH &sceneBVH = mainScene.bvh;
+
+    // a structure picked on the command line tells how it came out
+    if (accelerationSet && sceneBVH.structure == AccelerationGrid) {
+        glm::ivec3 resolution = sceneBVH.Grid().Resolution();
+        std::clog << "Scene grid: " << resolution.x << " x " << resolution.y << " x " << resolution.z << " cells, "
+                  << sceneBVH.Grid().References() << " references" << std::endl;
+    } else if (accelerationSet && sceneBVH.structure != AccelerationSAH) {
+        std::clog << "Scene BVH: SAH cost " << sceneBVH.Tree().SAHCost() << ", " << sceneBVH.BinnedCost()
+                  << " with the binned build, " << sceneBVH.Tree().Primitives().size() << " references" << std::endl;
+    }
+
+    if (UpdateCaustics()) {
+        std::clog << "Caustics: " << mainScene.causticMap.Size() << " of " << causticPhotons << " photons landed" << std::endl;
+    }
+    UpdateIndirect();
+
+    if (!animationPath.empty()) {
+        Animation animation;
+        if (animationPath == "turntable") {
+            frames = frames > 0 ? frames : 120;
+            animation.Turntable(camera, frames);
+        } else if (!animation.Load(animationPath, objects)) {
+            return 1;
+        }
+        frames = frames > 0 ? frames : animation.FrameCount();
+
+        if (videoFormat.empty()) {
+            PPMSequenceSink sink(outputPath.empty() ? "frame_%04d.ppm" : outputPath);
+            return RenderAnimation(animation, frames, sink, bufferDepth);
+        }
+
+        PixelFormat format;
+        if (!ParsePixelFormat(videoFormat, format)) {
+            std::cerr << "Unknown video format " << videoFormat << ", use rgb24, rgba or yuv420p" << std::endl;
+            return 1;
+        }
+        RawVideoSink sink(format);
+        if (!sink.Open(outputPath.empty() ? "-" : outputPath)) {
+            return 1;
+        }
+        return RenderAnimation(animation, frames, sink, bufferDepth);
+    }
+
+    if (!exrPath.empty()) {
+        return RenderEXR(exrPath, exrCompression);
+    }
+
+    if (!outputPath.empty() || !referencePath.empty()) {
+        return RenderHeadless(outputPath, referencePath, diffPath, tolerance);
+    }
+
+  	//initialise OpenGL
+	glutInit(&argc, argv);
+	//Define the window size with the size specifed at the top of this file
+	glutInitWindowSize(windowX, windowY);
+
+	//Create the window for drawing
+	glutCreateWindow("RayTracer");
+	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
+
+	//Set the function demoDisplay (defined above) as the function that
+	//is called when the window must display.
+	glutDisplayFunc(Render);
+	glutKeyboardFunc(Keyboard);
+	glutSpecialFunc(SpecialKeys);
+
     glutMainLoop();
 }
@@ -8,6 +8,10 @@
 #include <iostream>
 #include <fstream> //Provides facilities for file-based input and output.
 #include <cstring>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iomanip>
 #include <algorithm>
 
 
@@ -17,10 +21,52 @@
 #include "glm/gtc/matrix_transform.hpp"
 
 #include "Ray.h"
+#include "FastMath.h"
 #include "Object.h"
+#include "SDF.h"
+#include "Instance.h"
+#include "Image.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "FrameCache.h"
+#include "Parallel.h"
+#include "RenderServer.h"
+#include "Coordinator.h"
+#include "Animation.h"
+#include "FrameWriter.h"
+#include "VideoSink.h"
+#include "EXR.h"
+#include "PostProcess.h"
+#include "Shading.h"
+#include "Sampler.h"
+#include "Light.h"
+#include "Morton.h"
+#include "SceneBVH.h"
+#include "PhotonMap.h"
+#include "IrradianceCache.h"
+#include "PathTracer.h"
 
 bool CheckIntersection(const Ray &ray, IntersectInfo &info);
 float CastRay(Ray &ray, Payload &payload);
+void RenderRegion(Image &target, int targetX, int targetY, const Camera &camera, int frameWidth, int frameHeight,
+                  int x0, int y0, int x1, int y1, TileDependencies *deps, const Sampler &sampler);
+void RenderTile(Image &image, const Camera &camera, int x0, int y0, int x1, int y1, TileDependencies *deps, const Sampler &sampler);
+void RenderImage(Image &image);
+bool BuildScene(const std::string &name, Scene &scene);
+void ActivateScene(Scene *scene);
+bool UpdateCaustics();
+bool UpdateIndirect();
+void ClearIrradianceCache();
+void FillIrradianceCache(const Camera &camera, int width, int height);
+
+extern std::vector<Object*> objects;
+extern Scene *activeScene;
+extern const glm::vec3 lightSource;
+extern Light light;
+extern int causticPhotons;
+extern float causticRadius;
+extern int indirectRays;
+extern Integrator integrator;
 
 #endif
 
@@ -0,0 +1,459 @@
+#include "RenderServer.h"
+#include "RayTracer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// the jobs are split into tiles of this size, which is also the unit of streaming and cancellation
+static const int serverTileSize = 32;
+// the most caustic photons and irradiance record rays a job may ask for, as they are shot while no tile is rendered
+static const int maxJobPhotons = 1 << 24;
+static const int maxJobIndirectRays = 4096;
+
+class RenderServer::Connection {
+  public:
+    Connection(int fd):
+      fd(fd),
+      alive(true)
+    {}
+
+    ~Connection() { close(fd); }
+
+    /* Several workers stream tiles to one client, so the writes are serialised */
+    bool Send(int type, const std::vector<char> &payload) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (alive && !SendMessage(fd, type, payload)) {
+            alive = false;
+        }
+        return alive;
+    }
+
+    int fd;
+    std::atomic<bool> alive;  // cleared by a failed write, or by Serve when the client goes, outside writeMutex
+    std::mutex writeMutex;
+};
+
+class RenderServer::Job {
+  public:
+    Job():
+      scene(NULL),
+      sequence(0),
+      tilesX(0),
+      tileCount(0),
+      nextTile(0),
+      inFlight(0),
+      cancelled(false)
+    {}
+
+    RenderJob request;
+    std::shared_ptr<Connection> connection;
+    Scene *scene;
+    unsigned long sequence;
+
+    int tilesX;
+    int tileCount;
+    int nextTile;
+    int inFlight;
+    bool cancelled;
+
+    bool HasTilesLeft() const { return !cancelled && nextTile < tileCount; }
+    bool IsDone() const { return inFlight == 0 && !HasTilesLeft(); }
+
+    /* Whether this job should be rendered before other */
+    bool Before(const Job &other) const {
+        return request.priority != other.request.priority ? request.priority > other.request.priority : sequence < other.sequence;
+    }
+};
+
+// Whether the tracer renders a and b with the same settings, so that their tiles can be rendered side by side.
+// The irradiance cache is filled for one frame, so with indirect light that has to be the same frame too.
+static bool SameSettings(const RenderJob &a, const RenderJob &b) {
+
+    if (a.light != b.light || a.lightSize != b.lightSize || a.causticPhotons != b.causticPhotons || a.causticRadius != b.causticRadius ||
+        a.indirectRays != b.indirectRays || a.integrator != b.integrator || a.shading != b.shading) {
+        return false;
+    }
+    return a.indirectRays == 0 ||
+           (a.camera.eye == b.camera.eye && a.camera.center == b.camera.center && a.camera.up == b.camera.up &&
+            a.camera.fieldOfView == b.camera.fieldOfView && a.width == b.width && a.height == b.height);
+}
+
+static std::vector<char> JobDonePayload(int id, bool finished) {
+    MessageWriter writer;
+    writer.PutInt(id);
+    writer.PutInt(finished ? 1 : 0);
+    return writer.data;
+}
+
+static std::vector<char> ErrorPayload(int id, const std::string &message) {
+    MessageWriter writer;
+    writer.PutInt(id);
+    writer.PutString(message);
+    return writer.data;
+}
+
+RenderServer::RenderServer(int workerCount):
+    workerCount(workerCount),
+    nextSequence(0),
+    tilesInFlight(0),
+    preparing(false)
+  {}
+
+RenderServer::~RenderServer() {
+    for (std::map<std::string, Scene *>::iterator i = scenes.begin(); i != scenes.end(); ++i) {
+        delete i->second;
+    }
+}
+
+int RenderServer::Run(const std::string &address) {
+
+    // a client hanging up mid tile must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = ListenOn(address);
+    if (listener < 0) {
+        std::cerr << "Could not listen on " << address << std::endl;
+        return 1;
+    }
+
+    for (int i = 0; i < workerCount; i++) {
+        std::thread(&RenderServer::Work, this).detach();
+    }
+
+    std::cout << "raytracerd listening on " << address << " with " << workerCount << " workers" << std::endl;
+
+    while (true) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        std::thread(&RenderServer::Serve, this, std::make_shared<Connection>(fd)).detach();
+    }
+}
+
+void RenderServer::Serve(std::shared_ptr<Connection> connection) {
+
+    int type;
+    std::vector<char> payload;
+
+    while (ReceiveMessage(connection->fd, type, payload)) {
+        MessageReader reader(payload);
+
+        if (type == MessageRenderJob) {
+            RenderJob request;
+            request.Read(reader);
+            if (reader.ok) {
+                Submit(connection, request);
+            }
+        } else if (type == MessageCancel) {
+            int id = reader.GetInt();
+            if (reader.ok) {
+                Cancel(connection, id);
+            }
+        }
+    }
+
+    // the client went away, nobody is waiting for its jobs any more
+    std::lock_guard<std::mutex> lock(mutex);
+    connection->alive = false;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (jobs[i]->connection == connection) {
+            jobs[i]->cancelled = true;
+        }
+    }
+    changed.notify_all();
+}
+
+Scene *RenderServer::FindScene(const std::string &name) {
+
+    std::lock_guard<std::mutex> lock(sceneMutex);
+
+    std::map<std::string, Scene *>::iterator found = scenes.find(name);
+    if (found != scenes.end()) {
+        return found->second;
+    }
+
+    // built once, with its hierarchy, then kept for every later job that asks for it
+    Scene *scene = new Scene();
+    if (!BuildScene(name, *scene)) {
+        delete scene;
+        return NULL;
+    }
+    scene->BuildAcceleration();
+    scenes[name] = scene;
+
+    return scene;
+}
+
+void RenderServer::Submit(const std::shared_ptr<Connection> &connection, const RenderJob &request) {
+
+    if (request.width <= 0 || request.height <= 0 || request.width > 16384 || request.height > 16384 || request.samples < 1) {
+        connection->Send(MessageError, ErrorPayload(request.id, "invalid resolution or sample count"));
+        return;
+    }
+
+    int x1 = request.RegionX1(), y1 = request.RegionY1();
+    if (request.x0 < 0 || request.y0 < 0 || x1 > request.width || y1 > request.height || request.x0 >= x1 || request.y0 >= y1) {
+        connection->Send(MessageError, ErrorPayload(request.id, "invalid region"));
+        return;
+    }
+
+    if (request.sampler < SamplerGrid || request.sampler > SamplerBlueNoise) {
+        connection->Send(MessageError, ErrorPayload(request.id, "unknown sampler"));
+        return;
+    }
+
+    if (request.light < LightPoint || request.light > LightRectangle || !(request.lightSize >= 0.0f && request.lightSize < 1e6f)) {
+        connection->Send(MessageError, ErrorPayload(request.id, "invalid light"));
+        return;
+    }
+
+    if (request.causticPhotons < 0 || request.causticPhotons > maxJobPhotons) {
+        connection->Send(MessageError, ErrorPayload(request.id, "invalid caustic photon count"));
+        return;
+    }
+
+    if (!(request.causticRadius >= 0.0f && request.causticRadius < 1e6f)) {
+        connection->Send(MessageError, ErrorPayload(request.id, "invalid caustic radius"));
+        return;
+    }
+
+    const Camera &camera = request.camera;
+    glm::vec4 view(camera.eye.x + camera.eye.y + camera.eye.z, camera.center.x + camera.center.y + camera.center.z,
+                   camera.up.x + camera.up.y + camera.up.z, camera.fieldOfView);
+    if (!std::isfinite(view.x) || !std::isfinite(view.y) || !std::isfinite(view.z) || !std::isfinite(view.w)) {
+        connection->Send(MessageError, ErrorPayload(request.id, "invalid camera"));
+        return;
+    }
+
+    if (request.indirectRays < 0 || request.indirectRays > maxJobIndirectRays) {
+        connection->Send(MessageError, ErrorPayload(request.id, "invalid indirect ray count"));
+        return;
+    }
+
+    if (request.integrator < IntegratorWhitted || request.integrator > IntegratorPath) {
+        connection->Send(MessageError, ErrorPayload(request.id, "unknown integrator"));
+        return;
+    }
+
+    if (request.shading != ShadingExact && request.shading != ShadingFast) {
+        connection->Send(MessageError, ErrorPayload(request.id, "unknown shading mode"));
+        return;
+    }
+
+    Scene *scene = FindScene(request.scene);
+    if (!scene) {
+        connection->Send(MessageError, ErrorPayload(request.id, "unknown scene " + request.scene));
+        return;
+    }
+
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->request = request;
+    job->connection = connection;
+    job->scene = scene;
+    job->tilesX = (x1 - request.x0 + serverTileSize - 1) / serverTileSize;
+    job->tileCount = job->tilesX * ((y1 - request.y0 + serverTileSize - 1) / serverTileSize);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    job->sequence = nextSequence++;
+    jobs.push_back(job);
+    changed.notify_all();
+}
+
+void RenderServer::Cancel(const std::shared_ptr<Connection> &connection, int id) {
+
+    std::shared_ptr<Job> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (jobs[i]->connection == connection && jobs[i]->request.id == id) {
+                jobs[i]->cancelled = true;
+                if (jobs[i]->IsDone()) {
+                    done = jobs[i];
+                    jobs.erase(jobs.begin() + i);
+                }
+                break;
+            }
+        }
+        changed.notify_all();
+    }
+
+    // with tiles still in flight, the last of them reports the cancellation instead
+    if (done) {
+        connection->Send(MessageJobDone, JobDonePayload(id, false));
+    }
+}
+
+// Points the tracer at the scene of job, sets its globals to the settings of job and runs the irradiance
+// prepass for its frame, emptying the cache first so that the job renders the same whatever ran before it.
+// Must not run while tiles are in flight.
+void RenderServer::Activate(const Job &job) {
+
+    const RenderJob &request = job.request;
+    ActivateScene(job.scene);
+    light = Light(lightSource, (LightShape)request.light, request.lightSize);
+    causticPhotons = request.causticPhotons;
+    causticRadius = request.causticRadius;
+    indirectRays = request.indirectRays;
+    integrator = (Integrator)request.integrator;
+    fastMath = request.shading == ShadingFast;
+    UpdateCaustics();
+    if (indirectRays > 0) {
+        ClearIrradianceCache();
+        FillIrradianceCache(request.camera, request.width, request.height);
+    }
+}
+
+std::shared_ptr<RenderServer::Job> RenderServer::TakeTile(int &tile) {
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        std::shared_ptr<Job> best;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (jobs[i]->HasTilesLeft() && (!best || jobs[i]->Before(*best))) {
+                best = jobs[i];
+            }
+        }
+
+        if (preparing) {
+            changed.wait(lock);
+            continue;
+        }
+
+        // the tracer reads the global objects, activeScene and settings, so switching to another scene or
+        // other settings has to wait until every tile of the current ones is finished; the hierarchy and
+        // photons stay with their scene, so switching back only shoots what the settings changed
+        bool same = best && best->scene == activeScene && SameSettings(best->request, activeRequest);
+        if (best && (same || tilesInFlight == 0)) {
+            if (!same) {
+                // the photons and the irradiance prepass take a while, so the queue is released meanwhile,
+                // and looked at again after, as the job may have been cancelled
+                preparing = true;
+                lock.unlock();
+                Activate(*best);
+                lock.lock();
+                activeRequest = best->request;
+                preparing = false;
+                changed.notify_all();
+                continue;
+            }
+
+            tile = best->nextTile++;
+            best->inFlight++;
+            tilesInFlight++;
+            return best;
+        }
+
+        changed.wait(lock);
+    }
+}
+
+void RenderServer::FinishTile(const std::shared_ptr<Job> &job) {
+
+    bool done = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job->inFlight--;
+        tilesInFlight--;
+
+        if (job->IsDone()) {
+            done = true;
+            jobs.erase(std::find(jobs.begin(), jobs.end(), job));
+        }
+        changed.notify_all();
+    }
+
+    if (done) {
+        job->connection->Send(MessageJobDone, JobDonePayload(job->request.id, !job->cancelled));
+    }
+}
+
+void RenderServer::Work() {
+
+    while (true) {
+        int tile;
+        std::shared_ptr<Job> job = TakeTile(tile);
+        const RenderJob &request = job->request;
+
+        int x0 = request.x0 + (tile % job->tilesX) * serverTileSize;
+        int y0 = request.y0 + (tile / job->tilesX) * serverTileSize;
+        int x1 = std::min(x0 + serverTileSize, request.RegionX1());
+        int y1 = std::min(y0 + serverTileSize, request.RegionY1());
+
+        Image image(x1 - x0, y1 - y0);
+        Sampler sampler((SamplerType)request.sampler, request.samples);
+        RenderRegion(image, x0, y0, request.camera, request.width, request.height, x0, y0, x1, y1, NULL, sampler);
+
+        MessageWriter writer;
+        writer.PutInt(request.id);
+        writer.PutInt(x0);
+        writer.PutInt(y0);
+        writer.PutInt(x1);
+        writer.PutInt(y1);
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                writer.PutVec3(image(x - x0, y - y0));
+            }
+        }
+
+        if (!job->connection->Send(MessageTile, writer.data)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->cancelled = true;
+        }
+
+        FinishTile(job);
+    }
+}
+
+bool RenderRemote(const std::string &address, const RenderJob &job, Image &image) {
+
+    int fd = ConnectTo(address);
+    if (fd < 0) {
+        std::cerr << "Could not connect to " << address << std::endl;
+        return false;
+    }
+
+    MessageWriter writer;
+    job.Write(writer);
+    SendMessage(fd, MessageRenderJob, writer.data);
+
+    image = Image(job.width, job.height);
+
+    bool finished = false;
+    int type;
+    std::vector<char> payload;
+    while (ReceiveMessage(fd, type, payload)) {
+        MessageReader reader(payload);
+        int id = reader.GetInt();
+        if (id != job.id) {
+            continue;
+        }
+
+        if (type == MessageTile) {
+            int x0 = reader.GetInt(), y0 = reader.GetInt(), x1 = reader.GetInt(), y1 = reader.GetInt();
+            if (x0 < 0 || y0 < 0 || x1 > image.width || y1 > image.height) {
+                break;
+            }
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    image(x, y) = reader.GetVec3();
+                }
+            }
+        } else if (type == MessageJobDone) {
+            finished = reader.GetInt() == 1;
+            break;
+        } else if (type == MessageError) {
+            std::cerr << "Render server: " << reader.GetString() << std::endl;
+            break;
+        }
+    }
+
+    close(fd);
+    return finished;
+}
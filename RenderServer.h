@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+#include "Protocol.h"
+#include "Scene.h"
+
+/*
+** A long running render server (raytracerd). It listens on a Unix domain or TCP socket for render jobs
+** (see Protocol.h), keeps every scene it has been asked for built in memory, and renders the
+** jobs tile by tile on a shared pool of worker threads, highest priority first, streaming every
+** tile back to the client as soon as it is done. Clients can cancel their jobs, and closing
+** the connection cancels all of them.
+*/
+class RenderServer {
+  public:
+    RenderServer(int workerCount);
+    ~RenderServer();
+
+    /* Serves clients on address (see ListenOn) until the process is killed. Returns non-zero if it can't listen */
+    int Run(const std::string &address);
+
+  private:
+    class Connection;
+    class Job;
+
+    void Serve(std::shared_ptr<Connection> connection);
+    void Work();
+
+    Scene *FindScene(const std::string &name);
+    void Submit(const std::shared_ptr<Connection> &connection, const RenderJob &request);
+    void Cancel(const std::shared_ptr<Connection> &connection, int id);
+
+    void Activate(const Job &job);
+    std::shared_ptr<Job> TakeTile(int &tile);
+    void FinishTile(const std::shared_ptr<Job> &job);
+
+    int workerCount;
+
+    // the queue, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::shared_ptr<Job> > jobs;
+    unsigned long nextSequence;
+    int tilesInFlight;
+    RenderJob activeRequest;  // whose settings the tracer's globals hold
+    bool preparing;           // while a worker activates the settings of a job, outside mutex
+
+    // the resident scenes, guarded by sceneMutex
+    std::mutex sceneMutex;
+    std::map<std::string, Scene *> scenes;
+};
+
+/* Sends job to the server at address and assembles the tiles it streams back into image */
+bool RenderRemote(const std::string &address, const RenderJob &job, Image &image);
@@ -0,0 +1,211 @@
+#include "SDF.h"
+#include "Parallel.h"
+
+#include <limits>
+
+// Distance from p to the box, 0 when p is inside it
+static float BoxDistance(const AABB &box, const glm::vec3 &p) {
+    return glm::length(glm::max(glm::max(box.min - p, p - box.max), glm::vec3(0.0f)));
+}
+
+// Polynomial smooth minimum: the plain minimum once a and b are at least k apart
+static float SmoothMin(float a, float b, float k) {
+    if (k <= 0.0f) {
+        return glm::min(a, b);
+    }
+    float h = glm::clamp(0.5f + 0.5f * (b - a) / k, 0.0f, 1.0f);
+    return glm::mix(b, a, h) - k * h * (1.0f - h);
+}
+
+float SDFSphere::Distance(const glm::vec3 &p) const {
+    return glm::length(p - center) - radius;
+}
+
+AABB SDFSphere::Bounds() const {
+    return AABB(center - glm::vec3(radius), center + glm::vec3(radius));
+}
+
+float SDFBox::Distance(const glm::vec3 &p) const {
+    glm::vec3 q = glm::abs(p - center) - halfSize;
+    return glm::length(glm::max(q, glm::vec3(0.0f))) + glm::min(glm::max(q.x, glm::max(q.y, q.z)), 0.0f);
+}
+
+AABB SDFBox::Bounds() const {
+    return AABB(center - halfSize, center + halfSize);
+}
+
+float SDFRoundBox::Distance(const glm::vec3 &p) const {
+    // a box shrunk by radius, inflated again by radius
+    glm::vec3 q = glm::abs(p - center) - (halfSize - glm::vec3(radius));
+    return glm::length(glm::max(q, glm::vec3(0.0f))) + glm::min(glm::max(q.x, glm::max(q.y, q.z)), 0.0f) - radius;
+}
+
+AABB SDFRoundBox::Bounds() const {
+    return AABB(center - halfSize, center + halfSize);
+}
+
+float SDFTorus::Distance(const glm::vec3 &p) const {
+    glm::vec3 local = p - center;
+    glm::vec2 q(glm::length(glm::vec2(local.x, local.z)) - majorRadius, local.y);
+    return glm::length(q) - minorRadius;
+}
+
+AABB SDFTorus::Bounds() const {
+    glm::vec3 halfSize(majorRadius + minorRadius, minorRadius, majorRadius + minorRadius);
+    return AABB(center - halfSize, center + halfSize);
+}
+
+void SDFSmoothUnion::Add(const SDFShape *shape) {
+
+    shapes.push_back(shape);
+    shapeBounds.push_back(shape->Bounds());
+
+    // blending can pull the surface out by up to a quarter of the smoothness
+    AABB padded = shapeBounds.back();
+    padded.min -= glm::vec3(smoothness * 0.25f);
+    padded.max += glm::vec3(smoothness * 0.25f);
+    bounds.Extend(padded);
+}
+
+float SDFSmoothUnion::Distance(const glm::vec3 &p) const {
+
+    float distance = std::numeric_limits<float>::infinity();
+
+    for (size_t i = 0; i < shapes.size(); i++) {
+        // a shape is at least as far away as its box, and the blend leaves the distance alone
+        // when the shapes are more than smoothness apart, so far away shapes can be skipped
+        float boxDistance = BoxDistance(shapeBounds[i], p);
+        if (boxDistance > 0.0f && boxDistance >= distance + smoothness) {
+            continue;
+        }
+
+        float shapeDistance = shapes[i]->Distance(p);
+        distance = i == 0 ? shapeDistance : SmoothMin(distance, shapeDistance, smoothness);
+    }
+
+    return distance;
+}
+
+float SDFSmoothUnion::Lipschitz() const {
+    // the smooth minimum changes no faster than the fastest of its inputs
+    float lipschitz = 1.0f;
+    for (size_t i = 0; i < shapes.size(); i++) {
+        lipschitz = glm::max(lipschitz, shapes[i]->Lipschitz());
+    }
+    return lipschitz;
+}
+
+SDFGrid::SDFGrid(const SDFShape &shape, int gridResolution):
+    // the padding below needs more than five samples a side
+    resolution(glm::max(gridResolution, minSDFGridResolution)),
+    bounds(shape.Bounds()),
+    // interpolating along each axis is bounded by the shape's constant, so the gradient is within sqrt(3) of it
+    lipschitz(sqrtf(3.0f) * shape.Lipschitz()),
+    samples(this->resolution * this->resolution * this->resolution)
+  {
+
+    // pad by two cells so the samples on the border of the grid are all outside the surface
+    glm::vec3 extent = bounds.Extent();
+    float padding = 2.0f * glm::max(extent.x, glm::max(extent.y, extent.z)) / (resolution - 5);
+    bounds.min -= glm::vec3(padding);
+    bounds.max += glm::vec3(padding);
+    cellSize = bounds.Extent() / (float)(resolution - 1);
+
+    ParallelFor(resolution, [&](int z) {
+        for (int y = 0; y < resolution; y++) {
+            for (int x = 0; x < resolution; x++) {
+                glm::vec3 p = bounds.min + cellSize * glm::vec3(x, y, z);
+                samples[(z * resolution + y) * resolution + x] = shape.Distance(p);
+            }
+        }
+    });
+}
+
+float SDFGrid::Distance(const glm::vec3 &p) const {
+
+    // outside the grid, the distance to the grid plus the distance stored at its border
+    glm::vec3 q = glm::clamp(p, bounds.min, bounds.max);
+    float outside = glm::length(p - q);
+
+    glm::vec3 f = (q - bounds.min) / cellSize;
+    int x = glm::min((int)f.x, resolution - 2);
+    int y = glm::min((int)f.y, resolution - 2);
+    int z = glm::min((int)f.z, resolution - 2);
+    glm::vec3 t = f - glm::vec3(x, y, z);
+
+    float c00 = glm::mix(Sample(x, y, z),         Sample(x + 1, y, z),         t.x);
+    float c10 = glm::mix(Sample(x, y + 1, z),     Sample(x + 1, y + 1, z),     t.x);
+    float c01 = glm::mix(Sample(x, y, z + 1),     Sample(x + 1, y, z + 1),     t.x);
+    float c11 = glm::mix(Sample(x, y + 1, z + 1), Sample(x + 1, y + 1, z + 1), t.x);
+
+    return outside + glm::mix(glm::mix(c00, c10, t.y), glm::mix(c01, c11, t.y), t.z);
+}
+
+bool SDFObject::Intersect(const Ray &ray, IntersectInfo &info) const {
+
+    // surfaces closer than this count as hit
+    const float epsilon = 0.001f;
+    const int maxSteps = 256;
+
+    // skip the empty space up to the bounding box, and give up once the ray leaves it
+    // (padded a little, flat faces can lie exactly on the box)
+    float tNear, tFar;
+    AABB bounds = Bounds();
+    bounds.min -= glm::vec3(epsilon);
+    bounds.max += glm::vec3(epsilon);
+    if (!bounds.Intersect(ray, tNear, tFar)) {
+        return false;
+    }
+
+    // march in world units, the ray direction isn't always normalised
+    float length = glm::length(ray.direction);
+    glm::vec3 direction = ray.direction / length;
+    glm::vec3 origin = ray.origin - offset;
+    float lipschitz = shape->Lipschitz();
+
+    float t = tNear * length;
+    float end = tFar * length;
+
+    if (shape->Distance(origin) < 0) {
+        // case for rays starting inside the object, which like the spheres are not hit
+        return false;
+    }
+
+    for (int step = 0; step < maxSteps && t <= end; step++) {
+        float distance = shape->Distance(origin + t * direction) / lipschitz;
+
+        // hits right at the start of the ray are the surface the ray is leaving
+        if (distance < epsilon && t > epsilon) {
+            glm::vec3 local = origin + t * direction;
+
+            // the gradient of the field, from the tetrahedron of samples around the hit
+            const glm::vec2 h(epsilon, -epsilon);
+            glm::vec3 normal = glm::vec3(h.x, h.y, h.y) * shape->Distance(local + glm::vec3(h.x, h.y, h.y)) +
+                               glm::vec3(h.y, h.y, h.x) * shape->Distance(local + glm::vec3(h.y, h.y, h.x)) +
+                               glm::vec3(h.y, h.x, h.y) * shape->Distance(local + glm::vec3(h.y, h.x, h.y)) +
+                               glm::vec3(h.x, h.x, h.x) * shape->Distance(local + glm::vec3(h.x, h.x, h.x));
+
+            info.hitPoint = ray.origin + t * direction;
+            info.time = glm::length(ray.origin - info.hitPoint);
+            info.normal = glm::normalize(normal);
+            info.material = MaterialPtr();
+            info.object = this;
+
+            return true;
+        }
+
+        t += glm::max(distance, epsilon);
+    }
+
+    return false;
+}
+
+AABB SDFObject::Bounds() const {
+    AABB bounds = shape->Bounds();
+    return AABB(bounds.min + offset, bounds.max + offset);
+}
+
+void SDFObject::Translate(const glm::vec3 &offset) {
+    this->offset += offset;
+    MarkChanged();
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <vector>
+
+#include "Object.h"
+
+// A signed distance field: the distance from a point to the surface of a shape,
+// negative inside it. Shapes are rendered by sphere tracing through an SDFObject.
+class SDFShape {
+  public:
+    virtual ~SDFShape() {}
+
+    virtual float Distance(const glm::vec3 &p) const = 0;
+
+    /*
+    ** An upper bound on how fast Distance() changes (its Lipschitz constant). A true distance
+    ** has 1, and sphere tracing divides every step by this so it can never step through the surface.
+    */
+    virtual float Lipschitz() const { return 1.0f; }
+
+    /* A box that contains the whole surface. Outside it, Distance() is at least the distance to the box */
+    virtual AABB Bounds() const = 0;
+};
+
+class SDFSphere : public SDFShape {
+  public:
+    SDFSphere(glm::vec3 center, float radius):
+      center(center),
+      radius(radius) {}
+
+    virtual float Distance(const glm::vec3 &p) const;
+    virtual AABB Bounds() const;
+
+    glm::vec3 center;
+    float radius;
+};
+
+class SDFBox : public SDFShape {
+  public:
+    SDFBox(glm::vec3 center, glm::vec3 halfSize):
+      center(center),
+      halfSize(halfSize) {}
+
+    virtual float Distance(const glm::vec3 &p) const;
+    virtual AABB Bounds() const;
+
+    glm::vec3 center;
+    glm::vec3 halfSize;
+};
+
+// A box with its edges rounded off by radius, the whole shape still fits in halfSize
+class SDFRoundBox : public SDFShape {
+  public:
+    SDFRoundBox(glm::vec3 center, glm::vec3 halfSize, float radius):
+      center(center),
+      halfSize(halfSize),
+      radius(radius) {}
+
+    virtual float Distance(const glm::vec3 &p) const;
+    virtual AABB Bounds() const;
+
+    glm::vec3 center;
+    glm::vec3 halfSize;
+    float radius;
+};
+
+// A torus lying flat (around the y axis)
+class SDFTorus : public SDFShape {
+  public:
+    SDFTorus(glm::vec3 center, float majorRadius, float minorRadius):
+      center(center),
+      majorRadius(majorRadius),
+      minorRadius(minorRadius) {}
+
+    virtual float Distance(const glm::vec3 &p) const;
+    virtual AABB Bounds() const;
+
+    glm::vec3 center;
+    float majorRadius;
+    float minorRadius;
+};
+
+/*
+** The union of several shapes, blended together within smoothness of each other (0 gives
+** the plain union). The bounding boxes of the shapes are used to skip evaluating the ones
+** that are too far away to matter for a point.
+*/
+class SDFSmoothUnion : public SDFShape {
+  public:
+    SDFSmoothUnion(float smoothness = 0.0f):
+      smoothness(smoothness) {}
+
+    void Add(const SDFShape *shape);
+
+    virtual float Distance(const glm::vec3 &p) const;
+    virtual float Lipschitz() const;
+    virtual AABB Bounds() const { return bounds; }
+
+    float smoothness;
+
+  private:
+    std::vector<const SDFShape *> shapes;
+    std::vector<AABB> shapeBounds;
+    AABB bounds;
+};
+
+// The fewest samples an SDFGrid has a side: two of padding each way, and some of the shape between
+const int minSDFGridResolution = 8;
+
+/*
+** Another shape sampled once on a resolution^3 grid over its bounds and trilinearly
+** interpolated afterwards. Expensive compositions then cost 8 lookups per evaluation,
+** at the price of resolution^3 floats and some rounding of details smaller than a cell.
+** Resolutions below minSDFGridResolution are raised to it.
+*/
+class SDFGrid : public SDFShape {
+  public:
+    SDFGrid(const SDFShape &shape, int resolution);
+
+    virtual float Distance(const glm::vec3 &p) const;
+    virtual float Lipschitz() const { return lipschitz; }
+    virtual AABB Bounds() const { return bounds; }
+
+  private:
+    float Sample(int x, int y, int z) const { return samples[(z * resolution + y) * resolution + x]; }
+
+    int resolution;
+    AABB bounds;
+    glm::vec3 cellSize;
+    float lipschitz;
+    std::vector<float> samples;
+};
+
+// An Object whose surface is the zero set of a distance field, found by sphere tracing
+class SDFObject : public Object {
+
+    const SDFShape *shape;
+    glm::vec3 offset;  // where the shape has been moved to by Translate
+
+    public:
+        SDFObject(const glm::mat4 &transform, const Material &material, const SDFShape *shape):
+                Object(transform, material),
+                shape(shape),
+                offset(0.0f) {}
+
+        virtual bool Intersect(const Ray &ray, IntersectInfo &info) const;
+        virtual AABB Bounds() const;
+        virtual void Translate(const glm::vec3 &offset);
+};
@@ -0,0 +1,273 @@
+#include "Sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+void Philox(uint32_t key, uint32_t counter0, uint32_t counter1, uint32_t out[2]) {
+    const uint32_t multiplier = 0xd256d193u, weyl = 0x9e3779b9u;
+    for (int round = 0; round < 10; round++) {
+        uint64_t product = (uint64_t)multiplier * counter0;
+        counter0 = (uint32_t)(product >> 32) ^ key ^ counter1;
+        counter1 = (uint32_t)product;
+        key += weyl;
+    }
+    out[0] = counter0;
+    out[1] = counter1;
+}
+
+bool ParseSamplerType(const std::string &name, SamplerType &type) {
+    if (name == "grid") {
+        type = SamplerGrid;
+    } else if (name == "random") {
+        type = SamplerRandom;
+    } else if (name == "stratified") {
+        type = SamplerStratified;
+    } else if (name == "sobol") {
+        type = SamplerSobol;
+    } else if (name == "bluenoise") {
+        type = SamplerBlueNoise;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static float UnitFloat(uint32_t bits) {
+    return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// The numbers that make up the pattern of one pixel and dimension
+static void PixelRandom(uint32_t seed, int x, int y, int sample, int dimension, uint32_t out[2]) {
+    Philox(seed, (uint32_t)x | ((uint32_t)y << 16), ((uint32_t)sample << 10) | ((uint32_t)dimension & 1023u), out);
+}
+
+// Kensler's hash based permutation of [0, length), a different one for every pattern
+static uint32_t Permute(uint32_t i, uint32_t length, uint32_t pattern) {
+    uint32_t mask = length - 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+    do {
+        i ^= pattern;             i *= 0xe170893du;
+        i ^= pattern >> 16;       i ^= (i & mask) >> 4;
+        i ^= pattern >> 8;        i *= 0x0929eb3fu;
+        i ^= pattern >> 23;       i ^= (i & mask) >> 1;
+        i *= 1 | pattern >> 27;   i *= 0x6935fa69u;
+        i ^= (i & mask) >> 11;    i *= 0x74dcb303u;
+        i ^= (i & mask) >> 2;     i *= 0x9e501cc3u;
+        i ^= (i & mask) >> 2;     i *= 0xc860a3dfu;
+        i &= mask;                i ^= i >> 5;
+    } while (i >= length);
+    return (i + pattern) % length;
+}
+
+// Kensler's hash of i to a float in [0, 1)
+static float HashFloat(uint32_t i, uint32_t pattern) {
+    i ^= pattern;
+    i ^= i >> 17;
+    i ^= i >> 10;
+    i *= 0xb36534e5u;
+    i ^= i >> 12;
+    i ^= i >> 21;
+    i *= 0x93fc4795u;
+    i ^= 0xdf6e307fu;
+    i ^= i >> 17;
+    i *= 1 | pattern >> 18;
+    return i * (1.0f / 4294967808.0f);
+}
+
+static uint32_t ReverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// Owen scrambling, done with Laine and Karras' hash on the reversed bits (as in Burley's "Practical hash-based Owen scrambling")
+static uint32_t OwenScramble(uint32_t x, uint32_t seed) {
+    x = ReverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return ReverseBits(x);
+}
+
+// The first two dimensions of the Sobol sequence, as 32 bit fractions
+static uint32_t Sobol0(uint32_t i) {
+    return ReverseBits(i);
+}
+
+static uint32_t Sobol1(uint32_t i) {
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; i; i >>= 1, v ^= v >> 1) {
+        if (i & 1) {
+            result ^= v;
+        }
+    }
+    return result;
+}
+
+glm::vec2 ScrambledSobol(uint32_t index, uint32_t seed0, uint32_t seed1) {
+    index = OwenScramble(index, seed0);
+    return glm::vec2(UnitFloat(OwenScramble(Sobol0(index), seed1)), UnitFloat(OwenScramble(Sobol1(index), seed0 ^ seed1 * 0x9e3779b9u)));
+}
+
+static const int blueNoiseSize = 64;
+
+/*
+** A blue noise mask of blueNoiseSize x blueNoiseSize values in [0, 1), made once with Ulichney's
+** void and cluster method: every value is the rank at which its pixel was added to a pattern that
+** was kept as evenly spread as possible, measured by a gaussian energy on the torus. Any threshold
+** of the mask is then an even, clump free pattern, and so are its values as offsets.
+*/
+static std::vector<float> MakeBlueNoise() {
+
+    const int size = blueNoiseSize, cells = size * size;
+    const float sigma = 1.5f;
+
+    // the gaussian over every toroidal offset
+    std::vector<float> kernel(cells);
+    for (int dy = 0; dy < size; dy++) {
+        for (int dx = 0; dx < size; dx++) {
+            int wx = std::min(dx, size - dx), wy = std::min(dy, size - dy);
+            kernel[dy * size + dx] = expf(-(wx * wx + wy * wy) / (2.0f * sigma * sigma));
+        }
+    }
+
+    std::vector<char> pattern(cells, 0);
+    std::vector<float> energy(cells, 0.0f);
+    auto toggle = [&](int cell, bool on) {
+        pattern[cell] = on;
+        int cx = cell % size, cy = cell / size;
+        for (int y = 0; y < size; y++) {
+            const float *row = &kernel[((y - cy + size) % size) * size];
+            for (int x = 0; x < size; x++) {
+                energy[y * size + x] += (on ? 1.0f : -1.0f) * row[(x - cx + size) % size];
+            }
+        }
+    };
+    // the most crowded set cell, or the emptiest unset one
+    auto extreme = [&](bool set) {
+        int best = -1;
+        for (int i = 0; i < cells; i++) {
+            if (pattern[i] == set && (best < 0 || (set ? energy[i] > energy[best] : energy[i] < energy[best]))) {
+                best = i;
+            }
+        }
+        return best;
+    };
+
+    // a random initial pattern of a tenth of the cells, then relaxed by moving the most crowded
+    // cell into the biggest void until that puts it right back
+    int initial = cells / 10;
+    for (int placed = 0, counter = 0; placed < initial; counter++) {
+        uint32_t random[2];
+        Philox(0x5eed, (uint32_t)counter, 0, random);
+        int cell = random[0] % cells;
+        if (!pattern[cell]) {
+            toggle(cell, true);
+            placed++;
+        }
+    }
+    for (;;) {
+        int cluster = extreme(true);
+        toggle(cluster, false);
+        int hole = extreme(false);
+        toggle(hole, true);
+        if (hole == cluster) {
+            break;
+        }
+    }
+
+    std::vector<float> mask(cells);
+    std::vector<char> prototype = pattern;
+    std::vector<float> prototypeEnergy = energy;
+
+    // the initial cells are ranked by taking away the most crowded one each time
+    for (int rank = initial - 1; rank >= 0; rank--) {
+        int cluster = extreme(true);
+        toggle(cluster, false);
+        mask[cluster] = rank;
+    }
+
+    // and the rest by filling the biggest void each time
+    pattern = prototype;
+    energy = prototypeEnergy;
+    for (int rank = initial; rank < cells; rank++) {
+        int hole = extreme(false);
+        toggle(hole, true);
+        mask[hole] = rank;
+    }
+
+    for (int i = 0; i < cells; i++) {
+        mask[i] = (mask[i] + 0.5f) / cells;
+    }
+    return mask;
+}
+
+Sampler::Sampler(SamplerType type, int samples, uint32_t seed):
+    type(type),
+    count(std::max(samples, 1)),
+    grid(1),
+    seed(seed) {
+
+    if (type == SamplerGrid) {
+        grid = std::max(1, (int)sqrtf((float)count));
+        count = grid * grid;
+    }
+}
+
+// Kensler's correlated multi-jittered sample, in an m x n grid with m * n >= count
+glm::vec2 Sampler::Stratified(uint32_t pattern, int sample) const {
+    int m = std::max(1, (int)sqrtf((float)count));
+    int n = (count + m - 1) / m;
+    uint32_t s = Permute(sample, count, pattern * 0x51633e2du);
+    uint32_t sx = Permute(s % m, m, pattern * 0x68bc21ebu);
+    uint32_t sy = Permute(s / m, n, pattern * 0x02e5be93u);
+    float jx = HashFloat(s, pattern * 0x967a889bu);
+    float jy = HashFloat(s, pattern * 0x368cc8b7u);
+    return glm::vec2((sx + (sy + jx) / n) / m, (s + jy) / count);
+}
+
+glm::vec2 Sampler::Get2D(int x, int y, int sample, int dimension) const {
+
+    if (type == SamplerGrid) {
+        // a grid only has the one pattern, every dimension gets the same points
+        int sx = sample / grid, sy = sample % grid;
+        return glm::vec2((sx + 0.5f) / grid, (sy + 0.5f) / grid);
+    }
+
+    uint32_t random[2];
+
+    if (type == SamplerRandom) {
+        PixelRandom(seed, x, y, sample, dimension, random);
+        return glm::vec2(UnitFloat(random[0]), UnitFloat(random[1]));
+    }
+
+    if (type == SamplerStratified || type == SamplerSobol) {
+        // one pattern for all the samples of a pixel and dimension
+        PixelRandom(seed, x, y, 0, dimension, random);
+        if (type == SamplerStratified) {
+            return Stratified(random[0], sample);
+        }
+        return ScrambledSobol((uint32_t)sample, random[0], random[1]);
+    }
+
+    // blue noise: the Sobol points shifted (modulo 1) by two values of the mask, looked up at a
+    // different toroidal offset for every dimension so the dimensions aren't correlated. The offset
+    // is the same for all pixels, so neighbouring pixels read neighbouring values of the mask
+    static const std::vector<float> mask = MakeBlueNoise();
+    Philox(seed, (uint32_t)dimension, 0, random);
+    int offset = random[0] % (blueNoiseSize * blueNoiseSize);
+    int maskX = (x + offset % blueNoiseSize) % blueNoiseSize, maskY = (y + offset / blueNoiseSize) % blueNoiseSize;
+    glm::vec2 shift(mask[maskY * blueNoiseSize + maskX], mask[((maskY + blueNoiseSize / 2) % blueNoiseSize) * blueNoiseSize + (maskX + 17) % blueNoiseSize]);
+    glm::vec2 point(UnitFloat(Sobol0(sample)), UnitFloat(Sobol1(sample)));
+    return glm::fract(point + shift);
+}
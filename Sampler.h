@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+#include "glm/glm.hpp"
+
+/*
+** Philox-2x32-10, a counter based random number generator: the numbers for a counter are computed
+** from the counter and the key alone, with no state carried from one number to the next. Keyed by
+** pixel and counted by sample and dimension, every sample gets the same numbers however the frame
+** is split into tiles, threads or servers.
+*/
+void Philox(uint32_t key, uint32_t counter0, uint32_t counter1, uint32_t out[2]);
+
+/* Point index of the 2D Sobol sequence, Owen scrambled by the seeds. Its first 4^k points fall one
+   into each cell of a 2^k x 2^k grid, whatever the seeds, so any prefix of 4, 16, 64... is stratified */
+glm::vec2 ScrambledSobol(uint32_t index, uint32_t seed0, uint32_t seed1);
+
+enum SamplerType {
+    SamplerGrid,        // the centers of a regular grid inside the pixel, the count rounded down to a square
+    SamplerRandom,      // independent uniform random points
+    SamplerStratified,  // correlated multi-jittered: stratified in 2D and in both 1D projections, for any count
+    SamplerSobol,       // the 2D Sobol sequence, Owen scrambled per pixel and dimension
+    SamplerBlueNoise    // the Sobol sequence shifted per pixel by a blue noise mask, so the error looks like blue noise
+};
+
+/* Parses grid, random, stratified, sobol or bluenoise, false if it isn't one of them */
+bool ParseSamplerType(const std::string &name, SamplerType &type);
+
+/*
+** Where the samples of a pixel go. Every sample has any number of 2D dimensions, each a point in
+** [0, 1)^2: dimension 0 is the position inside the pixel, the later ones are for whatever else a
+** sample needs random numbers for (points on an area light, ...). All the samplers but the grid
+** draw a different pattern for every pixel and dimension, and all of them are deterministic.
+*/
+class Sampler {
+  public:
+    Sampler(SamplerType type = SamplerGrid, int samples = 1, uint32_t seed = 0);
+
+    /* How many samples a pixel gets, which for the grid is the requested count rounded down to a square */
+    int SampleCount() const { return count; }
+    SamplerType Type() const { return type; }
+
+    /* The point for dimension of sample (in [0, SampleCount())) of pixel (x, y) */
+    glm::vec2 Get2D(int x, int y, int sample, int dimension) const;
+    float Get1D(int x, int y, int sample, int dimension) const { return Get2D(x, y, sample, dimension).x; }
+
+  private:
+    SamplerType type;
+    int count;
+    int grid;       // the side of the grid of the grid sampler
+    uint32_t seed;
+
+    glm::vec2 Stratified(uint32_t pattern, int sample) const;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+
+#include "Arena.h"
+#include "IrradianceCache.h"
+#include "Light.h"
+#include "Object.h"
+#include "PhotonMap.h"
+#include "SceneBVH.h"
+
+// Remembers objects and their versions, to tell when any of them was edited or the scene was switched
+class ObjectsSnapshot {
+  public:
+    /* Whether objects changed since the last call, which takes them as the new snapshot */
+    bool Update(const std::vector<Object*> &objects) {
+        bool changed = snapshot != objects;
+        for (size_t i = 0; i < objects.size() && !changed; i++) {
+            changed = versions[i] != objects[i]->version;
+        }
+        if (changed) {
+            snapshot = objects;
+            versions.resize(objects.size());
+            for (size_t i = 0; i < objects.size(); i++) {
+                versions[i] = objects[i]->version;
+            }
+        }
+        return changed;
+    }
+
+  private:
+    std::vector<Object*> snapshot;
+    std::vector<unsigned int> versions;
+};
+
+// The objects of one scene, all constructed in the scene's own arena, and what the tracer keeps over them:
+// the scene stays resident with all of it, so a render server switching between scenes builds none of it again
+class Scene {
+  public:
+    Scene():
+      acceleration(AccelerationSAH),
+      causticPhotons(0),
+      causticFastMath(false),
+      indirectRays(0),
+      indirectLight(glm::vec3(0.0f))
+    {}
+
+    Arena arena;
+    std::vector<Object*> objects;
+    AccelerationStructure acceleration;  // what suits the scene best, the rays find its objects through it
+
+    SceneBVH bvh;                        // over objects, see BuildAcceleration
+    PhotonMap causticMap;                // see UpdateCaustics
+    int causticPhotons;                  // how many photons the map was shot with
+    bool causticFastMath;                // and whether through the approximate intersections of fastMath
+    ObjectsSnapshot causticSnapshot;     // of objects when they were shot
+    IrradianceCache irradianceCache;     // see UpdateIndirect
+    int indirectRays;                    // how many rays the records of the cache are made with
+    Light indirectLight;                 // and the light they see
+    ObjectsSnapshot irradianceSnapshot;  // of objects when the cache was emptied
+
+    /* Builds bvh over the objects with the scene's acceleration structure, once they are all added */
+    void BuildAcceleration() {
+        bvh.structure = acceleration;
+        bvh.Build(objects);
+    }
+
+    /* Constructs an object in the arena and adds it to the scene */
+    template<class T, class... Args>
+    T *Add(Args&&... args) {
+        T *object = arena.New<T>(std::forward<Args>(args)...);
+        object->id = objects.size();
+        objects.push_back(object);
+        return object;
+    }
+
+    /* Constructs something the objects use (shapes, materials, ...) in the arena without adding it */
+    template<class T, class... Args>
+    T *New(Args&&... args) {
+        return arena.New<T>(std::forward<Args>(args)...);
+    }
+
+    /* Frees every object of the scene at once */
+    void Release() {
+        objects.clear();
+        arena.Release();
+    }
+
+  private:
+    Scene(const Scene &);
+    Scene &operator =(const Scene &);
+};
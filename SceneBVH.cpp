@@ -0,0 +1,133 @@
+#include "SceneBVH.h"
+
+bool ParseAccelerationStructure(const std::string &name, AccelerationStructure &structure) {
+    if (name == "sah") {
+        structure = AccelerationSAH;
+    } else if (name == "linear") {
+        structure = AccelerationLinear;
+    } else if (name == "spatial") {
+        structure = AccelerationSpatial;
+    } else if (name == "grid") {
+        structure = AccelerationGrid;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void SceneBVH::BuildTree() {
+
+    if (structure == AccelerationLinear) {
+        tree.BuildLinear(bounded);
+    } else if (structure == AccelerationSpatial) {
+        tree.BuildSpatial(bounded);
+    } else {
+        tree.Build(bounded);
+    }
+    builtCost = tree.SAHCost();
+}
+
+void SceneBVH::Build(const std::vector<Object *> &objects) {
+
+    bounded.clear();
+    unbounded.clear();
+    versions.clear();
+    for (size_t i = 0; i < objects.size(); i++) {
+        if (objects[i]->Bounds().IsFinite()) {
+            bounded.push_back(objects[i]);
+            versions.push_back(objects[i]->version);
+        } else {
+            unbounded.push_back(objects[i]);
+        }
+    }
+
+    refits = 0;
+    rebuilds = 0;
+    if (structure == AccelerationGrid) {
+        tree = BVH();
+        wide = WideBVH();
+        grid.Build(bounded);
+        return;
+    }
+
+    // the binned build is quick next to the others, and tells what they were worth
+    grid = UniformGrid();
+    tree.Build(bounded);
+    binnedCost = builtCost = tree.SAHCost();
+    if (structure != AccelerationSAH) {
+        BuildTree();
+    }
+    CollapseTree();
+}
+
+void SceneBVH::CollapseTree() {
+
+    wide.Collapse(tree);
+    if (wide.Depth() > wideBVHMaxDepth) {
+        wide = WideBVH();
+    }
+}
+
+void SceneBVH::Update() {
+
+    bool moved = false;
+    for (size_t i = 0; i < bounded.size(); i++) {
+        if (versions[i] != bounded[i]->version) {
+            versions[i] = bounded[i]->version;
+            moved = true;
+        }
+    }
+    if (!moved) {
+        return;
+    }
+
+    if (structure == AccelerationGrid) {
+        grid.Build(bounded);
+        rebuilds++;
+        return;
+    }
+
+    tree.Refit();
+    refits++;
+
+    if (tree.SAHCost() > builtCost * sceneRebuildRatio) {
+        BuildTree();
+        rebuilds++;
+    }
+    CollapseTree();
+}
+
+bool SceneBVH::Intersect(const Ray &ray, IntersectInfo &info) const {
+
+    IntersectInfo closest;
+    bool hit = structure == AccelerationGrid ? grid.Intersect(ray, closest) :
+               wide.Nodes().empty() ? tree.Intersect(ray, closest) : wide.Intersect(ray, closest);
+
+    for (size_t i = 0; i < unbounded.size(); i++) {
+        IntersectInfo candidate;
+        if (unbounded[i]->Intersect(ray, candidate) && candidate.time < closest.time) {
+            closest = candidate;
+            hit = true;
+        }
+    }
+
+    if (hit) {
+        info = closest;
+    }
+    return hit;
+}
+
+const Object *SceneBVH::Occluder(const Ray &ray, float distance) const {
+
+    for (size_t i = 0; i < unbounded.size(); i++) {
+        IntersectInfo candidate;
+        if (unbounded[i]->Intersect(ray, candidate) && candidate.time < distance) {
+            return unbounded[i];
+        }
+    }
+
+    if (structure == AccelerationGrid) {
+        return grid.Occluder(ray, distance);
+    }
+    return wide.Nodes().empty() ? tree.Occluder(ray, distance) : wide.Occluder(ray, distance);
+}
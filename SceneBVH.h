@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "BVH.h"
+#include "Grid.h"
+#include "WideBVH.h"
+
+// How much the SAH cost of the tree may grow through refits, relative to what it was right after
+// the last build, before the tree is built again
+const float sceneRebuildRatio = 1.3f;
+
+// What the rays find the scene's objects through
+enum AccelerationStructure {
+    AccelerationSAH,      // a BVH built with BVH::Build, the default
+    AccelerationLinear,   // a BVH built with BVH::BuildLinear, the quickest to build
+    AccelerationSpatial,  // a BVH built with BVH::BuildSpatial, the slowest to build and the quickest to trace with long thin triangles
+    AccelerationGrid      // a UniformGrid, for many objects of about the same size spread evenly
+};
+
+/* Parses sah, linear, spatial or grid, false if it isn't one of them */
+bool ParseAccelerationStructure(const std::string &name, AccelerationStructure &structure);
+
+/*
+** The hierarchy over the objects of the scene that CheckIntersection and the shadow rays go through.
+** Objects with finite bounds are in a BVH, the few without (planes) are tested one by one. Rays
+** traverse the tree collapsed into a WideBVH, which is collapsed again whenever the tree changes (or the
+** tree itself, should it ever be too deep for the WideBVH's traversal stacks). When
+** objects move the tree keeps its structure and only its boxes are refitted, which is far cheaper
+** than a build; but boxes that moved apart overlap more and more, so once the tree's SAH cost has
+** grown by sceneRebuildRatio since it was built, it is built again. With AccelerationGrid the
+** bounded objects are in a UniformGrid instead, which is simply built again when they move.
+*/
+class SceneBVH {
+  public:
+    SceneBVH():
+      structure(AccelerationSAH),
+      binnedCost(0.0f),
+      builtCost(0.0f),
+      refits(0),
+      rebuilds(0)
+    {}
+
+    AccelerationStructure structure;  // for Build and the rebuilds
+
+    /* Builds the hierarchy over objects, which have to stay alive and in place while it is used */
+    void Build(const std::vector<Object *> &objects);
+
+    /* Brings the hierarchy up to date after objects were edited: refits it if any of them changed,
+       and rebuilds it if that made it too much worse. Must not run while rays are traced */
+    void Update();
+
+    /* Finds the closest hit along the ray, like Object::Intersect */
+    bool Intersect(const Ray &ray, IntersectInfo &info) const;
+
+    /* Any object the ray hits less than distance away, NULL if there is none */
+    const Object *Occluder(const Ray &ray, float distance) const;
+
+    const BVH &Tree() const { return tree; }
+    const UniformGrid &Grid() const { return grid; }
+    /* What the tree's SAH cost would have been with BVH::Build when it was last built, to compare the other methods with */
+    float BinnedCost() const { return binnedCost; }
+    int Refits() const { return refits; }
+    int Rebuilds() const { return rebuilds; }
+
+  private:
+    void BuildTree();
+    void CollapseTree();
+
+    BVH tree;
+    WideBVH wide;  // of tree, empty if it was too deep
+    UniformGrid grid;
+    std::vector<const Object *> bounded;    // in the tree
+    std::vector<const Object *> unbounded;  // tested on their own
+    std::vector<unsigned int> versions;     // of the bounded objects when the tree was last built or refitted
+    float binnedCost;                       // see BinnedCost
+    float builtCost;                        // the tree's SAH cost right after it was built
+    int refits, rebuilds;                   // since Build
+};
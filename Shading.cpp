@@ -0,0 +1,192 @@
+#include "Shading.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "FastMath.h"
+
+int ShadingBatch::Add(const glm::vec3 &hitPoint, const glm::vec3 &normal, const glm::vec3 &viewOrigin, const Material *material, float visibility) {
+
+    // a batch only ever sees a handful of materials, and neighbouring hits mostly share one
+    int found = bucketCount - 1;
+    if (found < 0 || buckets[found].material != material) {
+        for (found = 0; found < bucketCount && buckets[found].material != material; found++) {}
+        if (found == bucketCount) {
+            if (bucketCount == (int)buckets.size()) {
+                buckets.push_back(Bucket());
+            }
+            buckets[bucketCount].material = material;
+            buckets[bucketCount].blocks.clear();
+            buckets[bucketCount].index.clear();
+            bucketCount++;
+        }
+    }
+
+    Bucket &bucket = buckets[found];
+    int lane = bucket.index.size() % 4;
+    if (lane == 0) {
+        bucket.blocks.resize(bucket.blocks.size() + blockFloats, 0.0f);
+    }
+
+    float *block = &bucket.blocks[bucket.blocks.size() - blockFloats];
+    block[4 * PointX + lane] = hitPoint.x;
+    block[4 * PointY + lane] = hitPoint.y;
+    block[4 * PointZ + lane] = hitPoint.z;
+    block[4 * NormalX + lane] = normal.x;
+    block[4 * NormalY + lane] = normal.y;
+    block[4 * NormalZ + lane] = normal.z;
+    block[4 * OriginX + lane] = viewOrigin.x;
+    block[4 * OriginY + lane] = viewOrigin.y;
+    block[4 * OriginZ + lane] = viewOrigin.z;
+    block[4 * Visibility + lane] = visibility;
+
+    int index = (int)colors.size();
+    colors.push_back(glm::vec3(0.0f));
+    bucket.index.push_back(index);
+    return index;
+}
+
+void ShadingBatch::Clear() {
+    bucketCount = 0;
+    colors.clear();
+}
+
+void ShadingBatch::Shade(const glm::vec3 &lightPosition, const glm::vec3 &lightIntensity) {
+    for (int i = 0; i < bucketCount; i++) {
+        ShadeBucket(buckets[i], lightPosition, lightIntensity);
+    }
+}
+
+#ifdef __SSE2__
+
+// The same operations as GetPhong's, in the same order, on four lanes
+
+static inline __m128 Dot4(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+static inline void Normalize4(__m128 &x, __m128 &y, __m128 &z, bool fast) {
+    __m128 lengthSquared = Dot4(x, y, z, x, y, z), scale;
+    if (fast) {
+        // FastInverseSqrt
+        __m128 estimate = _mm_rsqrt_ps(lengthSquared);
+        scale = _mm_mul_ps(estimate, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), lengthSquared), estimate), estimate)));
+    } else {
+        // glm::normalize
+        scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared));
+    }
+    x = _mm_mul_ps(x, scale);
+    y = _mm_mul_ps(y, scale);
+    z = _mm_mul_ps(z, scale);
+}
+
+static inline __m128 Pow4(__m128 x, float exponent, bool fast) {
+
+    // FastPow's repeated squaring, which needs the same whole exponent in every lane (one material)
+    if (fast && exponent > 0.0f && exponent <= 1024.0f && (float)(int)exponent == exponent) {
+        __m128 result = _mm_set1_ps(1.0f), power = x;
+        for (unsigned int n = (unsigned int)exponent; n; n >>= 1) {
+            if (n & 1) {
+                result = _mm_mul_ps(result, power);
+            }
+            power = _mm_mul_ps(power, power);
+        }
+        return result;
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, x);
+    for (int i = 0; i < 4; i++) {
+        lanes[i] = ShadingPow(lanes[i], exponent);
+    }
+    return _mm_loadu_ps(lanes);
+}
+
+void ShadingBatch::ShadeBucket(Bucket &bucket, const glm::vec3 &lightPosition, const glm::vec3 &lightIntensity) {
+
+    const Material &material = *bucket.material;
+    bool fast = fastMath;
+    __m128 zero = _mm_setzero_ps(), two = _mm_set1_ps(2.0f);
+    __m128 lightX = _mm_set1_ps(lightPosition.x), lightY = _mm_set1_ps(lightPosition.y), lightZ = _mm_set1_ps(lightPosition.z);
+
+    __m128 diffuseColor[3], ambientColor[3], specularColor[3];
+    for (int c = 0; c < 3; c++) {
+        diffuseColor[c] = _mm_set1_ps(lightIntensity[c] * material.diffuse[c]);
+        ambientColor[c] = _mm_set1_ps(lightIntensity[c] * material.ambient[c]);
+        specularColor[c] = _mm_set1_ps(lightIntensity[c] * material.specular[c]);
+    }
+
+    int count = (int)bucket.index.size();
+    for (int first = 0; first < count; first += 4) {
+        const float *block = &bucket.blocks[first / 4 * blockFloats];
+        __m128 px = _mm_loadu_ps(block + 4 * PointX), py = _mm_loadu_ps(block + 4 * PointY), pz = _mm_loadu_ps(block + 4 * PointZ);
+        __m128 nx = _mm_loadu_ps(block + 4 * NormalX), ny = _mm_loadu_ps(block + 4 * NormalY), nz = _mm_loadu_ps(block + 4 * NormalZ);
+
+        __m128 lx = _mm_sub_ps(lightX, px), ly = _mm_sub_ps(lightY, py), lz = _mm_sub_ps(lightZ, pz);
+        Normalize4(lx, ly, lz, fast);
+        __m128 vx = _mm_sub_ps(_mm_loadu_ps(block + 4 * OriginX), px);
+        __m128 vy = _mm_sub_ps(_mm_loadu_ps(block + 4 * OriginY), py);
+        __m128 vz = _mm_sub_ps(_mm_loadu_ps(block + 4 * OriginZ), pz);
+        Normalize4(vx, vy, vz, fast);
+
+        __m128 lDotN = Dot4(lx, ly, lz, nx, ny, nz);
+        __m128 cosTheta = _mm_max_ps(lDotN, zero);
+
+        __m128 rx = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(two, nx), lDotN), lx);
+        __m128 ry = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(two, ny), lDotN), ly);
+        __m128 rz = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(two, nz), lDotN), lz);
+        Normalize4(rx, ry, rz, fast);
+        __m128 cosAlpha = _mm_max_ps(Dot4(rx, ry, rz, vx, vy, vz), zero);
+        __m128 highlight = Pow4(cosAlpha, material.specularIntensity, fast);
+
+        // the fraction of the light each lane sees scales its direct terms, the ambient stays
+        __m128 visibility = _mm_loadu_ps(block + 4 * Visibility);
+        float channels[3][4];
+        for (int c = 0; c < 3; c++) {
+            __m128 specular = _mm_mul_ps(visibility, _mm_mul_ps(specularColor[c], highlight));
+            __m128 diffuse = _mm_mul_ps(visibility, _mm_mul_ps(diffuseColor[c], cosTheta));
+            _mm_storeu_ps(channels[c], _mm_add_ps(_mm_add_ps(specular, diffuse), ambientColor[c]));
+        }
+
+        for (int lane = 0; lane < 4 && first + lane < count; lane++) {
+            colors[bucket.index[first + lane]] = glm::vec3(channels[0][lane], channels[1][lane], channels[2][lane]);
+        }
+    }
+}
+
+#else
+
+void ShadingBatch::ShadeBucket(Bucket &bucket, const glm::vec3 &lightPosition, const glm::vec3 &lightIntensity) {
+
+    const Material &material = *bucket.material;
+
+    for (int i = 0; i < (int)bucket.index.size(); i++) {
+        const float *block = &bucket.blocks[i / 4 * blockFloats];
+        int lane = i % 4;
+        glm::vec3 hitPoint(block[4 * PointX + lane], block[4 * PointY + lane], block[4 * PointZ + lane]);
+        glm::vec3 n(block[4 * NormalX + lane], block[4 * NormalY + lane], block[4 * NormalZ + lane]);
+        glm::vec3 origin(block[4 * OriginX + lane], block[4 * OriginY + lane], block[4 * OriginZ + lane]);
+        float visibility = block[4 * Visibility + lane];
+
+        glm::vec3 l = ShadingNormalize(lightPosition - hitPoint);
+        glm::vec3 v = ShadingNormalize(origin - hitPoint);
+
+        float lDotN = glm::dot(l, n);
+        float cosTheta = std::max(lDotN, 0.0f);
+        glm::vec3 r = ShadingNormalize((2.0f * n * lDotN) - l);
+        float highlight = ShadingPow(std::max(glm::dot(r, v), 0.0f), material.specularIntensity);
+
+        glm::vec3 color;
+        for (int c = 0; c < 3; c++) {
+            float ambient = lightIntensity[c] * material.ambient[c];
+            color[c] = visibility * (lightIntensity[c] * material.specular[c] * highlight) + visibility * (lightIntensity[c] * material.diffuse[c] * cosTheta) + ambient;
+        }
+        colors[bucket.index[i]] = color;
+    }
+}
+
+#endif
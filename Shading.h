@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "Object.h"
+
+/*
+** Phong shading for many hits at once, lit by one point light. Hits are added one at a time and
+** kept in a bucket per material, as blocks of four hits that each store the four x coordinates
+** of the hit points, then the four y coordinates and so on (a structure of arrays per block, so
+** adding a hit is a handful of stores into the last block). Shade then works on a whole block,
+** four hits of the same material, per SSE instruction with the material's constants broadcast.
+** How much of the light each hit sees is one more stream, a fraction from 0 (in shadow) to 1 (fully
+** lit) that is in between in the penumbrae of area lights, and the diffuse and specular terms of each
+** lane are multiplied by it, so a shadow is a multiply rather than a branch or a mask. The colors are
+** the same as GetPhong's, bit for bit, with exact and with fast math.
+*/
+class ShadingBatch {
+  public:
+    ShadingBatch():
+      bucketCount(0)
+    {}
+
+    /* Adds a hit seen from viewOrigin that sees visibility (0 to 1) of the light, and returns its index,
+       for Color once the batch is shaded */
+    int Add(const glm::vec3 &hitPoint, const glm::vec3 &normal, const glm::vec3 &viewOrigin, const Material *material, float visibility);
+
+    /* Shades every hit added so far */
+    void Shade(const glm::vec3 &lightPosition, const glm::vec3 &lightIntensity);
+
+    /* The color of the hit with that index, after Shade */
+    const glm::vec3 &Color(int index) const { return colors[index]; }
+
+    int Size() const { return (int)colors.size(); }
+
+    /* Removes every hit, keeping the memory for the next batch */
+    void Clear();
+
+  private:
+    // The streams of a block, each four floats wide
+    enum Stream { PointX, PointY, PointZ, NormalX, NormalY, NormalZ, OriginX, OriginY, OriginZ, Visibility, StreamCount };
+    static const int blockFloats = 4 * StreamCount;
+
+    // The hits of one material. index is where each hit's color goes
+    class Bucket {
+      public:
+        const Material *material;
+        std::vector<float> blocks;
+        std::vector<int> index;
+    };
+
+    void ShadeBucket(Bucket &bucket, const glm::vec3 &lightPosition, const glm::vec3 &lightIntensity);
+
+    std::vector<Bucket> buckets;  // the first bucketCount are in use, the rest keep their memory
+    int bucketCount;
+    std::vector<glm::vec3> colors;
+};
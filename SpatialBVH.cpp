@@ -0,0 +1,323 @@
+#include "BVH.h"
+
+#include <algorithm>
+
+// The buckets that object splits sort centroids into, as in Build, and that spatial splits cut a node into
+static const int spatialBins = 16;
+// Spatial splits are only looked for where the two children of the best object split overlap by more
+// than this much of the root's surface area, which keeps them to the few nodes where they pay off
+static const float spatialMinOverlap = 1e-5f;
+
+// A primitive, or the part of one that spatial splits left in a node, with the box of that part
+class Reference {
+  public:
+    const Object *object;
+    AABB bounds;
+};
+
+// The best way found to split a node, with the boxes and numbers of references on both sides
+class SpatialSplitChoice {
+  public:
+    SpatialSplitChoice():
+      cost(std::numeric_limits<float>::infinity()),
+      axis(0),
+      bin(0),
+      leftCount(0),
+      rightCount(0)
+    {}
+
+    float cost;
+    int axis, bin;  // the split goes below this bin
+    AABB left, right;
+    int leftCount, rightCount;
+};
+
+class SpatialBuild {
+  public:
+    SpatialBuild(CacheAlignedVector<BVHNode> &nodes, std::vector<const Object *> &primitives):
+      nodes(nodes),
+      primitives(primitives),
+      minOverlap(0.0f)
+    {}
+
+    CacheAlignedVector<BVHNode> &nodes;
+    std::vector<const Object *> &primitives;
+    float minOverlap;  // spatialMinOverlap times the area of the root
+};
+
+static inline int ObjectBin(const Reference &reference, const AABB &centroids, int axis, float scale) {
+    return std::min(spatialBins - 1, (int)((reference.bounds.Center()[axis] - centroids.min[axis]) * scale));
+}
+
+static inline int SpatialBin(float position, const AABB &bounds, int axis, float scale) {
+    return std::max(0, std::min(spatialBins - 1, (int)((position - bounds.min[axis]) * scale)));
+}
+
+static inline float SpatialPlane(int bin, const AABB &bounds, int axis) {
+    return bin == spatialBins ? bounds.max[axis] : bounds.min[axis] + bin * (bounds.max[axis] - bounds.min[axis]) / spatialBins;
+}
+
+// The best split of the references by their centroids along the axis they are most spread out on, the way Build splits
+static bool FindObjectSplit(const std::vector<Reference> &references, const AABB &centroids, SpatialSplitChoice &best) {
+
+    glm::vec3 extent = centroids.Extent();
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    if (extent[axis] <= 0.0f) {
+        return false;
+    }
+    float scale = spatialBins / extent[axis];
+
+    AABB bins[spatialBins];
+    int counts[spatialBins] = {0};
+    for (size_t i = 0; i < references.size(); i++) {
+        int bin = ObjectBin(references[i], centroids, axis, scale);
+        bins[bin].Extend(references[i].bounds);
+        counts[bin]++;
+    }
+
+    AABB rightBounds[spatialBins];
+    int rightCounts[spatialBins];
+    AABB right;
+    int rightCount = 0;
+    for (int bin = spatialBins - 1; bin > 0; bin--) {
+        right.Extend(bins[bin]);
+        rightCount += counts[bin];
+        rightBounds[bin] = right;
+        rightCounts[bin] = rightCount;
+    }
+
+    AABB left;
+    int leftCount = 0;
+    for (int bin = 1; bin < spatialBins; bin++) {
+        left.Extend(bins[bin - 1]);
+        leftCount += counts[bin - 1];
+        float cost = left.HalfArea() * leftCount + rightBounds[bin].HalfArea() * rightCounts[bin];
+        if (leftCount > 0 && rightCounts[bin] > 0 && cost < best.cost) {
+            best.cost = cost;
+            best.axis = axis;
+            best.bin = bin;
+            best.left = left;
+            best.right = rightBounds[bin];
+            best.leftCount = leftCount;
+            best.rightCount = rightCounts[bin];
+        }
+    }
+    return best.cost < std::numeric_limits<float>::infinity();
+}
+
+// The best split of the node's box by a plane on any axis, where the references that cross the plane
+// count on both sides, with only the parts of them that lie on each
+static bool FindSpatialSplit(const std::vector<Reference> &references, const AABB &bounds, SpatialSplitChoice &best) {
+
+    bool found = false;
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = bounds.max[axis] - bounds.min[axis];
+        if (extent <= 0.0f) {
+            continue;
+        }
+        float scale = spatialBins / extent;
+
+        // every reference is clipped to each of the bins it spans, and counted where it starts and ends
+        AABB bins[spatialBins];
+        int entries[spatialBins] = {0}, exits[spatialBins] = {0};
+        for (size_t i = 0; i < references.size(); i++) {
+            const Reference &reference = references[i];
+            int first = SpatialBin(reference.bounds.min[axis], bounds, axis, scale);
+            int last = SpatialBin(reference.bounds.max[axis], bounds, axis, scale);
+            if (first == last) {
+                bins[first].Extend(reference.bounds);
+            } else {
+                for (int bin = first; bin <= last; bin++) {
+                    AABB slab = reference.bounds;
+                    slab.min[axis] = std::max(slab.min[axis], SpatialPlane(bin, bounds, axis));
+                    slab.max[axis] = std::min(slab.max[axis], SpatialPlane(bin + 1, bounds, axis));
+                    bins[bin].Extend(reference.object->ClippedBounds(slab));
+                }
+            }
+            entries[first]++;
+            exits[last]++;
+        }
+
+        AABB rightBounds[spatialBins];
+        int rightCounts[spatialBins];
+        AABB right;
+        int rightCount = 0;
+        for (int bin = spatialBins - 1; bin > 0; bin--) {
+            right.Extend(bins[bin]);
+            rightCount += exits[bin];
+            rightBounds[bin] = right;
+            rightCounts[bin] = rightCount;
+        }
+
+        AABB left;
+        int leftCount = 0;
+        for (int bin = 1; bin < spatialBins; bin++) {
+            left.Extend(bins[bin - 1]);
+            leftCount += entries[bin - 1];
+            float cost = left.HalfArea() * leftCount + rightBounds[bin].HalfArea() * rightCounts[bin];
+            if (leftCount > 0 && rightCounts[bin] > 0 && cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.bin = bin;
+                best.left = left;
+                best.right = rightBounds[bin];
+                best.leftCount = leftCount;
+                best.rightCount = rightCounts[bin];
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+// Sorts the references to the two sides of a spatial split. A reference that crosses the plane is
+// cut in two, unless putting it whole on one side is cheaper (Stich et al.'s "unsplitting") or the
+// budget of duplicates is spent.
+static void SplitSpatially(const std::vector<Reference> &references, const AABB &bounds, SpatialSplitChoice split,
+                           int &duplicates, std::vector<Reference> &left, std::vector<Reference> &right) {
+
+    int axis = split.axis;
+    float scale = spatialBins / (bounds.max[axis] - bounds.min[axis]);
+    float plane = SpatialPlane(split.bin, bounds, axis);
+
+    for (size_t i = 0; i < references.size(); i++) {
+        const Reference &reference = references[i];
+        if (SpatialBin(reference.bounds.max[axis], bounds, axis, scale) < split.bin) {
+            left.push_back(reference);
+            continue;
+        }
+        if (SpatialBin(reference.bounds.min[axis], bounds, axis, scale) >= split.bin) {
+            right.push_back(reference);
+            continue;
+        }
+
+        AABB leftWith = split.left, rightWith = split.right;
+        leftWith.Extend(reference.bounds);
+        rightWith.Extend(reference.bounds);
+        float splitCost = split.left.HalfArea() * split.leftCount + split.right.HalfArea() * split.rightCount;
+        float leftCost = leftWith.HalfArea() * split.leftCount + split.right.HalfArea() * (split.rightCount - 1);
+        float rightCost = split.left.HalfArea() * (split.leftCount - 1) + rightWith.HalfArea() * split.rightCount;
+
+        if (duplicates > 0 && splitCost < std::min(leftCost, rightCost)) {
+            AABB leftHalf = reference.bounds, rightHalf = reference.bounds;
+            leftHalf.max[axis] = plane;
+            rightHalf.min[axis] = plane;
+            Reference leftPart = { reference.object, reference.object->ClippedBounds(leftHalf) };
+            Reference rightPart = { reference.object, reference.object->ClippedBounds(rightHalf) };
+
+            // a primitive that only touches the plane may have nothing on one side after all
+            if (leftPart.bounds.IsEmpty()) {
+                right.push_back(reference);
+            } else if (rightPart.bounds.IsEmpty()) {
+                left.push_back(reference);
+            } else {
+                left.push_back(leftPart);
+                right.push_back(rightPart);
+                duplicates--;
+            }
+        } else if (leftCost <= rightCost) {
+            left.push_back(reference);
+            split.left = leftWith;
+            split.rightCount--;
+        } else {
+            right.push_back(reference);
+            split.right = rightWith;
+            split.leftCount--;
+        }
+    }
+}
+
+// Builds the subtree over references, whose spatial splits may add up to duplicates more references, depth
+// nodes down from the root
+static int BuildNode(SpatialBuild &build, std::vector<Reference> &references, int duplicates, int depth) {
+
+    int index = build.nodes.size();
+    build.nodes.push_back(BVHNode());
+
+    AABB bounds, centroids;
+    for (size_t i = 0; i < references.size(); i++) {
+        bounds.Extend(references[i].bounds);
+        centroids.Extend(references[i].bounds.Center());
+    }
+    build.nodes[index].bounds = bounds;
+
+    int count = references.size();
+    if (count <= bvhMaxLeafSize) {
+        build.nodes[index].offset = build.primitives.size();
+        build.nodes[index].count = count;
+        for (int i = 0; i < count; i++) {
+            build.primitives.push_back(references[i].object);
+        }
+        return index;
+    }
+
+    SpatialSplitChoice objectSplit, spatialSplit;
+    bool haveObjectSplit = depth < bvhMaxDepth && FindObjectSplit(references, centroids, objectSplit);
+
+    // only where the object split leaves the children overlapping is a spatial split worth looking for
+    bool haveSpatialSplit = false;
+    if (duplicates > 0 && depth < bvhMaxDepth && (!haveObjectSplit || objectSplit.left.Intersection(objectSplit.right).HalfArea() > build.minOverlap)) {
+        haveSpatialSplit = FindSpatialSplit(references, bounds, spatialSplit);
+    }
+
+    std::vector<Reference> left, right;
+    if (haveSpatialSplit && spatialSplit.cost < objectSplit.cost) {
+        SplitSpatially(references, bounds, spatialSplit, duplicates, left, right);
+    }
+    if (left.empty() || right.empty()) {
+        left.clear();
+        right.clear();
+        if (haveObjectSplit) {
+            float scale = spatialBins / centroids.Extent()[objectSplit.axis];
+            for (int i = 0; i < count; i++) {
+                bool isLeft = ObjectBin(references[i], centroids, objectSplit.axis, scale) < objectSplit.bin;
+                (isLeft ? left : right).push_back(references[i]);
+            }
+        } else {
+            // all at the same spot, or too deep down for the split to matter, any split will do
+            left.assign(references.begin(), references.begin() + count / 2);
+            right.assign(references.begin() + count / 2, references.end());
+        }
+    }
+
+    // the children's references take the place of these
+    std::vector<Reference>().swap(references);
+
+    // what is left of the budget is shared by the children by their size, so that the first one
+    // built doesn't spend all of it
+    int leftDuplicates = (int)((long long)duplicates * left.size() / (left.size() + right.size()));
+    int rightDuplicates = duplicates - leftDuplicates;
+
+    BuildNode(build, left, leftDuplicates, depth + 1);
+    int second = BuildNode(build, right, rightDuplicates, depth + 1);
+
+    build.nodes[index].offset = second;
+    build.nodes[index].count = 0;
+
+    return index;
+}
+
+void BVH::BuildSpatial(const std::vector<const Object *> &objects, float duplicateBudget) {
+
+    nodes.clear();
+    primitives.clear();
+
+    if (objects.empty()) {
+        return;
+    }
+
+    std::vector<Reference> references(objects.size());
+    AABB bounds;
+    for (size_t i = 0; i < objects.size(); i++) {
+        references[i].object = objects[i];
+        references[i].bounds = objects[i]->Bounds();
+        bounds.Extend(references[i].bounds);
+    }
+
+    SpatialBuild build(nodes, primitives);
+    build.minOverlap = spatialMinOverlap * bounds.HalfArea();
+
+    nodes.reserve(2 * objects.size());
+    primitives.reserve(objects.size());
+    BuildNode(build, references, (int)(duplicateBudget * objects.size()), 1);
+}
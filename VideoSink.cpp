@@ -0,0 +1,101 @@
+#include "VideoSink.h"
+
+#include <algorithm>
+#include <csignal>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+bool ParsePixelFormat(const std::string &name, PixelFormat &format) {
+    if (name == "rgb24") {
+        format = PixelRGB24;
+    } else if (name == "rgba") {
+        format = PixelRGBA;
+    } else if (name == "yuv420p") {
+        format = PixelYUV420;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static unsigned char Quantize(float value) {
+    return (unsigned char)(std::min(std::max(value, 0.0f), 255.0f) + 0.5f);
+}
+
+RawVideoSink::RawVideoSink(PixelFormat format):
+    format(format),
+    fd(-1)
+  {}
+
+RawVideoSink::~RawVideoSink() {
+    if (fd > STDERR_FILENO) {
+        close(fd);
+    }
+}
+
+bool RawVideoSink::Open(const std::string &path) {
+
+    // an encoder that quits early should end the animation with an error, not kill it
+    signal(SIGPIPE, SIG_IGN);
+
+    fd = path == "-" ? STDOUT_FILENO : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Could not open " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool RawVideoSink::WriteFrame(int frame, const Image &image) {
+
+    int pixels = image.width * image.height;
+
+    if (format == PixelRGB24 || format == PixelRGBA) {
+        int stride = format == PixelRGB24 ? 3 : 4;
+        bytes.resize(pixels * stride);
+        for (int i = 0; i < pixels; i++) {
+            const glm::vec3 &color = image.pixels[i];
+            bytes[i * stride + 0] = Quantize(color.x * 255.0f);
+            bytes[i * stride + 1] = Quantize(color.y * 255.0f);
+            bytes[i * stride + 2] = Quantize(color.z * 255.0f);
+            if (stride == 4) {
+                bytes[i * stride + 3] = 255;
+            }
+        }
+    } else {
+        int chromaWidth = (image.width + 1) / 2, chromaHeight = (image.height + 1) / 2;
+        bytes.resize(pixels + 2 * chromaWidth * chromaHeight);
+        unsigned char *luma = &bytes[0];
+        unsigned char *u = luma + pixels;
+        unsigned char *v = u + chromaWidth * chromaHeight;
+
+        for (int i = 0; i < pixels; i++) {
+            glm::vec3 color = glm::clamp(image.pixels[i], 0.0f, 1.0f);
+            luma[i] = Quantize(16.0f + 219.0f * (0.299f * color.x + 0.587f * color.y + 0.114f * color.z));
+        }
+
+        // every chroma sample is the average over its 2x2 pixels, the last row or column repeated for odd sizes
+        for (int cy = 0; cy < chromaHeight; cy++) {
+            int y0 = 2 * cy, y1 = std::min(y0 + 1, image.height - 1);
+            for (int cx = 0; cx < chromaWidth; cx++) {
+                int x0 = 2 * cx, x1 = std::min(x0 + 1, image.width - 1);
+                glm::vec3 color = 0.25f * (glm::clamp(image(x0, y0), 0.0f, 1.0f) + glm::clamp(image(x1, y0), 0.0f, 1.0f) +
+                                           glm::clamp(image(x0, y1), 0.0f, 1.0f) + glm::clamp(image(x1, y1), 0.0f, 1.0f));
+                u[cy * chromaWidth + cx] = Quantize(128.0f + 224.0f * (-0.168736f * color.x - 0.331264f * color.y + 0.5f * color.z));
+                v[cy * chromaWidth + cx] = Quantize(128.0f + 224.0f * (0.5f * color.x - 0.418688f * color.y - 0.081312f * color.z));
+            }
+        }
+    }
+
+    for (size_t written = 0; written < bytes.size();) {
+        ssize_t result = write(fd, &bytes[written], bytes.size() - written);
+        if (result <= 0) {
+            std::cerr << "Could not write frame " << frame << " of the video" << std::endl;
+            return false;
+        }
+        written += result;
+    }
+
+    return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "FrameWriter.h"
+
+enum PixelFormat {
+    PixelRGB24,    // 3 bytes per pixel
+    PixelRGBA,     // 4 bytes per pixel, alpha always 255
+    PixelYUV420    // planar Y, then U and V at half resolution, BT.601 limited range (ffmpeg's yuv420p)
+};
+
+/* Parses the ffmpeg name of a format (rgb24, rgba, yuv420p), false if it isn't one of them */
+bool ParsePixelFormat(const std::string &name, PixelFormat &format);
+
+/*
+** Writes the frames one after the other as raw video, without any header, to stdout or a file
+** or named pipe that an encoder reads from, e.g.
+**   ffmpeg -f rawvideo -pix_fmt yuv420p -s 640x480 -r 30 -i pipe.yuv out.mp4
+** The conversion happens on the FrameWriter's thread, into a buffer that is reused every frame.
+*/
+class RawVideoSink : public FrameSink {
+  public:
+    RawVideoSink(PixelFormat format);
+    ~RawVideoSink();
+
+    /* Opens path for writing, "-" for stdout. A named pipe blocks here until its reader opens it */
+    bool Open(const std::string &path);
+
+    virtual bool WriteFrame(int frame, const Image &image);
+
+  private:
+    PixelFormat format;
+    int fd;
+    std::vector<unsigned char> bytes;
+};
@@ -0,0 +1,268 @@
+#include "WideBVH.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// the primitive counts of leaves have to fit the three low bits of a child
+static_assert(bvhMaxLeafSize < 8, "leaf counts are stored in three bits");
+static_assert(sizeof(WideNode) == 64, "a node should fill one cache line");
+
+static inline int LeafChild(int offset, int count) {
+    return ~(offset << 3 | count);
+}
+
+void WideBVH::Collapse(const BVH &tree) {
+
+    nodes.clear();
+    primitives = tree.Primitives();
+    depth = 0;
+    if (tree.Nodes().empty()) {
+        return;
+    }
+
+    nodes.reserve(tree.Nodes().size() / 2 + 1);
+    CollapseRecursive(tree.Nodes(), 0, 1);
+}
+
+int WideBVH::CollapseRecursive(const CacheAlignedVector<BVHNode> &binary, int index, int level) {
+
+    depth = std::max(depth, level);
+    int out = nodes.size();
+    nodes.push_back(WideNode());
+
+    // open the biggest interior child until there are four; a leaf at the root is the only child
+    int slots[wideBVHWidth];
+    int slotCount = 0;
+    if (binary[index].IsLeaf()) {
+        slots[slotCount++] = index;
+    } else {
+        slots[slotCount++] = index + 1;
+        slots[slotCount++] = binary[index].offset;
+    }
+    while (slotCount < wideBVHWidth) {
+        int biggest = -1;
+        for (int i = 0; i < slotCount; i++) {
+            if (!binary[slots[i]].IsLeaf() && (biggest < 0 || binary[slots[i]].bounds.HalfArea() > binary[slots[biggest]].bounds.HalfArea())) {
+                biggest = i;
+            }
+        }
+        if (biggest < 0) {
+            break;
+        }
+        int opened = slots[biggest];
+        slots[biggest] = opened + 1;
+        slots[slotCount++] = binary[opened].offset;
+    }
+
+    // the children's boxes in 255 steps of the node's box per axis, with the lower bounds rounded
+    // down and the upper ones up, checked with the very arithmetic traversal uses to undo it
+    WideNode node;
+    const AABB &box = binary[index].bounds;
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = box.max[axis] - box.min[axis];
+        node.origin[axis] = box.min[axis];
+        node.scale[axis] = extent > 0.0f ? extent / 255.0f : 1.0f;
+
+        // 255 steps may fall short of the max corner by rounding, then they are made a bit longer
+        while (node.origin[axis] + 255 * node.scale[axis] < box.max[axis]) {
+            node.scale[axis] = nextafterf(node.scale[axis], INFINITY);
+        }
+
+        for (int i = 0; i < wideBVHWidth; i++) {
+            if (i >= slotCount) {
+                node.lower[axis][i] = 255;
+                node.upper[axis][i] = 0;
+                continue;
+            }
+            const AABB &child = binary[slots[i]].bounds;
+            int lower = std::max(0, std::min(255, (int)floorf((child.min[axis] - node.origin[axis]) / node.scale[axis])));
+            while (lower > 0 && node.origin[axis] + lower * node.scale[axis] > child.min[axis]) {
+                lower--;
+            }
+            int upper = std::max(0, std::min(255, (int)ceilf((child.max[axis] - node.origin[axis]) / node.scale[axis])));
+            while (upper < 255 && node.origin[axis] + upper * node.scale[axis] < child.max[axis]) {
+                upper++;
+            }
+            node.lower[axis][i] = lower;
+            node.upper[axis][i] = upper;
+        }
+    }
+
+    for (int i = 0; i < wideBVHWidth; i++) {
+        node.children[i] = emptyChild;
+    }
+    nodes[out] = node;
+
+    for (int i = 0; i < slotCount; i++) {
+        const BVHNode &child = binary[slots[i]];
+        int reference = child.IsLeaf() ? LeafChild(child.offset, child.count) : CollapseRecursive(binary, slots[i], level + 1);
+        nodes[out].children[i] = reference;
+    }
+
+    return out;
+}
+
+#ifdef __SSE2__
+
+// Four bytes widened to four floats
+static inline __m128 LoadSteps(const uint8_t steps[wideBVHWidth]) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i bytes = _mm_cvtsi32_si128(steps[0] | steps[1] << 8 | steps[2] << 16 | steps[3] << 24);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+}
+
+int WideBVH::IntersectChildren(const WideNode &node, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float tMax, float tNear[wideBVHWidth]) const {
+
+    __m128 nearest = _mm_setzero_ps(), farthest = _mm_set1_ps(tMax);
+    for (int axis = 0; axis < 3; axis++) {
+        __m128 base = _mm_set1_ps(node.origin[axis]), scale = _mm_set1_ps(node.scale[axis]);
+        __m128 lower = _mm_add_ps(base, _mm_mul_ps(LoadSteps(node.lower[axis]), scale));
+        __m128 upper = _mm_add_ps(base, _mm_mul_ps(LoadSteps(node.upper[axis]), scale));
+
+        __m128 rayOrigin = _mm_set1_ps(origin[axis]), inverse = _mm_set1_ps(inverseDirection[axis]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(lower, rayOrigin), inverse);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(upper, rayOrigin), inverse);
+        nearest = _mm_max_ps(nearest, _mm_min_ps(t0, t1));
+        farthest = _mm_min_ps(farthest, _mm_max_ps(t0, t1));
+    }
+
+    _mm_storeu_ps(tNear, nearest);
+    return _mm_movemask_ps(_mm_cmple_ps(nearest, farthest));
+}
+
+#else
+
+int WideBVH::IntersectChildren(const WideNode &node, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float tMax, float tNear[wideBVHWidth]) const {
+
+    int mask = 0;
+    for (int i = 0; i < wideBVHWidth; i++) {
+        float nearest = 0.0f, farthest = tMax;
+        for (int axis = 0; axis < 3; axis++) {
+            float lower = node.origin[axis] + node.lower[axis][i] * node.scale[axis];
+            float upper = node.origin[axis] + node.upper[axis][i] * node.scale[axis];
+            float t0 = (lower - origin[axis]) * inverseDirection[axis];
+            float t1 = (upper - origin[axis]) * inverseDirection[axis];
+            nearest = std::max(nearest, std::min(t0, t1));
+            farthest = std::min(farthest, std::max(t0, t1));
+        }
+        tNear[i] = nearest;
+        mask |= (nearest <= farthest) << i;
+    }
+    return mask;
+}
+
+#endif
+
+bool WideBVH::Intersect(const Ray &ray, IntersectInfo &info) const {
+
+    if (nodes.empty()) {
+        return false;
+    }
+
+    // the boxes give ray parameters, the hits give distances
+    float length = glm::length(ray.direction);
+    glm::vec3 inverseDirection = 1.0f / ray.direction;
+
+    IntersectInfo closest;
+    bool hit = false;
+
+    // children are pushed farthest first, with where the ray enters them, so that the nearest is
+    // visited first and the others can be dropped if a hit has been found in front of them by then
+    int stack[wideBVHStackSize];
+    float stackNear[wideBVHStackSize];
+    int top = 0;
+    stack[top] = 0;
+    stackNear[top++] = 0.0f;
+
+    while (top > 0) {
+        top--;
+        int child = stack[top];
+        if (stackNear[top] * length > closest.time) {
+            continue;
+        }
+
+        if (child < 0) {
+            int offset = ~child >> 3, count = ~child & 7;
+            for (int i = offset; i < offset + count; i++) {
+                IntersectInfo candidate;
+                if (primitives[i]->Intersect(ray, candidate) && candidate.time < closest.time) {
+                    closest = candidate;
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        const WideNode &node = nodes[child];
+        float tNear[wideBVHWidth];
+        int mask = IntersectChildren(node, ray.origin, inverseDirection, closest.time / length, tNear);
+
+        int order[wideBVHWidth];
+        int hits = 0;
+        for (int i = 0; i < wideBVHWidth; i++) {
+            if ((mask >> i & 1) && node.children[i] != emptyChild) {
+                // insertion sort by entry, farthest first
+                int j = hits++;
+                for (; j > 0 && tNear[order[j - 1]] < tNear[i]; j--) {
+                    order[j] = order[j - 1];
+                }
+                order[j] = i;
+            }
+        }
+        for (int j = 0; j < hits; j++) {
+            stack[top] = node.children[order[j]];
+            stackNear[top++] = tNear[order[j]];
+        }
+    }
+
+    if (hit) {
+        info = closest;
+    }
+
+    return hit;
+}
+
+const Object *WideBVH::Occluder(const Ray &ray, float distance) const {
+
+    if (nodes.empty()) {
+        return NULL;
+    }
+
+    float length = glm::length(ray.direction);
+    glm::vec3 inverseDirection = 1.0f / ray.direction;
+
+    int stack[wideBVHStackSize];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        int child = stack[--top];
+
+        if (child < 0) {
+            int offset = ~child >> 3, count = ~child & 7;
+            for (int i = offset; i < offset + count; i++) {
+                IntersectInfo candidate;
+                if (primitives[i]->Intersect(ray, candidate) && candidate.time < distance) {
+                    return primitives[i];
+                }
+            }
+            continue;
+        }
+
+        // any hit will do, so the order of the children doesn't matter
+        const WideNode &node = nodes[child];
+        float tNear[wideBVHWidth];
+        int mask = IntersectChildren(node, ray.origin, inverseDirection, distance / length, tNear);
+        for (int i = 0; i < wideBVHWidth; i++) {
+            if ((mask >> i & 1) && node.children[i] != emptyChild) {
+                stack[top++] = node.children[i];
+            }
+        }
+    }
+
+    return NULL;
+}
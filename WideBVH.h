@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "BVH.h"
+
+// The children of a WideBVH node
+const int wideBVHWidth = 4;
+// Every traversal step pops one node and pushes up to four children, so a tree of depth d needs stacks of
+// 3d + 1 entries. These hold the deepest trees collapsed from binary ones the BVH traversal can take, as
+// collapsing never makes a tree deeper; Collapse records the depth so that deeper ones can be told apart.
+const int wideBVHMaxDepth = bvhStackSize - 1;
+const int wideBVHStackSize = 3 * wideBVHMaxDepth + 1;
+
+/*
+** One node of a WideBVH, the size of a cache line (64 bytes). The boxes of the node's children
+** are stored as 8 bit steps within the node's own box, rounded outwards so they still enclose the
+** children, and laid out one array per axis and side, so one SSE instruction handles a bound of all
+** four children at once.
+*/
+class WideNode {
+  public:
+    float origin[3];                      // the min corner of the node's box
+    float scale[3];                       // the size of one step along each axis
+    uint8_t lower[3][wideBVHWidth];       // the children's min corners, in steps from origin
+    uint8_t upper[3][wideBVHWidth];       // and their max corners
+    int children[wideBVHWidth];           // see WideBVH
+};
+
+/*
+** A four wide BVH, collapsed from a binary one: every node takes the place of up to three levels
+** of the binary tree, by opening the child with the largest surface area until there are four. A
+** ray is tested against all of a node's children at once, and the tree has under a quarter of the
+** binary one's nodes at twice their size, so it takes half the memory and fewer cache lines per ray.
+** A child is the index of another node, or for a leaf ~(offset << 3 | count) of its primitives,
+** and emptyChild where a node has fewer than four.
+*/
+class WideBVH {
+  public:
+    WideBVH():
+      depth(0)
+    {}
+
+    static const int emptyChild = -1;
+
+    /* Collapses tree into this one. The primitives are copied, so tree can be changed or dropped
+       afterwards; after it is refitted, it has to be collapsed again */
+    void Collapse(const BVH &tree);
+
+    /* Finds the closest hit along the ray, like Object::Intersect */
+    bool Intersect(const Ray &ray, IntersectInfo &info) const;
+
+    /* Any primitive the ray hits less than distance away, NULL if there is none, like BVH::Occluder */
+    const Object *Occluder(const Ray &ray, float distance) const;
+
+    const CacheAlignedVector<WideNode> &Nodes() const { return nodes; }
+    /* The most nodes on a path from the root, which the traversal can take up to wideBVHMaxDepth */
+    int Depth() const { return depth; }
+
+  private:
+    int CollapseRecursive(const CacheAlignedVector<BVHNode> &binary, int index, int level);
+    /* The ray parameters at which the ray enters each of the node's children's boxes, and a bit per child it hits no later than tMax */
+    int IntersectChildren(const WideNode &node, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float tMax, float tNear[wideBVHWidth]) const;
+
+    CacheAlignedVector<WideNode> nodes;
+    std::vector<const Object *> primitives;  // in leaf order
+    int depth;
+};
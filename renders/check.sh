@@ -0,0 +1,17 @@
+#!/bin/sh
+# Renders the canonical scenes and compares each against its reference in renders/reference, stopping
+# at the first that fails (see —REGRESSION RENDERS— in readme.txt). Run from the top of the repo:
+#   renders/check.sh [path to the RayTracer binary, ./RayTracer by default] [more RayTracer options]
+# The error image of a scene X goes to diff_X.ppm.
+
+raytracer=${1:-./RayTracer}
+[ $# -gt 0 ] && shift
+
+for scene in default saltire sdf instances; do
+    if ! "$raytracer" --scene $scene --compare renders/reference/$scene.ppm --diff diff_$scene.ppm "$@"; then
+        echo "Regression in the $scene scene, see diff_$scene.ppm" >&2
+        exit 1
+    fi
+done
+
+echo "All scenes match their references"